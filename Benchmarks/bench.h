@@ -0,0 +1,263 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+// Shared by the benchmarks in this directory. Each one takes a world's region directory,
+// or builds a synthetic world in a temporary directory when given none, so runs can be repeated anywhere.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "minecraft/nbt.hpp"
+#include "minecraft/worldio.h"
+
+namespace bench
+{
+	using clock = std::chrono::steady_clock;
+
+	// Peak resident memory of the process so far, in bytes.
+	inline size_t PeakRSS()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters{};
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+		return counters.PeakWorkingSetSize;
+#else
+		rusage usage{};
+		getrusage(RUSAGE_SELF, &usage);
+		return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+	}
+
+	// Page faults taken by the process so far.
+	inline size_t PageFaults()
+	{
+#ifdef _WIN32
+		PROCESS_MEMORY_COUNTERS counters{};
+		GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+		return counters.PageFaultCount;
+#else
+		rusage usage{};
+		getrusage(RUSAGE_SELF, &usage);
+		return static_cast<size_t>(usage.ru_minflt + usage.ru_majflt);
+#endif
+	}
+
+	// Runs body repeats times and returns the fastest run in seconds, which is the least disturbed by everything else on the machine.
+	template<typename Body>
+	double Best(int repeats, Body&& body)
+	{
+		double best = 1e300;
+		for (int i = 0; i < repeats; i++)
+		{
+			clock::time_point start = clock::now();
+			body();
+			best = std::min(best, std::chrono::duration<double>(clock::now() - start).count());
+		}
+		return best;
+	}
+
+	// Throughput is left out when bytes is 0.
+	inline void Report(std::string_view name, double seconds, size_t items, size_t bytes)
+	{
+		std::printf("%-28.*s %9.3f ms %9.2f us/chunk", static_cast<int>(name.size()), name.data(),
+			seconds * 1e3, seconds * 1e6 / std::max<size_t>(items, 1));
+		if (bytes != 0)
+			std::printf(" %9.1f MB/s", bytes / seconds / 1e6);
+		std::printf("\n");
+	}
+
+	// A 1.18+ chunk with the usual mix of sections, palettes, light arrays and block entities, the same for the same seed.
+	inline std::vector<std::byte> SyntheticChunk(uint32_t seed, int chunkX, int chunkZ)
+	{
+		std::mt19937 random(seed);
+		nbt::nbtout out;
+		auto key = [&](nbt::tag type, std::string_view name)
+		{
+			out.write(type);
+			out.write(name);
+		};
+		auto longs = [&](std::string_view name, int count)
+		{
+			key(nbt::tag::LONGARRAY, name);
+			out.write(int32_t(count));
+			for (int i = 0; i < count; i++)
+				out.write(static_cast<int64_t>(random()) << 32 | random());
+		};
+		auto string = [&](std::string_view name, std::string_view value)
+		{
+			key(nbt::tag::STRING, name);
+			out.write(value);
+		};
+		static constexpr std::string_view blocks[] = { "minecraft:stone", "minecraft:deepslate", "minecraft:dirt", "minecraft:iron_ore", "minecraft:water", "minecraft:oak_log" };
+
+		key(nbt::tag::COMPOUND, "");
+		key(nbt::tag::INT, "DataVersion");
+		out.write(int32_t(3465));
+		key(nbt::tag::INT, "xPos");
+		out.write(int32_t(chunkX));
+		key(nbt::tag::INT, "zPos");
+		out.write(int32_t(chunkZ));
+		key(nbt::tag::INT, "yPos");
+		out.write(int32_t(-4));
+		string("Status", "minecraft:full");
+		key(nbt::tag::LONG, "LastUpdate");
+		out.write(int64_t(random()));
+		key(nbt::tag::LONG, "InhabitedTime");
+		out.write(int64_t(random() % 10000));
+
+		key(nbt::tag::LIST, "sections");
+		out.write(nbt::tag::COMPOUND);
+		out.write(int32_t(24));
+		for (int section = 0; section < 24; section++)
+		{
+			key(nbt::tag::BYTE, "Y");
+			out.write(int8_t(section - 4));
+			key(nbt::tag::COMPOUND, "block_states");
+			key(nbt::tag::LIST, "palette");
+			out.write(nbt::tag::COMPOUND);
+			int palette = 1 + random() % 12;
+			out.write(int32_t(palette));
+			for (int i = 0; i < palette; i++)
+			{
+				string("Name", blocks[random() % std::size(blocks)]);
+				if (random() % 3 == 0)
+				{
+					key(nbt::tag::COMPOUND, "Properties");
+					string("axis", "y");
+					string("waterlogged", "false");
+					out.write(nbt::tag::NONE);
+				}
+				out.write(nbt::tag::NONE);
+			}
+			if (palette > 1)
+				longs("data", 256);
+			out.write(nbt::tag::NONE);
+			key(nbt::tag::COMPOUND, "biomes");
+			key(nbt::tag::LIST, "palette");
+			out.write(nbt::tag::STRING);
+			out.write(int32_t(2));
+			out.write(std::string_view("minecraft:plains"));
+			out.write(std::string_view("minecraft:river"));
+			longs("data", 1);
+			out.write(nbt::tag::NONE);
+			for (std::string_view light : { "BlockLight", "SkyLight" })
+			{
+				key(nbt::tag::BYTEARRAY, light);
+				out.write(int32_t(2048));
+				for (int i = 0; i < 2048; i++)
+					out.write(int8_t(i % 16 == 0 ? random() : 0));
+			}
+			out.write(nbt::tag::NONE);
+		}
+
+		key(nbt::tag::COMPOUND, "Heightmaps");
+		longs("MOTION_BLOCKING", 37);
+		longs("WORLD_SURFACE", 37);
+		longs("OCEAN_FLOOR", 37);
+		out.write(nbt::tag::NONE);
+
+		key(nbt::tag::LIST, "block_entities");
+		out.write(nbt::tag::COMPOUND);
+		int entities = random() % 8;
+		out.write(int32_t(entities));
+		for (int i = 0; i < entities; i++)
+		{
+			string("id", "minecraft:chest");
+			key(nbt::tag::INT, "x");
+			out.write(int32_t(chunkX * 16 + i));
+			key(nbt::tag::INT, "y");
+			out.write(int32_t(64));
+			key(nbt::tag::INT, "z");
+			out.write(int32_t(chunkZ * 16 + i));
+			key(nbt::tag::LIST, "Items");
+			out.write(nbt::tag::COMPOUND);
+			out.write(int32_t(5));
+			for (int slot = 0; slot < 5; slot++)
+			{
+				key(nbt::tag::BYTE, "Slot");
+				out.write(int8_t(slot));
+				string("id", "minecraft:diamond");
+				key(nbt::tag::BYTE, "Count");
+				out.write(int8_t(1 + random() % 64));
+				out.write(nbt::tag::NONE);
+			}
+			out.write(nbt::tag::NONE);
+		}
+		out.write(nbt::tag::NONE);
+		return std::move(out.buffer);
+	}
+
+	// Writes regions x regions synthetic region files, chunksPerRegion chunks each, into a fresh directory under the temp directory.
+	inline std::string SyntheticWorld(int regions, size_t chunksPerRegion)
+	{
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "anvil_bench_world";
+		std::filesystem::remove_all(directory);
+		std::filesystem::create_directories(directory);
+		for (int regionX = 0; regionX < regions; regionX++)
+		{
+			for (int regionZ = 0; regionZ < regions; regionZ++)
+			{
+				worldio::RegionWriter writer((directory / ("r." + std::to_string(regionX) + "." + std::to_string(regionZ) + ".mca")).string());
+				for (size_t index = 0; index < chunksPerRegion; index++)
+				{
+					int chunkX = regionX * 32 + static_cast<int>(index % 32);
+					int chunkZ = regionZ * 32 + static_cast<int>(index / 32);
+					std::vector<std::byte> chunk = SyntheticChunk(static_cast<uint32_t>(chunkX * 7919 + chunkZ), chunkX, chunkZ);
+					nbt::nbtin in(chunk);
+					writer.SaveChunk(index, nbt::load(in), worldio::compression::ZLIB, 1);
+				}
+			}
+		}
+		return directory.string();
+	}
+
+	// The region files of a directory.
+	inline std::vector<std::string> RegionFiles(const std::string& directory)
+	{
+		std::vector<std::string> files;
+		for (const auto& entry : std::filesystem::directory_iterator(directory))
+		{
+			int regionX, regionZ;
+			if (entry.is_regular_file() && worldio::RegionFile::ParseName(entry.path().filename().string(), regionX, regionZ))
+				files.push_back(entry.path().string());
+		}
+		std::sort(files.begin(), files.end());
+		return files;
+	}
+
+	// Up to limit decompressed chunks from the world in directory, or from a synthetic world if directory is empty.
+	inline std::vector<std::vector<std::byte>> Chunks(std::string directory, size_t limit)
+	{
+		if (directory.empty())
+			directory = SyntheticWorld(1, std::min<size_t>(limit, worldio::CHUNKS_PER_REGION));
+		std::vector<std::vector<std::byte>> chunks;
+		for (const std::string& file : RegionFiles(directory))
+		{
+			worldio::RegionFile region(file);
+			for (size_t index = 0; index < worldio::CHUNKS_PER_REGION && chunks.size() < limit; index++)
+			{
+				zlib::vector data;
+				if (region.ReadChunk(index, data) != 0)
+					chunks.emplace_back(data.begin(), data.end());
+			}
+		}
+		return chunks;
+	}
+}
+
+#endif // BENCH_H
@@ -0,0 +1,93 @@
+// Parsing chunks into an nbt::arena with one kept arena_reader, against nbt::load building the usual tree of vectors and strings.
+// Every chunk's tree is kept until the end of a pass, the way a world load holds them, then freed in one go.
+// Each reader runs in a process of its own so their peak resident memory can be compared.
+//
+//	g++ -std=c++20 -O2 -I../Source bench_arena.cpp ../Source/minecraft/worldio.cpp ../Source/zlib_helper.cpp ../Source/zlib_inflate.cpp ../Source/lz4_helper.cpp ../Source/thread_pool.cpp -lz -lpthread -o bench_arena
+//	./bench_arena [region directory]
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "minecraft/nbt_arena.hpp"
+
+namespace
+{
+	constexpr size_t CHUNK_LIMIT = 512;
+	constexpr int REPEATS = 5;
+
+	void Run(const std::string& reader, const std::string& directory)
+	{
+		std::vector<std::vector<std::byte>> chunks = bench::Chunks(directory, CHUNK_LIMIT);
+		size_t bytes = 0;
+		for (const std::vector<std::byte>& chunk : chunks)
+			bytes += chunk.size();
+		size_t before = bench::PeakRSS();
+
+		double parse = 0;
+		double release = 0;
+		if (reader == "load")
+		{
+			std::vector<nbt::NBTree> trees;
+			trees.reserve(chunks.size());
+			parse = bench::Best(REPEATS, [&]
+			{
+				trees.clear();
+				for (const std::vector<std::byte>& chunk : chunks)
+				{
+					nbt::nbtin in(chunk);
+					trees.push_back(nbt::load(in));
+				}
+			});
+			release = bench::Best(1, [&] { trees.clear(); });
+		}
+		else
+		{
+			nbt::arena memory;
+			nbt::arena_reader arenaReader(memory);
+			std::vector<nbt::a_tree> trees;
+			trees.reserve(chunks.size());
+			parse = bench::Best(REPEATS, [&]
+			{
+				trees.clear();
+				memory.reset();
+				for (const std::vector<std::byte>& chunk : chunks)
+				{
+					nbt::nbtin in(chunk);
+					trees.push_back(arenaReader.load(in));
+				}
+			});
+			release = bench::Best(1, [&]
+			{
+				trees.clear();
+				memory.reset();
+			});
+		}
+
+		bench::Report(reader == "load" ? "nbt::load" : "nbt::arena_reader", parse, chunks.size(), bytes);
+		std::printf("%-28s %9.3f ms to free, peak RSS up %.1f MiB for %.1f MiB of NBT\n", "",
+			release * 1e3, (bench::PeakRSS() - before) / 1048576.0, bytes / 1048576.0);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 3 && std::string(argv[1]) == "--run")
+	{
+		Run(argv[2], argv[3]);
+		return 0;
+	}
+
+	std::string directory = argc > 1 ? argv[1] : bench::SyntheticWorld(1, CHUNK_LIMIT);
+	std::printf("Up to %zu chunks from %s\n", CHUNK_LIMIT, directory.c_str());
+	std::fflush(stdout);
+	for (const char* reader : { "load", "arena" })
+	{
+		std::string command = std::string("\"") + argv[0] + "\" --run " + reader + " \"" + directory + "\"";
+		if (std::system(command.c_str()) != 0)
+			return 1;
+	}
+	return 0;
+}
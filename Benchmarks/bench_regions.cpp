@@ -0,0 +1,106 @@
+// Reading region files through worldio::RegionFile, which maps the file and hands out spans,
+// against the older path of copying the whole file in with zlib::ReadFile and decoding the header out of the copy.
+// Both decompress every chunk with zlib::Decompress, and the files are warm in the page cache after the first repeat.
+//
+//	g++ -std=c++20 -O2 -I../Source bench_regions.cpp ../Source/minecraft/worldio.cpp ../Source/zlib_helper.cpp ../Source/zlib_inflate.cpp ../Source/lz4_helper.cpp ../Source/thread_pool.cpp -lz -lpthread -o bench_regions
+//	./bench_regions [region directory]
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "zlib_helper.h"
+
+namespace
+{
+	inline uint32_t ReadBigEndian(const std::byte* p)
+	{
+		return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | static_cast<uint32_t>(p[3]);
+	}
+
+	// zlib::ReadFile streams through basic_ifstream<std::byte>, which only MSVC's standard library can do.
+	// Elsewhere the same copy, a byte at a time through istreambuf_iterator, goes through a char stream.
+	zlib::vector ReadWholeFile(const std::string& filename)
+	{
+#ifdef _MSC_VER
+		return zlib::ReadFile(filename);
+#else
+		std::ifstream file(filename, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("Could not open the file.");
+		zlib::vector data;
+		for (std::istreambuf_iterator<char> scan(file), end; scan != end; ++scan)
+			data.push_back(static_cast<std::byte>(*scan));
+		return data;
+#endif
+	}
+
+	// What reading a region took before RegionFile: the whole file copied into memory, then sliced by hand.
+	size_t ReadCopied(const std::string& filename, bool decompress, size_t& bytes)
+	{
+		zlib::vector file = ReadWholeFile(filename);
+		if (file.size() < worldio::HEADER_SIZE)
+			return 0;
+		size_t chunks = 0;
+		for (size_t index = 0; index < worldio::CHUNKS_PER_REGION; index++)
+		{
+			uint32_t location = ReadBigEndian(file.data() + index * 4);
+			size_t offset = static_cast<size_t>(location >> 8) * worldio::SECTOR_SIZE;
+			if (location == 0 || offset + worldio::CHUNK_HEADER_SIZE > file.size())
+				continue;
+			size_t length = ReadBigEndian(file.data() + offset);
+			if (length == 0 || offset + 4 + length > file.size())
+				continue;
+			chunks++;
+			if (decompress)
+				bytes += zlib::Decompress(reinterpret_cast<const char*>(file.data() + offset + worldio::CHUNK_HEADER_SIZE), length - 1).size();
+		}
+		return chunks;
+	}
+
+	size_t ReadMapped(const std::string& filename, bool decompress, size_t& bytes)
+	{
+		worldio::RegionFile region(filename);
+		size_t chunks = 0;
+		for (size_t index = 0; index < worldio::CHUNKS_PER_REGION; index++)
+		{
+			std::span<const std::byte> payload = region.Payload(index);
+			if (payload.empty())
+				continue;
+			chunks++;
+			if (decompress)
+				bytes += zlib::Decompress(reinterpret_cast<const char*>(payload.data()), payload.size()).size();
+		}
+		return chunks;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::string directory = argc > 1 ? argv[1] : bench::SyntheticWorld(3, worldio::CHUNKS_PER_REGION / 4);
+	std::vector<std::string> files = bench::RegionFiles(directory);
+	std::printf("%zu region files in %s\n", files.size(), directory.c_str());
+
+	for (bool decompress : { false, true })
+	{
+		std::printf(decompress ? "\nOpen, find and decompress every chunk\n" : "\nOpen and find every chunk\n");
+		for (auto [name, read] : { std::pair{ "zlib::ReadFile", &ReadCopied }, std::pair{ "RegionFile", &ReadMapped } })
+		{
+			size_t chunks = 0;
+			size_t bytes = 0;
+			size_t faults = bench::PageFaults();
+			double seconds = bench::Best(5, [&]
+			{
+				chunks = 0;
+				bytes = 0;
+				for (const std::string& file : files)
+					chunks += read(file, decompress, bytes);
+			});
+			bench::Report(name, seconds, chunks, bytes);
+			std::printf("%-28s %9zu page faults over 5 repeats\n", "", bench::PageFaults() - faults);
+		}
+	}
+}
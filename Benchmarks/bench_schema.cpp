@@ -0,0 +1,77 @@
+// Decoding chunks straight into chunk::ChunkData with nbt::load_schema, against the generic nbt::load
+// that builds the whole tree through read_compound, and against load followed by picking the same fields out of the tree.
+//
+//	g++ -std=c++20 -O2 -I../Source bench_schema.cpp ../Source/minecraft/worldio.cpp ../Source/zlib_helper.cpp ../Source/zlib_inflate.cpp ../Source/lz4_helper.cpp ../Source/thread_pool.cpp -lz -lpthread -o bench_schema
+//	./bench_schema [region directory]
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "minecraft/chunk.h"
+
+namespace
+{
+	constexpr size_t CHUNK_LIMIT = 256;
+	constexpr int REPEATS = 10;
+
+	// What a caller of nbt::load does to get at the fields ChunkData holds.
+	size_t PickFields(const nbt::NBTree& tree)
+	{
+		size_t found = 0;
+		const nbt::t_compound* root = std::get_if<nbt::t_compound>(&tree.root);
+		if (root == nullptr)
+			return 0;
+		for (std::string_view key : { "DataVersion", "xPos", "zPos", "yPos" })
+			found += root->find(key) != root->end();
+		auto sections = root->find("sections");
+		if (sections == root->end() || !std::holds_alternative<nbt::t_list>(sections->second))
+			return found;
+		const nbt::t_list& list = std::get<nbt::t_list>(sections->second);
+		if (list.type() != nbt::tag::COMPOUND)
+			return found;
+		for (const nbt::t_compound& section : std::get<std::vector<nbt::t_compound>>(list.data))
+		{
+			for (std::string_view key : { "Y", "block_states", "biomes", "BlockLight", "SkyLight" })
+				found += section.find(key) != section.end();
+		}
+		return found;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::vector<std::byte>> chunks = bench::Chunks(argc > 1 ? argv[1] : "", CHUNK_LIMIT);
+	size_t bytes = 0;
+	for (const std::vector<std::byte>& chunk : chunks)
+		bytes += chunk.size();
+	std::printf("%zu chunks, %.1f MiB of NBT\n", chunks.size(), bytes / 1048576.0);
+
+	size_t sink = 0;
+	bench::Report("nbt::load", bench::Best(REPEATS, [&]
+	{
+		for (const std::vector<std::byte>& chunk : chunks)
+		{
+			nbt::nbtin in(chunk);
+			sink += nbt::load(in).name.size();
+		}
+	}), chunks.size(), bytes);
+	bench::Report("nbt::load + field lookups", bench::Best(REPEATS, [&]
+	{
+		for (const std::vector<std::byte>& chunk : chunks)
+		{
+			nbt::nbtin in(chunk);
+			sink += PickFields(nbt::load(in));
+		}
+	}), chunks.size(), bytes);
+	bench::Report("nbt::load_schema", bench::Best(REPEATS, [&]
+	{
+		for (const std::vector<std::byte>& chunk : chunks)
+		{
+			nbt::nbtin in(chunk);
+			sink += nbt::load_schema<chunk::ChunkData>(in).sections.size();
+		}
+	}), chunks.size(), bytes);
+	return sink == 0;
+}
@@ -0,0 +1,30 @@
+// libFuzzer target for nbt::load. Anything that loads has to write back out and hash the same when loaded again.
+// clang++ -std=c++20 -g -O1 -fsanitize=fuzzer,address,undefined -I../Source fuzz_load.cpp -o fuzz_load
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+#include "minecraft/nbt.hpp"
+#include "minecraft/nbt_hash.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	nbt::NBTree tree;
+	try
+	{
+		nbt::nbtin in(data, size);
+		tree = nbt::load(in, nbt::read_limits{ 512, 64 * 1024 * 1024 });
+	}
+	catch (const std::exception&)
+	{
+		return 0;
+	}
+
+	nbt::nbtout out;
+	nbt::dump(tree, out);
+	nbt::nbtin again(out.buffer.data(), out.buffer.size());
+	if (nbt::hash(again) != nbt::hash(tree))
+		__builtin_trap();
+	return 0;
+}
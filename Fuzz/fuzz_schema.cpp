@@ -0,0 +1,22 @@
+// libFuzzer target for nbt::load_schema, decoding into the chunk schema.
+// clang++ -std=c++20 -g -O1 -fsanitize=fuzzer,address,undefined -I../Source fuzz_schema.cpp -o fuzz_schema
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+#include "minecraft/chunk.h"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	try
+	{
+		nbt::nbtin in(data, size);
+		in.limit(nbt::read_limits{ 512, 64 * 1024 * 1024 });
+		(void)nbt::load_schema<chunk::ChunkData>(in);
+	}
+	catch (const std::exception&)
+	{
+	}
+	return 0;
+}
@@ -0,0 +1,58 @@
+// libFuzzer target for skip_tag, visit and find_path. Whatever nbt::load accepts, skip_tag has to
+// get past and end up in the same place.
+// clang++ -std=c++20 -g -O1 -fsanitize=fuzzer,address,undefined -I../Source fuzz_skip.cpp -o fuzz_skip
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+#include "minecraft/nbt.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	const std::byte* loaded = nullptr;
+	try
+	{
+		nbt::nbtin in(data, size);
+		(void)nbt::load(in, nbt::read_limits{ 512, 64 * 1024 * 1024 });
+		loaded = in.scan;
+	}
+	catch (const std::exception&)
+	{
+	}
+
+	try
+	{
+		nbt::nbtin in(data, size);
+		nbt::tag type = in.read_type();
+		in.skip(in.read_u16());
+		nbt::skip_tag(in, type);
+		if (loaded != nullptr && in.scan != loaded)
+			__builtin_trap();
+	}
+	catch (const std::exception&)
+	{
+		if (loaded != nullptr)
+			__builtin_trap();
+	}
+
+	try
+	{
+		nbt::nbtin in(data, size);
+		nbt::sax_visitor visitor;
+		nbt::visit(in, visitor);
+	}
+	catch (const std::exception&)
+	{
+	}
+
+	try
+	{
+		nbt::nbtin in(data, size);
+		(void)nbt::find_path(in, "sections.0.block_states");
+	}
+	catch (const std::exception&)
+	{
+	}
+	return 0;
+}
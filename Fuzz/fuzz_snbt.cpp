@@ -0,0 +1,28 @@
+// libFuzzer target for nbt::parse_snbt. Anything that parses has to print and parse again to the same tree.
+// clang++ -std=c++20 -g -O1 -fsanitize=fuzzer,address,undefined -I../Source fuzz_snbt.cpp -o fuzz_snbt
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string_view>
+
+#include "minecraft/nbt_hash.hpp"
+#include "minecraft/nbt_snbt.hpp"
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	nbt::NBTree tree;
+	try
+	{
+		tree = nbt::parse_snbt(std::string_view(reinterpret_cast<const char*>(data), size));
+	}
+	catch (const std::exception&)
+	{
+		return 0;
+	}
+
+	nbt::NBTree again = nbt::parse_snbt(nbt::to_snbt(tree));
+	if (nbt::hash(again) != nbt::hash(tree))
+		__builtin_trap();
+	return 0;
+}
@@ -0,0 +1,51 @@
+// libFuzzer target for nbt::view, reading back every value it indexed.
+// clang++ -std=c++20 -g -O1 -fsanitize=fuzzer,address,undefined -I../Source fuzz_view.cpp -o fuzz_view
+
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+
+#include "minecraft/nbt_view.hpp"
+
+static void Walk(const nbt::view_value& value)
+{
+	switch (value.type())
+	{
+	case nbt::tag::LIST:
+	case nbt::tag::COMPOUND:
+		for (size_t i = 0; i < value.size(); i++)
+			Walk(value.at(i));
+		break;
+	case nbt::tag::STRING:
+		(void)value.as_string();
+		break;
+	case nbt::tag::BYTEARRAY:
+		(void)value.as_bytearray();
+		break;
+	case nbt::tag::INTARRAY:
+		for (int32_t item : value.as_intarray())
+			(void)item;
+		break;
+	case nbt::tag::LONGARRAY:
+		for (int64_t item : value.as_longarray())
+			(void)item;
+		break;
+	default:
+		(void)value.get<double>();
+		break;
+	}
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+	try
+	{
+		nbt::nbtin in(data, size);
+		nbt::view index(in);
+		Walk(index.root());
+	}
+	catch (const std::exception&)
+	{
+	}
+	return 0;
+}
@@ -0,0 +1,155 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <utility>
+
+// A fixed capacity queue that any number of threads can push to and pop from without locks.
+// Every slot carries a sequence number telling producers and consumers whose turn it is
+// (Dmitry Vyukov's bounded MPMC queue). Push waits while the queue is full, which is what
+// holds a fast stage back when the one after it can't keep up.
+template <typename T>
+class BoundedQueue
+{
+public:
+	// The capacity is rounded up to a power of two.
+	explicit BoundedQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity)
+			size *= 2;
+		mask = size - 1;
+		cells = std::make_unique<Cell[]>(size);
+		for (size_t i = 0; i < size; i++)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	BoundedQueue(const BoundedQueue&) = delete;
+	BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+	[[nodiscard]] inline size_t Capacity() const
+	{
+		return mask + 1;
+	}
+
+	// Returns false if the queue is full.
+	bool TryPush(T& value)
+	{
+		size_t position = tail.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+			if (difference == 0)
+			{
+				if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					cell.value = std::move(value);
+					cell.sequence.store(position + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = tail.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Returns false if the queue is empty.
+	bool TryPop(T& value)
+	{
+		size_t position = head.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			Cell& cell = cells[position & mask];
+			size_t sequence = cell.sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+			if (difference == 0)
+			{
+				if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+				{
+					value = std::move(cell.value);
+					cell.sequence.store(position + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (difference < 0)
+			{
+				return false;
+			}
+			else
+			{
+				position = head.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Waits for room. Gives up and returns false if the queue is closed while full, so a producer
+	// can't be left waiting on consumers that are gone.
+	bool Push(T value)
+	{
+		for (unsigned spins = 0; !TryPush(value); spins++)
+		{
+			if (closed.load(std::memory_order_acquire))
+				return false;
+			Backoff(spins);
+		}
+		return true;
+	}
+
+	// Waits for a value. Returns false once the queue is closed and empty.
+	bool Pop(T& value)
+	{
+		for (unsigned spins = 0; !TryPop(value); spins++)
+		{
+			if (closed.load(std::memory_order_acquire))
+				return TryPop(value);
+			Backoff(spins);
+		}
+		return true;
+	}
+
+	// Tells consumers nothing more is coming. Values already queued can still be popped.
+	void Close()
+	{
+		closed.store(true, std::memory_order_release);
+	}
+
+private:
+	struct Cell
+	{
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<Cell[]> cells;
+	size_t mask = 0;
+	// Producers and consumers each get their own cache line.
+	alignas(64) std::atomic<size_t> tail = 0;
+	alignas(64) std::atomic<size_t> head = 0;
+	alignas(64) std::atomic<bool> closed = false;
+
+	// Spins briefly, then yields, then sleeps so a stage that is starved or blocked for long doesn't hog a core.
+	static void Backoff(unsigned spins)
+	{
+		if (spins < 64)
+			return;
+		if (spins < 1024)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(50));
+	}
+};
+
+#endif // BOUNDED_QUEUE_H
@@ -0,0 +1,379 @@
+#include "lz4_helper.h"
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+#include <memory>
+
+namespace
+{
+	constexpr size_t MIN_MATCH = 4;
+	// The last 5 bytes of a block are always literals.
+	constexpr size_t LAST_LITERALS = 5;
+	// The last match has to start at least 12 bytes before the end of the block.
+	constexpr size_t MF_LIMIT = 12;
+	constexpr size_t MAX_DISTANCE = 65535;
+	constexpr int HASH_BITS = 16;
+
+	// LZ4BlockOutputStream framing.
+	constexpr char BLOCK_MAGIC[8] = { 'L', 'Z', '4', 'B', 'l', 'o', 'c', 'k' };
+	constexpr size_t BLOCK_HEADER_SIZE = sizeof(BLOCK_MAGIC) + 1 + 4 + 4 + 4;
+	constexpr uint8_t METHOD_RAW = 0x10;
+	constexpr uint8_t METHOD_LZ4 = 0x20;
+	constexpr uint8_t BLOCK_LEVEL = 6;
+	constexpr size_t BLOCK_SIZE = size_t(1) << (BLOCK_LEVEL + 10);
+	constexpr uint32_t CHECKSUM_SEED = 0x9747b28c;
+	// lz4-java only keeps the low 28 bits of the checksum.
+	constexpr uint32_t CHECKSUM_MASK = 0x0FFFFFFF;
+
+	inline uint32_t Read32(const uint8_t* p)
+	{
+		return uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24;
+	}
+
+	inline void Write32(uint8_t* p, uint32_t value)
+	{
+		p[0] = uint8_t(value);
+		p[1] = uint8_t(value >> 8);
+		p[2] = uint8_t(value >> 16);
+		p[3] = uint8_t(value >> 24);
+	}
+
+	inline uint32_t Rotl(uint32_t value, int count)
+	{
+		return (value << count) | (value >> (32 - count));
+	}
+
+	inline uint32_t Hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	// Writes a sequence length that didn't fit in its 4 bit token field.
+	inline uint8_t* WriteLength(uint8_t* op, size_t length)
+	{
+		while (length >= 255)
+		{
+			*op++ = 255;
+			length -= 255;
+		}
+		*op++ = static_cast<uint8_t>(length);
+		return op;
+	}
+
+	// The bytes WriteLength takes after the token for a field of length, 0 if it fits in the token.
+	constexpr size_t LengthBytes(size_t length)
+	{
+		return length < 15 ? 0 : (length - 15) / 255 + 1;
+	}
+}
+
+uint32_t lz4::XXHash32(const void* data, size_t size, uint32_t seed)
+{
+	constexpr uint32_t PRIME1 = 2654435761u;
+	constexpr uint32_t PRIME2 = 2246822519u;
+	constexpr uint32_t PRIME3 = 3266489917u;
+	constexpr uint32_t PRIME4 = 668265263u;
+	constexpr uint32_t PRIME5 = 374761393u;
+
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	const uint8_t* end = p + size;
+	uint32_t h;
+
+	if (size >= 16)
+	{
+		uint32_t v1 = seed + PRIME1 + PRIME2;
+		uint32_t v2 = seed + PRIME2;
+		uint32_t v3 = seed;
+		uint32_t v4 = seed - PRIME1;
+		const uint8_t* limit = end - 16;
+		do
+		{
+			v1 = Rotl(v1 + Read32(p) * PRIME2, 13) * PRIME1;
+			v2 = Rotl(v2 + Read32(p + 4) * PRIME2, 13) * PRIME1;
+			v3 = Rotl(v3 + Read32(p + 8) * PRIME2, 13) * PRIME1;
+			v4 = Rotl(v4 + Read32(p + 12) * PRIME2, 13) * PRIME1;
+			p += 16;
+		} while (p <= limit);
+		h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+	}
+	else
+	{
+		h = seed + PRIME5;
+	}
+
+	h += static_cast<uint32_t>(size);
+	while (end - p >= 4)
+	{
+		h = Rotl(h + Read32(p) * PRIME3, 17) * PRIME4;
+		p += 4;
+	}
+	while (p < end)
+	{
+		h = Rotl(h + *p * PRIME5, 11) * PRIME1;
+		p++;
+	}
+
+	h ^= h >> 15;
+	h *= PRIME2;
+	h ^= h >> 13;
+	h *= PRIME3;
+	h ^= h >> 16;
+	return h;
+}
+
+size_t lz4::CompressBlock(const char* data, size_t size, char* output, size_t capacity)
+{
+	const uint8_t* const src = reinterpret_cast<const uint8_t*>(data);
+	uint8_t* op = reinterpret_cast<uint8_t*>(output);
+	uint8_t* const oend = op + capacity;
+
+	size_t anchor = 0;
+	if (size > MF_LIMIT)
+	{
+		// Positions are stored plus one so that 0 means empty.
+		std::unique_ptr<uint32_t[]> table = std::make_unique<uint32_t[]>(size_t(1) << HASH_BITS);
+		const size_t matchLimit = size - LAST_LITERALS;
+		size_t ip = 0;
+		unsigned misses = 0;
+		while (ip + MF_LIMIT <= size)
+		{
+			uint32_t sequence = Read32(src + ip);
+			uint32_t& slot = table[Hash(sequence)];
+			size_t candidate = slot;
+			slot = static_cast<uint32_t>(ip + 1);
+
+			if (candidate == 0 || ip - (candidate - 1) > MAX_DISTANCE || Read32(src + candidate - 1) != sequence)
+			{
+				// Skip ahead faster through data that doesn't compress.
+				ip += 1 + (misses++ >> 6);
+				continue;
+			}
+			misses = 0;
+
+			size_t ref = candidate - 1;
+			// Extend backwards over literals that also match.
+			while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1])
+			{
+				ip--;
+				ref--;
+			}
+			size_t length = MIN_MATCH;
+			while (ip + length < matchLimit && src[ref + length] == src[ip + length])
+				length++;
+
+			size_t literals = ip - anchor;
+			size_t matchLength = length - MIN_MATCH;
+			size_t needed = 1 + LengthBytes(literals) + literals + 2 + LengthBytes(matchLength);
+			if (size_t(oend - op) < needed)
+				return 0;
+
+			uint8_t* token = op++;
+			*token = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+			if (literals >= 15)
+				op = WriteLength(op, literals - 15);
+			std::memcpy(op, src + anchor, literals);
+			op += literals;
+
+			size_t distance = ip - ref;
+			*op++ = static_cast<uint8_t>(distance);
+			*op++ = static_cast<uint8_t>(distance >> 8);
+
+			*token |= static_cast<uint8_t>(std::min<size_t>(matchLength, 15));
+			if (matchLength >= 15)
+				op = WriteLength(op, matchLength - 15);
+
+			ip += length;
+			anchor = ip;
+			if (ip + MF_LIMIT <= size)
+				table[Hash(Read32(src + ip - 2))] = static_cast<uint32_t>(ip - 2 + 1);
+		}
+	}
+
+	// The block always ends with a run of literals.
+	size_t literals = size - anchor;
+	if (size_t(oend - op) < 1 + LengthBytes(literals) + literals)
+		return 0;
+	*op++ = static_cast<uint8_t>(std::min<size_t>(literals, 15) << 4);
+	if (literals >= 15)
+		op = WriteLength(op, literals - 15);
+	// data may be null when size is 0.
+	if (literals != 0)
+		std::memcpy(op, src + anchor, literals);
+	op += literals;
+
+	return op - reinterpret_cast<uint8_t*>(output);
+}
+
+size_t lz4::DecompressBlock(const char* data, size_t size, char* output, size_t capacity)
+{
+	const uint8_t* ip = reinterpret_cast<const uint8_t*>(data);
+	const uint8_t* const iend = ip + size;
+	uint8_t* const obegin = reinterpret_cast<uint8_t*>(output);
+	uint8_t* op = obegin;
+	uint8_t* const oend = obegin + capacity;
+
+	auto readLength = [&](size_t length) -> size_t
+	{
+		uint8_t next;
+		do
+		{
+			if (ip == iend)
+				throw std::runtime_error("LZ4 block is truncated.");
+			next = *ip++;
+			length += next;
+		} while (next == 255);
+		return length;
+	};
+
+	while (ip < iend)
+	{
+		uint8_t token = *ip++;
+
+		size_t literals = token >> 4;
+		if (literals == 15)
+			literals = readLength(literals);
+		if (size_t(iend - ip) < literals)
+			throw std::runtime_error("LZ4 block is truncated.");
+		if (size_t(oend - op) < literals)
+			throw std::runtime_error("LZ4 output buffer is too small.");
+		std::memcpy(op, ip, literals);
+		op += literals;
+		ip += literals;
+
+		// The last sequence has no match.
+		if (ip == iend)
+			break;
+
+		if (iend - ip < 2)
+			throw std::runtime_error("LZ4 block is truncated.");
+		size_t distance = size_t(ip[0]) | size_t(ip[1]) << 8;
+		ip += 2;
+		if (distance == 0 || distance > size_t(op - obegin))
+			throw std::runtime_error("LZ4 match offset is out of range.");
+
+		size_t length = token & 15;
+		if (length == 15)
+			length = readLength(length);
+		length += MIN_MATCH;
+		if (size_t(oend - op) < length)
+			throw std::runtime_error("LZ4 output buffer is too small.");
+
+		const uint8_t* match = op - distance;
+		if (distance >= length)
+		{
+			std::memcpy(op, match, length);
+			op += length;
+		}
+		else
+		{
+			// Overlapping copy repeats the last distance bytes.
+			for (size_t i = 0; i < length; i++)
+				op[i] = match[i];
+			op += length;
+		}
+	}
+
+	return op - obegin;
+}
+
+lz4::vector lz4::Compress(const char* data, size_t size)
+{
+	lz4::vector result;
+	size_t blocks = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	result.resize(blocks * (BLOCK_HEADER_SIZE + CompressBound(BLOCK_SIZE)) + BLOCK_HEADER_SIZE);
+	uint8_t* begin = reinterpret_cast<uint8_t*>(result.data());
+	uint8_t* op = begin;
+
+	auto writeHeader = [&](uint8_t method, size_t compressed, size_t original, uint32_t checksum)
+	{
+		std::memcpy(op, BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+		op[8] = method | BLOCK_LEVEL;
+		Write32(op + 9, static_cast<uint32_t>(compressed));
+		Write32(op + 13, static_cast<uint32_t>(original));
+		Write32(op + 17, checksum);
+		op += BLOCK_HEADER_SIZE;
+	};
+
+	for (size_t offset = 0; offset < size; offset += BLOCK_SIZE)
+	{
+		size_t length = std::min(BLOCK_SIZE, size - offset);
+		const char* block = data + offset;
+		uint32_t checksum = XXHash32(block, length, CHECKSUM_SEED) & CHECKSUM_MASK;
+
+		char* payload = reinterpret_cast<char*>(op + BLOCK_HEADER_SIZE);
+		size_t compressed = CompressBlock(block, length, payload, length - 1);
+		if (compressed == 0)
+		{
+			// Store incompressible blocks as they are.
+			writeHeader(METHOD_RAW, length, length, checksum);
+			std::memcpy(op, block, length);
+			op += length;
+		}
+		else
+		{
+			writeHeader(METHOD_LZ4, compressed, length, checksum);
+			op += compressed;
+		}
+	}
+
+	// An empty raw block marks the end of the stream.
+	writeHeader(METHOD_RAW, 0, 0, 0);
+
+	result.resize(op - begin);
+	return result;
+}
+
+lz4::vector lz4::Decompress(const char* data, size_t size)
+{
+	lz4::vector result;
+	Decompress(data, size, result);
+	return result;
+}
+
+size_t lz4::Decompress(const char* data, size_t size, lz4::vector& output)
+{
+	const uint8_t* ip = reinterpret_cast<const uint8_t*>(data);
+	const uint8_t* const iend = ip + size;
+	output.clear();
+	size_t written = 0;
+
+	while (iend - ip >= static_cast<ptrdiff_t>(BLOCK_HEADER_SIZE))
+	{
+		if (std::memcmp(ip, BLOCK_MAGIC, sizeof(BLOCK_MAGIC)) != 0)
+			throw std::runtime_error("Invalid LZ4 block magic.");
+		uint8_t method = ip[8] & 0xF0;
+		uint8_t level = ip[8] & 0x0F;
+		size_t compressed = Read32(ip + 9);
+		size_t original = Read32(ip + 13);
+		uint32_t checksum = Read32(ip + 17);
+		ip += BLOCK_HEADER_SIZE;
+
+		size_t maxBlock = size_t(1) << (level + 10);
+		if (original > maxBlock || compressed > maxBlock || (method != METHOD_RAW && method != METHOD_LZ4))
+			throw std::runtime_error("Invalid LZ4 block header.");
+		if (method == METHOD_RAW && compressed != original)
+			throw std::runtime_error("Invalid LZ4 block header.");
+		if (original == 0)
+			break;
+		if (size_t(iend - ip) < compressed)
+			throw std::runtime_error("LZ4 stream is truncated.");
+
+		output.resize(written + original);
+		char* block = reinterpret_cast<char*>(output.data() + written);
+		if (method == METHOD_RAW)
+		{
+			std::memcpy(block, ip, original);
+		}
+		else if (DecompressBlock(reinterpret_cast<const char*>(ip), compressed, block, original) != original)
+		{
+			throw std::runtime_error("LZ4 block size mismatch.");
+		}
+		if ((XXHash32(block, original, CHECKSUM_SEED) & CHECKSUM_MASK) != checksum)
+			throw std::runtime_error("LZ4 block checksum mismatch.");
+
+		written += original;
+		ip += compressed;
+	}
+
+	return written;
+}
@@ -0,0 +1,40 @@
+#ifndef LZ4_HELPER_H
+#define LZ4_HELPER_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+// Minecraft writes LZ4 chunks with lz4-java's LZ4BlockOutputStream, which splits
+// the data into 64 KiB blocks, each with a small header and an xxHash32 checksum.
+
+namespace lz4
+{
+	typedef std::byte byte;
+	typedef std::vector<byte> vector;
+
+	// The largest a raw LZ4 block can get for size bytes of input.
+	constexpr size_t CompressBound(size_t size)
+	{
+		return size + size / 255 + 16;
+	}
+
+	// Compresses into a raw LZ4 block. Returns the compressed size, or 0 if it doesn't fit in capacity.
+	size_t CompressBlock(const char* data, size_t size, char* output, size_t capacity);
+
+	// Decompresses a raw LZ4 block. Throws if the block is malformed or doesn't fit in capacity.
+	// Returns the decompressed size.
+	size_t DecompressBlock(const char* data, size_t size, char* output, size_t capacity);
+
+	uint32_t XXHash32(const void* data, size_t size, uint32_t seed);
+
+	// The LZ4BlockOutputStream format used by region files.
+	lz4::vector Compress(const char* data, size_t size);
+	lz4::vector Decompress(const char* data, size_t size);
+
+	// Decompresses into output, replacing its contents. Returns the decompressed size.
+	size_t Decompress(const char* data, size_t size, lz4::vector& output);
+}
+
+#endif // LZ4_HELPER_H
@@ -0,0 +1,859 @@
+﻿//╔════════════════════════════════════════════════════════╗
+//║ Includes                                               ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Includes]
+
+#include "asyncio.h"
+#include "../bounded_queue.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__linux__) && !defined(WORLDIO_NO_URING) && __has_include(<linux/io_uring.h>)
+#define WORLDIO_URING
+#include <atomic>
+#include <cerrno>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+#pragma endregion [Includes]
+
+//╔════════════════════════════════════════════════════════╗
+//║ AsyncFile                                              ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [AsyncFile]
+
+worldio::AsyncFile::AsyncFile(const std::string& filename, bool writable)
+{
+#ifdef _WIN32
+	DWORD access = writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+	DWORD disposition = writable ? OPEN_ALWAYS : OPEN_EXISTING;
+	HANDLE handle = CreateFileA(filename.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, disposition, FILE_FLAG_OVERLAPPED, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Could not open the file.");
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(handle, &length))
+	{
+		CloseHandle(handle);
+		throw std::runtime_error("Could not get the file size.");
+	}
+	file = handle;
+	size = static_cast<uint64_t>(length.QuadPart);
+#else
+	int handle = writable ? ::open(filename.c_str(), O_RDWR | O_CREAT, 0644) : ::open(filename.c_str(), O_RDONLY);
+	if (handle < 0)
+		throw std::runtime_error("Could not open the file.");
+
+	struct stat info;
+	if (::fstat(handle, &info) != 0)
+	{
+		::close(handle);
+		throw std::runtime_error("Could not get the file size.");
+	}
+	fd = handle;
+	size = static_cast<uint64_t>(info.st_size);
+#endif
+}
+
+worldio::AsyncFile::~AsyncFile()
+{
+	Close();
+}
+
+worldio::AsyncFile::AsyncFile(AsyncFile&& rhs) noexcept
+{
+	*this = std::move(rhs);
+}
+
+worldio::AsyncFile& worldio::AsyncFile::operator=(AsyncFile&& rhs) noexcept
+{
+	if (this != &rhs)
+	{
+		Close();
+#ifdef _WIN32
+		file = rhs.file;
+		rhs.file = nullptr;
+#else
+		fd = rhs.fd;
+		rhs.fd = -1;
+#endif
+		size = rhs.size;
+		rhs.size = 0;
+	}
+	return *this;
+}
+
+void worldio::AsyncFile::Close()
+{
+#ifdef _WIN32
+	if (file != nullptr)
+		CloseHandle(file);
+	file = nullptr;
+#else
+	if (fd >= 0)
+		::close(fd);
+	fd = -1;
+#endif
+	size = 0;
+}
+
+#pragma endregion [AsyncFile]
+
+//╔════════════════════════════════════════════════════════╗
+//║ Engines                                                ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Engines]
+
+// Runs the requests of an AsyncIO. Each request lives in a slot, which owns one of the buffers.
+class worldio::AsyncIO::Engine
+{
+public:
+	virtual ~Engine() = default;
+
+	// Queues the request in slot. It doesn't have to start until the next Reap.
+	virtual void Submit(size_t slot, Request& request, std::byte* buffer) = 0;
+
+	// Starts queued requests and appends the slots of finished ones to done, having set their results.
+	// If block is set, waits for at least one. Only called with requests in flight.
+	virtual void Reap(bool block, std::vector<size_t>& done) = 0;
+};
+
+namespace
+{
+	using worldio::AsyncIO;
+
+	// Blocking positional I/O on worker threads. Like RegionWriter::ReadAt and WriteAt, but reporting
+	// errors as results, and a read stops early at the end of the file instead of failing.
+	class ThreadEngine : public AsyncIO::Engine
+	{
+	public:
+		struct Job
+		{
+			size_t slot = 0;
+			AsyncIO::Request* request = nullptr;
+			std::byte* buffer = nullptr;
+		};
+
+		ThreadEngine(size_t queueDepth) : submitted(queueDepth), completed(queueDepth)
+		{
+			for (size_t i = 0; i < queueDepth; i++)
+				workers.emplace_back(&ThreadEngine::Run, this);
+		}
+
+		~ThreadEngine() override
+		{
+			submitted.Close();
+			for (std::thread& worker : workers)
+				worker.join();
+		}
+
+		void Submit(size_t slot, AsyncIO::Request& request, std::byte* buffer) override
+		{
+			submitted.Push(Job { slot, &request, buffer });
+		}
+
+		void Reap(bool block, std::vector<size_t>& done) override
+		{
+			size_t slot;
+			// Nothing closes completed, so with requests in flight Pop waits until one of them finishes.
+			if (block && completed.Pop(slot))
+				done.push_back(slot);
+			while (completed.TryPop(slot))
+				done.push_back(slot);
+		}
+
+	private:
+		BoundedQueue<Job> submitted;
+		BoundedQueue<size_t> completed;
+		std::vector<std::thread> workers;
+
+		void Run()
+		{
+#ifdef _WIN32
+			HANDLE event = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+#endif
+			Job job;
+			while (submitted.Pop(job))
+			{
+				AsyncIO::Request& request = *job.request;
+				std::byte* p = job.buffer;
+				size_t size = request.size;
+				uint64_t offset = request.offset;
+				int64_t result = 0;
+				while (size != 0)
+				{
+#ifdef _WIN32
+					OVERLAPPED position = {};
+					position.Offset = static_cast<DWORD>(offset);
+					position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+					position.hEvent = event;
+					DWORD count = 0;
+					HANDLE file = request.file->Handle();
+					BOOL started = request.write
+						? WriteFile(file, p, static_cast<DWORD>(size), nullptr, &position)
+						: ReadFile(file, p, static_cast<DWORD>(size), nullptr, &position);
+					if ((!started && GetLastError() != ERROR_IO_PENDING) || !GetOverlappedResult(file, &position, &count, TRUE))
+					{
+						if (!request.write && GetLastError() == ERROR_HANDLE_EOF)
+							break;
+						result = -1;
+						break;
+					}
+#else
+					ssize_t count = request.write
+						? ::pwrite(request.file->Handle(), p, size, static_cast<off_t>(offset))
+						: ::pread(request.file->Handle(), p, size, static_cast<off_t>(offset));
+					if (count < 0)
+					{
+						result = -1;
+						break;
+					}
+#endif
+					if (count == 0)
+					{
+						if (request.write)
+							result = -1;
+						break;
+					}
+					p += count;
+					size -= static_cast<size_t>(count);
+					offset += static_cast<uint64_t>(count);
+					result += static_cast<int64_t>(count);
+				}
+				request.result = result;
+				completed.Push(job.slot);
+			}
+#ifdef _WIN32
+			CloseHandle(event);
+#endif
+		}
+	};
+
+#ifdef WORLDIO_URING
+	// io_uring through its system calls, without liburing.
+	class UringEngine : public AsyncIO::Engine
+	{
+	public:
+		// Throws if the kernel doesn't support io_uring or won't let us use it.
+		UringEngine(size_t queueDepth, std::byte* buffers, size_t bufferSize)
+		{
+			io_uring_params params = {};
+			ring = static_cast<int>(::syscall(__NR_io_uring_setup, static_cast<unsigned>(queueDepth), &params));
+			if (ring < 0)
+				throw std::runtime_error("Could not set up io_uring.");
+
+			submissionSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+			completionSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+			if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+				submissionSize = completionSize = std::max(submissionSize, completionSize);
+			entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+			submissionRing = ::mmap(nullptr, submissionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+			if (submissionRing == MAP_FAILED)
+			{
+				submissionRing = nullptr;
+				Close();
+				throw std::runtime_error("Could not map the io_uring submission ring.");
+			}
+			if ((params.features & IORING_FEAT_SINGLE_MMAP) != 0)
+				completionRing = submissionRing;
+			else
+			{
+				completionRing = ::mmap(nullptr, completionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+				if (completionRing == MAP_FAILED)
+				{
+					completionRing = nullptr;
+					Close();
+					throw std::runtime_error("Could not map the io_uring completion ring.");
+				}
+			}
+			void* mapped = ::mmap(nullptr, entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+			if (mapped == MAP_FAILED)
+			{
+				Close();
+				throw std::runtime_error("Could not map the io_uring submission entries.");
+			}
+			entries = static_cast<io_uring_sqe*>(mapped);
+
+			char* sq = static_cast<char*>(submissionRing);
+			submissionTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+			submissionMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+			submissionArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+			char* cq = static_cast<char*>(completionRing);
+			completionHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+			completionTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+			completionMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+			completions = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+			// Registered buffers are pinned once here instead of on every request. If the memory lock limit
+			// doesn't allow it, plain vectored requests into the same buffers work too.
+			requests.resize(queueDepth);
+			vectors.resize(queueDepth);
+			for (size_t slot = 0; slot < queueDepth; slot++)
+			{
+				vectors[slot].iov_base = buffers + slot * bufferSize;
+				vectors[slot].iov_len = bufferSize;
+			}
+			registered = ::syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, vectors.data(), static_cast<unsigned>(queueDepth)) == 0;
+		}
+
+		~UringEngine() override
+		{
+			Close();
+		}
+
+		void Submit(size_t slot, AsyncIO::Request& request, std::byte* buffer) override
+		{
+			// AsyncIO never has more requests in flight than slots, and there are at least as many entries as slots.
+			unsigned tail = *submissionTail;
+			unsigned position = tail & submissionMask;
+			io_uring_sqe& entry = entries[position];
+			std::memset(&entry, 0, sizeof(entry));
+			entry.fd = request.file->Handle();
+			entry.off = request.offset;
+			entry.user_data = slot;
+			requests[slot] = &request;
+			if (registered)
+			{
+				entry.opcode = request.write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+				entry.addr = reinterpret_cast<uint64_t>(buffer);
+				entry.len = static_cast<uint32_t>(request.size);
+				entry.buf_index = static_cast<uint16_t>(slot);
+			}
+			else
+			{
+				vectors[slot].iov_len = request.size;
+				entry.opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+				entry.addr = reinterpret_cast<uint64_t>(&vectors[slot]);
+				entry.len = 1;
+			}
+			submissionArray[position] = position;
+			std::atomic_ref<unsigned>(*submissionTail).store(tail + 1, std::memory_order_release);
+			pending++;
+		}
+
+		void Reap(bool block, std::vector<size_t>& done) override
+		{
+			size_t before = done.size();
+			Collect(done);
+			if (pending == 0 && (!block || done.size() != before))
+				return;
+
+			unsigned wait = block && done.size() == before ? 1 : 0;
+			for (;;)
+			{
+				long entered = ::syscall(__NR_io_uring_enter, ring, pending, wait, wait != 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+				if (entered >= 0)
+				{
+					pending -= static_cast<unsigned>(entered);
+					if (pending == 0)
+						break;
+				}
+				else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+					throw std::runtime_error("Could not submit to io_uring.");
+			}
+			Collect(done);
+		}
+
+	private:
+		int ring = -1;
+		void* submissionRing = nullptr;
+		void* completionRing = nullptr;
+		size_t submissionSize = 0;
+		size_t completionSize = 0;
+		size_t entriesSize = 0;
+		io_uring_sqe* entries = nullptr;
+		unsigned* submissionTail = nullptr;
+		unsigned* submissionArray = nullptr;
+		unsigned submissionMask = 0;
+		unsigned* completionHead = nullptr;
+		unsigned* completionTail = nullptr;
+		unsigned completionMask = 0;
+		io_uring_cqe* completions = nullptr;
+		std::vector<iovec> vectors;
+		bool registered = false;
+		// Entries written to the submission ring that the kernel hasn't taken yet.
+		unsigned pending = 0;
+		// The request in each slot, to hand its result back to.
+		std::vector<AsyncIO::Request*> requests;
+
+		void Collect(std::vector<size_t>& done)
+		{
+			unsigned head = *completionHead;
+			unsigned tail = std::atomic_ref<unsigned>(*completionTail).load(std::memory_order_acquire);
+			for (; head != tail; head++)
+			{
+				const io_uring_cqe& completion = completions[head & completionMask];
+				size_t slot = static_cast<size_t>(completion.user_data);
+				requests[slot]->result = completion.res;
+				done.push_back(slot);
+			}
+			std::atomic_ref<unsigned>(*completionHead).store(head, std::memory_order_release);
+		}
+
+		void Close()
+		{
+			if (entries != nullptr)
+				::munmap(entries, entriesSize);
+			if (completionRing != nullptr && completionRing != submissionRing)
+				::munmap(completionRing, completionSize);
+			if (submissionRing != nullptr)
+				::munmap(submissionRing, submissionSize);
+			if (ring >= 0)
+				::close(ring);
+			entries = nullptr;
+			completionRing = nullptr;
+			submissionRing = nullptr;
+			ring = -1;
+		}
+	};
+#endif
+}
+
+#pragma endregion [Engines]
+
+//╔════════════════════════════════════════════════════════╗
+//║ AsyncIO                                                ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [AsyncIO]
+
+worldio::AsyncIO::AsyncIO(size_t queueDepth, io_backend backend)
+{
+	queueDepth = std::max<size_t>(queueDepth, 1);
+	buffers = std::make_unique<std::byte[]>(queueDepth * ASYNC_BUFFER_SIZE);
+	requests.resize(queueDepth);
+	available.reserve(queueDepth);
+	for (size_t slot = queueDepth; slot != 0; slot--)
+		available.push_back(slot - 1);
+	reaped.reserve(queueDepth);
+
+#ifdef WORLDIO_URING
+	if (backend == io_backend::URING)
+	{
+		try
+		{
+			engine = std::make_unique<UringEngine>(queueDepth, buffers.get(), ASYNC_BUFFER_SIZE);
+			this->backend = io_backend::URING;
+			return;
+		}
+		catch (const std::exception&)
+		{
+			// Old kernels, seccomp filters and containers often refuse io_uring. The threads do the same job.
+		}
+	}
+#endif
+	engine = std::make_unique<ThreadEngine>(queueDepth);
+	this->backend = io_backend::THREADS;
+}
+
+worldio::AsyncIO::~AsyncIO()
+{
+	// The kernel or the workers may still be writing into the buffers.
+	try
+	{
+		while (inFlight != finished.size())
+		{
+			reaped.clear();
+			engine->Reap(true, reaped);
+			finished.insert(finished.end(), reaped.begin(), reaped.end());
+		}
+	}
+	catch (const std::exception&)
+	{
+	}
+}
+
+size_t worldio::AsyncIO::Acquire()
+{
+	while (available.empty())
+		Poll(true);
+	size_t slot = available.back();
+	available.pop_back();
+	return slot;
+}
+
+void worldio::AsyncIO::Submit(size_t slot)
+{
+	inFlight++;
+	try
+	{
+		engine->Submit(slot, requests[slot], buffers.get() + slot * ASYNC_BUFFER_SIZE);
+	}
+	catch (...)
+	{
+		inFlight--;
+		requests[slot].complete = nullptr;
+		available.push_back(slot);
+		throw;
+	}
+}
+
+void worldio::AsyncIO::Read(const AsyncFile& file, uint64_t offset, size_t size, Completion complete)
+{
+	if (size > ASYNC_BUFFER_SIZE)
+		throw std::runtime_error("Request is larger than an I/O buffer.");
+	if (!file.IsOpen())
+		throw std::runtime_error("File is not open.");
+
+	size_t slot = Acquire();
+	Request& request = requests[slot];
+	request.complete = std::move(complete);
+	request.file = &file;
+	request.offset = offset;
+	request.size = size;
+	request.write = false;
+	request.result = 0;
+	Submit(slot);
+}
+
+void worldio::AsyncIO::Write(const AsyncFile& file, uint64_t offset, std::span<const std::byte> data, Completion complete)
+{
+	if (data.size() > ASYNC_BUFFER_SIZE)
+		throw std::runtime_error("Request is larger than an I/O buffer.");
+	if (!file.IsOpen())
+		throw std::runtime_error("File is not open.");
+
+	size_t slot = Acquire();
+	std::memcpy(buffers.get() + slot * ASYNC_BUFFER_SIZE, data.data(), data.size());
+	Request& request = requests[slot];
+	request.complete = std::move(complete);
+	request.file = &file;
+	request.offset = offset;
+	request.size = data.size();
+	request.write = true;
+	request.result = 0;
+	Submit(slot);
+}
+
+size_t worldio::AsyncIO::Poll(bool block)
+{
+	if (inFlight > finished.size())
+	{
+		reaped.clear();
+		engine->Reap(block && finished.empty(), reaped);
+		finished.insert(finished.end(), reaped.begin(), reaped.end());
+	}
+
+	size_t count = 0;
+	while (!finished.empty())
+	{
+		// Taken off the queue first, so a completion that throws doesn't leave it to run again,
+		// and a completion that polls doesn't see it.
+		size_t slot = finished.front();
+		finished.pop_front();
+		Request& request = requests[slot];
+		Completion complete = std::move(request.complete);
+		request.complete = nullptr;
+
+		bool ok = request.write ? request.result == static_cast<int64_t>(request.size) : request.result >= 0;
+		size_t length = ok ? static_cast<size_t>(request.result) : 0;
+		std::span<const std::byte> data(buffers.get() + slot * ASYNC_BUFFER_SIZE, length);
+		try
+		{
+			if (complete)
+				complete(data, ok);
+		}
+		catch (...)
+		{
+			inFlight--;
+			available.push_back(slot);
+			throw;
+		}
+		inFlight--;
+		available.push_back(slot);
+		count++;
+	}
+	return count;
+}
+
+void worldio::AsyncIO::Wait()
+{
+	while (inFlight != 0)
+		Poll(true);
+}
+
+#pragma endregion [AsyncIO]
+
+//╔════════════════════════════════════════════════════════╗
+//║ Region Scans                                           ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Region Scans]
+
+namespace
+{
+	inline uint32_t ReadBigEndian(const std::byte* p)
+	{
+		return
+			static_cast<uint32_t>(p[0]) << 24 |
+			static_cast<uint32_t>(p[1]) << 16 |
+			static_cast<uint32_t>(p[2]) << 8 |
+			static_cast<uint32_t>(p[3]);
+	}
+
+	struct ScanRegion
+	{
+		std::string path;
+		int x = 0;
+		int z = 0;
+		worldio::AsyncFile file;
+		uint32_t locations[worldio::CHUNKS_PER_REGION] = {};
+		uint32_t timestamps[worldio::CHUNKS_PER_REGION] = {};
+	};
+
+	// Chunks read in one request, sorted by where they start.
+	struct ScanRun
+	{
+		std::shared_ptr<ScanRegion> region;
+		uint32_t offset = 0;
+		uint32_t count = 0;
+		std::vector<uint16_t> chunks;
+	};
+
+	// Fills in everything about the chunk that the header says.
+	void DescribeChunk(const ScanRegion& region, size_t index, worldio::ScannedChunk& chunk)
+	{
+		using namespace worldio;
+		chunk.region = region.path;
+		chunk.x = region.x * static_cast<int>(REGION_WIDTH) + static_cast<int>(index % REGION_WIDTH);
+		chunk.z = region.z * static_cast<int>(REGION_WIDTH) + static_cast<int>(index / REGION_WIDTH);
+		chunk.index = index;
+		chunk.sectorOffset = region.locations[index] >> 8;
+		chunk.sectorCount = static_cast<uint8_t>(region.locations[index] & 0xFF);
+		chunk.timestamp = region.timestamps[index];
+	}
+
+	// Splits the region's chunks that filter accepts into runs that sit next to each other on disk.
+	void PlanRuns(const std::shared_ptr<ScanRegion>& region, const worldio::ChunkFilter& filter, std::deque<ScanRun>& runs, worldio::ScanResult& result)
+	{
+		using namespace worldio;
+		std::vector<uint16_t> order;
+		for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+		{
+			uint32_t location = region->locations[index];
+			if ((location >> 8) < HEADER_SIZE / SECTOR_SIZE || (location & 0xFF) == 0)
+				continue;
+			if (filter)
+			{
+				ScannedChunk chunk;
+				DescribeChunk(*region, index, chunk);
+				if (!filter(chunk))
+				{
+					result.skipped++;
+					continue;
+				}
+			}
+			order.push_back(static_cast<uint16_t>(index));
+		}
+		std::sort(order.begin(), order.end(), [&](uint16_t lhs, uint16_t rhs) { return region->locations[lhs] < region->locations[rhs]; });
+
+		constexpr uint32_t MAX_RUN = ASYNC_BUFFER_SIZE / SECTOR_SIZE;
+		for (uint16_t index : order)
+		{
+			uint32_t offset = region->locations[index] >> 8;
+			uint32_t count = region->locations[index] & 0xFF;
+			if (!runs.empty() && runs.back().region == region)
+			{
+				ScanRun& run = runs.back();
+				uint32_t end = run.offset + run.count;
+				// Overlapping chunks are damaged, but are read as they are, the same as RegionFile does.
+				if (offset <= end && std::max(end, offset + count) - run.offset <= MAX_RUN)
+				{
+					run.count = std::max(end, offset + count) - run.offset;
+					run.chunks.push_back(index);
+					continue;
+				}
+			}
+			ScanRun run;
+			run.region = region;
+			run.offset = offset;
+			run.count = count;
+			run.chunks.push_back(index);
+			runs.push_back(std::move(run));
+		}
+	}
+
+	// Hands every chunk of a finished run to the callback.
+	void FinishRun(const ScanRun& run, std::span<const std::byte> data, bool ok, const worldio::ChunkCallback& callback, worldio::ScanResult& result)
+	{
+		using namespace worldio;
+		const ScanRegion& region = *run.region;
+		if (!ok)
+		{
+			result.failed += run.chunks.size();
+			return;
+		}
+		result.bytesRead += data.size();
+
+		for (uint16_t index : run.chunks)
+		{
+			uint32_t location = region.locations[index];
+			size_t begin = static_cast<size_t>((location >> 8) - run.offset) * SECTOR_SIZE;
+			// The last sector of a region is allowed to be truncated.
+			if (begin >= data.size())
+			{
+				result.failed++;
+				continue;
+			}
+			std::span<const std::byte> sectors = data.subspan(begin, std::min<size_t>(static_cast<size_t>(location & 0xFF) * SECTOR_SIZE, data.size() - begin));
+			if (sectors.size() < CHUNK_HEADER_SIZE)
+			{
+				result.failed++;
+				continue;
+			}
+			// The length includes the compression type byte.
+			size_t length = ReadBigEndian(sectors.data());
+			uint8_t type = static_cast<uint8_t>(sectors[4]);
+
+			ScannedChunk chunk;
+			DescribeChunk(region, index, chunk);
+			chunk.type = static_cast<compression>(type & ~static_cast<uint8_t>(compression::EXTERNAL));
+
+			// Oversized chunks are rare enough that mapping their .mcc file here costs less than routing them through the queue.
+			MappedFile external;
+			if ((type & static_cast<uint8_t>(compression::EXTERNAL)) != 0)
+			{
+				std::filesystem::path path = std::filesystem::path(region.path).parent_path();
+				path /= "c." + std::to_string(chunk.x) + "." + std::to_string(chunk.z) + ".mcc";
+				try
+				{
+					external = MappedFile(path.string());
+				}
+				catch (const std::exception&)
+				{
+				}
+				chunk.payload = external.View();
+			}
+			else if (length != 0 && length <= sectors.size() - 4)
+				chunk.payload = sectors.subspan(CHUNK_HEADER_SIZE, length - 1);
+
+			if (chunk.payload.empty())
+			{
+				result.failed++;
+				continue;
+			}
+			result.chunks++;
+			callback(chunk);
+		}
+	}
+}
+
+worldio::ScanResult& worldio::ScanResult::operator+=(const ScanResult& rhs)
+{
+	regions += rhs.regions;
+	chunks += rhs.chunks;
+	failed += rhs.failed;
+	skipped += rhs.skipped;
+	bytesRead += rhs.bytesRead;
+	return *this;
+}
+
+worldio::ScanResult worldio::ScanRegions(AsyncIO& io, const std::vector<std::string>& filenames, const ChunkCallback& callback)
+{
+	return ScanRegions(io, filenames, ChunkFilter(), callback);
+}
+
+worldio::ScanResult worldio::ScanRegions(AsyncIO& io, const std::vector<std::string>& filenames, const ChunkFilter& filter, const ChunkCallback& callback)
+{
+	ScanResult result;
+	std::deque<ScanRun> runs;
+	size_t next = 0;
+	// Completions can outlive this call if something throws, so they check this before touching anything on its stack.
+	auto cancelled = std::make_shared<bool>(false);
+	try
+	{
+		for (;;)
+		{
+			// Start on more headers only while there are too few runs to keep the queue full,
+			// so just the regions being read are open at any one time.
+			while (next < filenames.size() && runs.size() < io.QueueDepth() && io.InFlight() < io.QueueDepth())
+			{
+				auto region = std::make_shared<ScanRegion>();
+				region->path = filenames[next++];
+				std::string name = std::filesystem::path(region->path).filename().string();
+				try
+				{
+					if (!RegionFile::ParseName(name, region->x, region->z))
+						throw std::runtime_error("Region file name must be of the form r.X.Z.mca.");
+					region->file = AsyncFile(region->path);
+				}
+				catch (const std::exception&)
+				{
+					result.failed++;
+					continue;
+				}
+
+				io.Read(region->file, 0, HEADER_SIZE, [&runs, &result, &filter, region, cancelled](std::span<const std::byte> data, bool ok)
+				{
+					if (*cancelled)
+						return;
+					if (!ok)
+					{
+						result.failed++;
+						return;
+					}
+					result.regions++;
+					result.bytesRead += data.size();
+					// Like RegionFile, files shorter than the header are treated as empty.
+					if (data.size() < HEADER_SIZE)
+						return;
+					for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+					{
+						region->locations[index] = ReadBigEndian(data.data() + index * 4);
+						region->timestamps[index] = ReadBigEndian(data.data() + SECTOR_SIZE + index * 4);
+					}
+					PlanRuns(region, filter, runs, result);
+				});
+			}
+
+			while (!runs.empty() && io.InFlight() < io.QueueDepth())
+			{
+				auto run = std::make_shared<ScanRun>(std::move(runs.front()));
+				runs.pop_front();
+				io.Read(run->region->file, static_cast<uint64_t>(run->offset) * SECTOR_SIZE, static_cast<size_t>(run->count) * SECTOR_SIZE,
+					[&callback, &result, run, cancelled](std::span<const std::byte> data, bool ok)
+				{
+					if (*cancelled)
+						return;
+					FinishRun(*run, data, ok, callback, result);
+				});
+			}
+
+			if (io.InFlight() == 0 && runs.empty() && next >= filenames.size())
+				break;
+			io.Poll(true);
+		}
+	}
+	catch (...)
+	{
+		*cancelled = true;
+		try
+		{
+			io.Wait();
+		}
+		catch (...)
+		{
+		}
+		throw;
+	}
+	return result;
+}
+
+#pragma endregion [Region Scans]
@@ -0,0 +1,226 @@
+﻿#ifndef ASYNCIO_HEADER_FILE
+#define ASYNCIO_HEADER_FILE
+
+//╔════════════════════════════════════════════════════════╗
+//║ Includes                                               ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Includes]
+
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "worldio.h"
+
+#pragma endregion [Includes]
+
+//╔════════════════════════════════════════════════════════╗
+//║ Async I/O                                              ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Async I/O]
+
+namespace worldio
+{
+	// Size of each buffer AsyncIO reads into and writes from, and so the largest single request.
+	// Big enough for any chunk that isn't stored in a .mcc file.
+	constexpr size_t ASYNC_BUFFER_SIZE = 256 * SECTOR_SIZE;
+
+	enum class io_backend
+	{
+		// io_uring, on Linux builds that have its headers. Define WORLDIO_NO_URING to leave it out.
+		URING,
+		// Worker threads doing blocking positional reads and writes.
+		THREADS,
+	};
+
+	// A file opened for AsyncIO.
+	class AsyncFile
+	{
+	public:
+		AsyncFile() = default;
+		// Opens an existing file. writable also creates it if it doesn't exist.
+		AsyncFile(const std::string& filename, bool writable = false);
+		~AsyncFile();
+
+		AsyncFile(const AsyncFile&) = delete;
+		AsyncFile& operator=(const AsyncFile&) = delete;
+		AsyncFile(AsyncFile&& rhs) noexcept;
+		AsyncFile& operator=(AsyncFile&& rhs) noexcept;
+
+		void Close();
+
+		[[nodiscard]] inline bool IsOpen() const
+		{
+#ifdef _WIN32
+			return file != nullptr;
+#else
+			return fd >= 0;
+#endif
+		}
+
+		// Size of the file when it was opened.
+		[[nodiscard]] inline uint64_t Size() const
+		{
+			return size;
+		}
+
+#ifdef _WIN32
+		[[nodiscard]] inline void* Handle() const
+		{
+			return file;
+		}
+#else
+		[[nodiscard]] inline int Handle() const
+		{
+			return fd;
+		}
+#endif
+
+	private:
+#ifdef _WIN32
+		// Opened for overlapped I/O, so requests on the same file don't queue up behind each other.
+		void* file = nullptr;
+#else
+		int fd = -1;
+#endif
+		uint64_t size = 0;
+	};
+
+	// Keeps up to queueDepth reads and writes in flight at once.
+	// With io_uring, requests are queued on the submission ring and handed to the kernel in batches
+	// by Poll, straight into a pool of buffers registered with the kernel up front. Where io_uring
+	// isn't compiled in or can't be set up, queueDepth worker threads run the requests instead.
+	//
+	// Completions only ever run on the thread calling Poll or Wait, whichever the backend, so a
+	// completion can hand its data to the next stage, or queue more requests, without locking.
+	// A single AsyncIO must not be used from more than one thread at a time.
+	class AsyncIO
+	{
+	public:
+		// data holds the bytes read, or the bytes written, and is only valid during the call.
+		// A read that runs past the end of the file returns the bytes up to it.
+		using Completion = std::function<void(std::span<const std::byte> data, bool ok)>;
+
+		explicit AsyncIO(size_t queueDepth = 64, io_backend backend = io_backend::URING);
+		// Waits for requests in flight, without running their completions.
+		~AsyncIO();
+
+		AsyncIO(const AsyncIO&) = delete;
+		AsyncIO& operator=(const AsyncIO&) = delete;
+
+		// The backend in use, which is THREADS if io_uring was asked for but isn't available.
+		[[nodiscard]] inline io_backend Backend() const
+		{
+			return backend;
+		}
+
+		[[nodiscard]] inline size_t QueueDepth() const
+		{
+			return requests.size();
+		}
+
+		// Requests whose completion hasn't run yet.
+		[[nodiscard]] inline size_t InFlight() const
+		{
+			return inFlight;
+		}
+
+		// Queues a read of size bytes, at most ASYNC_BUFFER_SIZE. If the queue is full, runs completions until it isn't.
+		// file must stay open until the completion has run.
+		void Read(const AsyncFile& file, uint64_t offset, size_t size, Completion complete);
+
+		// Queues a write of a copy of data, at most ASYNC_BUFFER_SIZE bytes. If the queue is full, runs completions until it isn't.
+		void Write(const AsyncFile& file, uint64_t offset, std::span<const std::byte> data, Completion complete);
+
+		// Submits queued requests, then runs the completions of finished ones, waiting for at least one if block is set
+		// and anything is in flight. Returns the number of completions run.
+		size_t Poll(bool block = false);
+
+		// Runs completions until nothing is in flight.
+		void Wait();
+
+		// What the backends see of a request.
+		struct Request
+		{
+			Completion complete;
+			const AsyncFile* file = nullptr;
+			uint64_t offset = 0;
+			size_t size = 0;
+			bool write = false;
+			// Bytes transferred, or negative if the request failed. Set by the engine.
+			int64_t result = 0;
+		};
+
+		class Engine;
+
+	private:
+
+		io_backend backend = io_backend::THREADS;
+		std::unique_ptr<std::byte[]> buffers;
+		std::vector<Request> requests;
+		std::vector<size_t> available;
+		// Slots whose requests have finished but whose completions haven't run yet.
+		std::deque<size_t> finished;
+		std::vector<size_t> reaped;
+		size_t inFlight = 0;
+		std::unique_ptr<Engine> engine;
+
+		size_t Acquire();
+		void Submit(size_t slot);
+	};
+
+	struct ScannedChunk
+	{
+		// Path of the region file.
+		std::string_view region;
+		// Chunk coordinates.
+		int x = 0;
+		int z = 0;
+		size_t index = 0;
+		uint32_t sectorOffset = 0;
+		uint8_t sectorCount = 0;
+		uint32_t timestamp = 0;
+		// Without the EXTERNAL bit. Chunks stored in .mcc files are read from them.
+		// Not known yet when the chunk is passed to a ChunkFilter.
+		compression type = compression::ZLIB;
+		std::span<const std::byte> payload;
+	};
+
+	struct ScanResult
+	{
+		size_t regions = 0;
+		size_t chunks = 0;
+		// Regions that couldn't be opened and chunks whose data is damaged. They are skipped.
+		size_t failed = 0;
+		// Chunks a ChunkFilter turned down.
+		size_t skipped = 0;
+		uint64_t bytesRead = 0;
+
+		ScanResult& operator+=(const ScanResult& rhs);
+	};
+
+	// Called for every chunk a scan finds, on the thread running the scan. The payload is only valid during the call.
+	using ChunkCallback = std::function<void(const ScannedChunk& chunk)>;
+
+	// Called for every chunk in a region's header before it is read, with an empty payload. Chunks it returns false for aren't read.
+	using ChunkFilter = std::function<bool(const ScannedChunk& chunk)>;
+
+	// Reads every chunk of the region files through io, keeping it busy across regions rather than going one at a time.
+	// Each header is read first, then chunks that sit next to each other on disk are read together in one request.
+	// If the callback throws, the scan waits out its requests still in flight without running anything more, then rethrows,
+	// so io is left empty and usable.
+	ScanResult ScanRegions(AsyncIO& io, const std::vector<std::string>& filenames, const ChunkCallback& callback);
+
+	// Same as above, but only reads the chunks filter accepts.
+	ScanResult ScanRegions(AsyncIO& io, const std::vector<std::string>& filenames, const ChunkFilter& filter, const ChunkCallback& callback);
+}
+
+#pragma endregion [Async I/O]
+
+#endif // ASYNCIO_HEADER_FILE
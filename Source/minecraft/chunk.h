@@ -1,13 +1,111 @@
 ﻿#ifndef CHUNK_HEADER_FILE
 #define CHUNK_HEADER_FILE
 
+// https://minecraft.fandom.com/wiki/Chunk_format
+
 //╔════════════════════════════════════════════════════════╗
 //║ Includes                                               ║
 //╚════════════════════════════════════════════════════════╝
 #pragma region [Includes]
 
+#include <vector>
 
+#include "nbt_schema.hpp"
 
 #pragma endregion [Includes]
 
-#endif // CHUNK_HEADER_FILE
\ No newline at end of file
+//╔════════════════════════════════════════════════════════╗
+//║ Chunk Schema                                           ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Chunk Schema]
+
+// The parts of a 1.18+ chunk that the renderer needs, decoded with nbt::load_schema.
+// Anything not listed here is skipped while reading.
+namespace chunk
+{
+	struct BlockState
+	{
+		nbt::t_string Name;
+		std::vector<std::pair<nbt::atom, nbt::t_string>> Properties;
+
+		NBT_SCHEMA(BlockState,
+			NBT_FIELD(Name),
+			NBT_FIELD(Properties));
+	};
+
+	struct BlockStates
+	{
+		std::vector<BlockState> palette;
+		nbt::t_longarray data;
+
+		NBT_SCHEMA(BlockStates,
+			NBT_FIELD(palette),
+			NBT_FIELD(data));
+	};
+
+	struct Biomes
+	{
+		std::vector<nbt::t_string> palette;
+		nbt::t_longarray data;
+
+		NBT_SCHEMA(Biomes,
+			NBT_FIELD(palette),
+			NBT_FIELD(data));
+	};
+
+	struct Section
+	{
+		nbt::t_byte Y = 0;
+		BlockStates block_states;
+		Biomes biomes;
+		nbt::t_bytearray BlockLight;
+		nbt::t_bytearray SkyLight;
+
+		NBT_SCHEMA(Section,
+			NBT_FIELD(Y),
+			NBT_FIELD(block_states),
+			NBT_FIELD(biomes),
+			NBT_FIELD(BlockLight),
+			NBT_FIELD(SkyLight));
+	};
+
+	struct Heightmaps
+	{
+		nbt::t_longarray MOTION_BLOCKING;
+		nbt::t_longarray WORLD_SURFACE;
+		nbt::t_longarray OCEAN_FLOOR;
+
+		NBT_SCHEMA(Heightmaps,
+			NBT_FIELD(MOTION_BLOCKING),
+			NBT_FIELD(WORLD_SURFACE),
+			NBT_FIELD(OCEAN_FLOOR));
+	};
+
+	struct ChunkData
+	{
+		nbt::t_int DataVersion = 0;
+		nbt::t_int xPos = 0;
+		nbt::t_int zPos = 0;
+		nbt::t_int yPos = 0;
+		nbt::t_string Status;
+		nbt::t_long LastUpdate = 0;
+		nbt::t_long InhabitedTime = 0;
+		std::vector<Section> sections;
+		Heightmaps heightmaps;
+
+		NBT_SCHEMA(ChunkData,
+			NBT_FIELD(DataVersion),
+			NBT_FIELD(xPos),
+			NBT_FIELD(zPos),
+			NBT_FIELD(yPos),
+			NBT_FIELD(Status),
+			NBT_FIELD(LastUpdate),
+			NBT_FIELD(InhabitedTime),
+			NBT_FIELD(sections),
+			NBT_FIELD_AS(heightmaps, "Heightmaps"));
+	};
+}
+
+#pragma endregion [Chunk Schema]
+
+#endif // CHUNK_HEADER_FILE
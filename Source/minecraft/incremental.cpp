@@ -0,0 +1,303 @@
+﻿//╔════════════════════════════════════════════════════════╗
+//║ Includes                                               ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Includes]
+
+#include "incremental.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <bitset>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#pragma endregion [Includes]
+
+namespace
+{
+	// "AMF" and a version byte.
+	constexpr uint32_t MANIFEST_MAGIC = 0x01464D41;
+
+	// Region coordinates, then each chunk's index, timestamp, location and hash.
+	constexpr size_t REGION_RECORD_SIZE = 4 + 4 + 2;
+	constexpr size_t CHUNK_RECORD_SIZE = 2 + 4 + 4 + 16;
+
+	// The manifest is little-endian whatever the machine.
+	template <typename T>
+	void WriteLittleEndian(std::vector<char>& output, T value)
+	{
+		for (size_t i = 0; i < sizeof(T); i++)
+			output.push_back(static_cast<char>(static_cast<uint64_t>(value) >> (i * 8)));
+	}
+
+	template <typename T>
+	T ReadLittleEndian(const char*& p)
+	{
+		uint64_t value = 0;
+		for (size_t i = 0; i < sizeof(T); i++)
+			value |= static_cast<uint64_t>(static_cast<uint8_t>(p[i])) << (i * 8);
+		p += sizeof(T);
+		return static_cast<T>(value);
+	}
+
+	// Rounds towards negative infinity, like the region a chunk is in.
+	inline int RegionCoordinate(int chunk)
+	{
+		return chunk >> 5;
+	}
+}
+
+//╔════════════════════════════════════════════════════════╗
+//║ ScanManifest                                           ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [ScanManifest]
+
+worldio::ScanManifest worldio::ScanManifest::Load(const std::string& filename)
+{
+	ScanManifest manifest;
+	std::ifstream stream(filename, std::ios::binary | std::ios::ate);
+	if (!stream)
+		return manifest;
+	std::vector<char> data(static_cast<size_t>(stream.tellg()));
+	stream.seekg(0);
+	if (!stream.read(data.data(), static_cast<std::streamsize>(data.size())))
+		throw std::runtime_error("Could not read the manifest.");
+
+	const char* p = data.data();
+	const char* end = p + data.size();
+	if (data.size() < 8 || ReadLittleEndian<uint32_t>(p) != MANIFEST_MAGIC)
+		throw std::runtime_error("Manifest file is damaged.");
+	uint32_t regionCount = ReadLittleEndian<uint32_t>(p);
+	for (uint32_t i = 0; i < regionCount; i++)
+	{
+		if (static_cast<size_t>(end - p) < REGION_RECORD_SIZE)
+			throw std::runtime_error("Manifest file is damaged.");
+		int regionX = ReadLittleEndian<int32_t>(p);
+		int regionZ = ReadLittleEndian<int32_t>(p);
+		uint16_t count = ReadLittleEndian<uint16_t>(p);
+		if (count > CHUNKS_PER_REGION || static_cast<size_t>(end - p) < count * CHUNK_RECORD_SIZE)
+			throw std::runtime_error("Manifest file is damaged.");
+
+		// Save writes every region and chunk once, so a repeat can only be damage.
+		auto [found, added] = manifest.regions.try_emplace(Key(regionX, regionZ));
+		if (!added)
+			throw std::runtime_error("Manifest file is damaged.");
+		Region& region = found->second;
+		for (uint16_t j = 0; j < count; j++)
+		{
+			uint16_t index = ReadLittleEndian<uint16_t>(p);
+			if (index >= CHUNKS_PER_REGION || region.chunks[index].location != 0)
+				throw std::runtime_error("Manifest file is damaged.");
+			ManifestEntry& entry = region.chunks[index];
+			entry.timestamp = ReadLittleEndian<uint32_t>(p);
+			entry.location = ReadLittleEndian<uint32_t>(p);
+			entry.hash.low = ReadLittleEndian<uint64_t>(p);
+			entry.hash.high = ReadLittleEndian<uint64_t>(p);
+			if (entry.location == 0)
+				throw std::runtime_error("Manifest file is damaged.");
+		}
+		region.count = count;
+		manifest.size += count;
+	}
+	if (p != end)
+		throw std::runtime_error("Manifest file is damaged.");
+	return manifest;
+}
+
+void worldio::ScanManifest::Save(const std::string& filename) const
+{
+	std::vector<char> data;
+	data.reserve(8 + regions.size() * REGION_RECORD_SIZE + size * CHUNK_RECORD_SIZE);
+	WriteLittleEndian(data, MANIFEST_MAGIC);
+	WriteLittleEndian(data, static_cast<uint32_t>(regions.size()));
+	for (const auto& [key, region] : regions)
+	{
+		WriteLittleEndian(data, static_cast<int32_t>(key >> 32));
+		WriteLittleEndian(data, static_cast<int32_t>(key & 0xFFFFFFFF));
+		WriteLittleEndian(data, static_cast<uint16_t>(region.count));
+		for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+		{
+			const ManifestEntry& entry = region.chunks[index];
+			if (entry.location == 0)
+				continue;
+			WriteLittleEndian(data, static_cast<uint16_t>(index));
+			WriteLittleEndian(data, entry.timestamp);
+			WriteLittleEndian(data, entry.location);
+			WriteLittleEndian(data, entry.hash.low);
+			WriteLittleEndian(data, entry.hash.high);
+		}
+	}
+
+	std::string temporary = filename + ".tmp";
+	{
+		std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+		if (!stream.write(data.data(), static_cast<std::streamsize>(data.size())) || !stream.flush())
+			throw std::runtime_error("Could not write the manifest.");
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, filename, error);
+	if (error)
+	{
+		std::filesystem::remove(temporary, error);
+		throw std::runtime_error("Could not replace the manifest.");
+	}
+}
+
+const worldio::ManifestEntry* worldio::ScanManifest::Find(int chunkX, int chunkZ) const
+{
+	auto found = regions.find(Key(RegionCoordinate(chunkX), RegionCoordinate(chunkZ)));
+	if (found == regions.end())
+		return nullptr;
+	const ManifestEntry& entry = found->second.chunks[ChunkIndex(chunkX, chunkZ)];
+	return entry.location == 0 ? nullptr : &entry;
+}
+
+void worldio::ScanManifest::Set(int chunkX, int chunkZ, const ManifestEntry& entry)
+{
+	if (entry.location == 0)
+	{
+		Erase(chunkX, chunkZ);
+		return;
+	}
+	Region& region = regions[Key(RegionCoordinate(chunkX), RegionCoordinate(chunkZ))];
+	ManifestEntry& slot = region.chunks[ChunkIndex(chunkX, chunkZ)];
+	if (slot.location == 0)
+	{
+		region.count++;
+		size++;
+	}
+	slot = entry;
+}
+
+void worldio::ScanManifest::Erase(int chunkX, int chunkZ)
+{
+	auto found = regions.find(Key(RegionCoordinate(chunkX), RegionCoordinate(chunkZ)));
+	if (found == regions.end())
+		return;
+	ManifestEntry& slot = found->second.chunks[ChunkIndex(chunkX, chunkZ)];
+	if (slot.location == 0)
+		return;
+	slot = ManifestEntry();
+	size--;
+	if (--found->second.count == 0)
+		regions.erase(found);
+}
+
+size_t worldio::ScanManifest::EraseIf(const std::function<bool(int chunkX, int chunkZ, const ManifestEntry& entry)>& predicate)
+{
+	size_t erased = 0;
+	for (auto region = regions.begin(); region != regions.end();)
+	{
+		int regionX = static_cast<int32_t>(region->first >> 32);
+		int regionZ = static_cast<int32_t>(region->first & 0xFFFFFFFF);
+		for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+		{
+			ManifestEntry& entry = region->second.chunks[index];
+			int chunkX = regionX * static_cast<int>(REGION_WIDTH) + static_cast<int>(index % REGION_WIDTH);
+			int chunkZ = regionZ * static_cast<int>(REGION_WIDTH) + static_cast<int>(index / REGION_WIDTH);
+			if (entry.location == 0 || !predicate(chunkX, chunkZ, entry))
+				continue;
+			entry = ManifestEntry();
+			region->second.count--;
+			erased++;
+		}
+		if (region->second.count == 0)
+			region = regions.erase(region);
+		else
+			++region;
+	}
+	size -= erased;
+	return erased;
+}
+
+#pragma endregion [ScanManifest]
+
+//╔════════════════════════════════════════════════════════╗
+//║ Incremental Scans                                      ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Incremental Scans]
+
+worldio::ChangeResult worldio::ScanChanges(AsyncIO& io, const std::string& directory, ScanManifest& manifest, const ChunkCallback& callback)
+{
+	ChangeResult result;
+	std::vector<std::string> filenames;
+	for (const auto& entry : std::filesystem::directory_iterator(directory))
+	{
+		int regionX, regionZ;
+		if (entry.is_regular_file() && RegionFile::ParseName(entry.path().filename().string(), regionX, regionZ))
+			filenames.push_back(entry.path().string());
+	}
+	std::sort(filenames.begin(), filenames.end());
+
+	// Every chunk in the region headers. Entries for any others are for chunks that have gone,
+	// unless their region couldn't be read.
+	std::unordered_map<uint64_t, std::bitset<CHUNKS_PER_REGION>> seen;
+	auto Key = [](int regionX, int regionZ)
+	{
+		return static_cast<uint64_t>(static_cast<uint32_t>(regionX)) << 32 | static_cast<uint32_t>(regionZ);
+	};
+
+	ScanResult scanned = ScanRegions(io, filenames,
+		[&](const ScannedChunk& chunk)
+		{
+			result.chunks++;
+			seen[Key(RegionCoordinate(chunk.x), RegionCoordinate(chunk.z))].set(chunk.index);
+			const ManifestEntry* entry = manifest.Find(chunk.x, chunk.z);
+			return entry == nullptr || entry->timestamp != chunk.timestamp || entry->location != (chunk.sectorOffset << 8 | chunk.sectorCount);
+		},
+		[&](const ScannedChunk& chunk)
+		{
+			nbt::hasher hasher;
+			hasher.update(chunk.payload.data(), chunk.payload.size());
+			ManifestEntry updated;
+			updated.timestamp = chunk.timestamp;
+			updated.location = chunk.sectorOffset << 8 | chunk.sectorCount;
+			updated.hash = hasher.digest();
+
+			const ManifestEntry* entry = manifest.Find(chunk.x, chunk.z);
+			if (entry != nullptr && entry->hash == updated.hash)
+				result.moved++;
+			else
+			{
+				callback(chunk);
+				result.changed++;
+			}
+			manifest.Set(chunk.x, chunk.z, updated);
+		});
+	result.regions = scanned.regions;
+	result.unchanged = scanned.skipped;
+	result.failed = scanned.failed;
+	result.bytesRead = scanned.bytesRead;
+
+	// A region with nothing seen in it is either empty or couldn't be read. Rare enough to be worth checking.
+	for (const std::string& filename : filenames)
+	{
+		int regionX, regionZ;
+		RegionFile::ParseName(std::filesystem::path(filename).filename().string(), regionX, regionZ);
+		if (seen.find(Key(regionX, regionZ)) != seen.end())
+			continue;
+		try
+		{
+			RegionFile region(filename);
+			bool empty = true;
+			for (size_t index = 0; index < CHUNKS_PER_REGION && empty; index++)
+				empty = region.SectorOffset(index) == 0;
+			if (empty)
+				continue;
+		}
+		catch (const std::exception&)
+		{
+		}
+		seen[Key(regionX, regionZ)].set();
+	}
+
+	result.removed = manifest.EraseIf([&](int chunkX, int chunkZ, const ManifestEntry&)
+	{
+		auto found = seen.find(Key(RegionCoordinate(chunkX), RegionCoordinate(chunkZ)));
+		return found == seen.end() || !found->second.test(ChunkIndex(chunkX, chunkZ));
+	});
+	return result;
+}
+
+#pragma endregion [Incremental Scans]
@@ -0,0 +1,113 @@
+﻿#ifndef INCREMENTAL_HEADER_FILE
+#define INCREMENTAL_HEADER_FILE
+
+//╔════════════════════════════════════════════════════════╗
+//║ Includes                                               ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Includes]
+
+#include <array>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <unordered_map>
+
+#include "asyncio.h"
+#include "nbt_hash.hpp"
+
+#pragma endregion [Includes]
+
+//╔════════════════════════════════════════════════════════╗
+//║ Incremental Scans                                      ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Incremental Scans]
+
+namespace worldio
+{
+	// What the last scan saw of a chunk.
+	struct ManifestEntry
+	{
+		uint32_t timestamp = 0;
+		// The chunk's location table entry, sector offset << 8 | sector count. 0 if there is no entry.
+		uint32_t location = 0;
+		// Hash of the compressed payload.
+		nbt::hash128 hash;
+	};
+
+	// The chunks of a world as of the last incremental scan, one slot per chunk of every region that had any.
+	class ScanManifest
+	{
+	public:
+		// Returns an empty manifest if the file doesn't exist. Throws if it is damaged.
+		static ScanManifest Load(const std::string& filename);
+
+		// Written next to filename first and then renamed over it.
+		void Save(const std::string& filename) const;
+
+		// nullptr if the chunk has no entry.
+		[[nodiscard]] const ManifestEntry* Find(int chunkX, int chunkZ) const;
+
+		void Set(int chunkX, int chunkZ, const ManifestEntry& entry);
+
+		void Erase(int chunkX, int chunkZ);
+
+		// Erases the entries predicate returns true for. Returns the number erased.
+		size_t EraseIf(const std::function<bool(int chunkX, int chunkZ, const ManifestEntry& entry)>& predicate);
+
+		// Number of chunks with an entry.
+		[[nodiscard]] inline size_t Size() const
+		{
+			return size;
+		}
+
+		[[nodiscard]] inline size_t Regions() const
+		{
+			return regions.size();
+		}
+
+	private:
+		struct Region
+		{
+			std::array<ManifestEntry, CHUNKS_PER_REGION> chunks = {};
+			size_t count = 0;
+		};
+
+		std::unordered_map<uint64_t, Region> regions;
+		size_t size = 0;
+
+		[[nodiscard]] static inline uint64_t Key(int regionX, int regionZ)
+		{
+			return static_cast<uint64_t>(static_cast<uint32_t>(regionX)) << 32 | static_cast<uint32_t>(regionZ);
+		}
+	};
+
+	struct ChangeResult
+	{
+		size_t regions = 0;
+		// Chunks in the region headers.
+		size_t chunks = 0;
+		// Chunks whose header entry matched the manifest, and weren't read.
+		size_t unchanged = 0;
+		// Chunks that were read because their header entry changed, but whose payload hadn't.
+		size_t moved = 0;
+		// Chunks that were new or changed, and passed to the callback.
+		size_t changed = 0;
+		// Chunks in the manifest that are gone from the world.
+		size_t removed = 0;
+		// Regions and chunks that couldn't be read. Their entries are left as they were.
+		size_t failed = 0;
+		uint64_t bytesRead = 0;
+	};
+
+	// Passes only the chunks of the world's region directory that are new or changed since the manifest to callback,
+	// and brings the manifest up to date. Chunks whose timestamp and location are what the manifest says aren't read,
+	// so a scan that finds few changes costs little more than reading every region header.
+	// Save the manifest once the changed chunks have been dealt with; if that fails they come round again next time.
+	// If callback throws, the scan stops with io drained, like ScanRegions, and the manifest keeps the chunks handled before it.
+	ChangeResult ScanChanges(AsyncIO& io, const std::string& directory, ScanManifest& manifest, const ChunkCallback& callback);
+}
+
+#pragma endregion [Incremental Scans]
+
+#endif // INCREMENTAL_HEADER_FILE
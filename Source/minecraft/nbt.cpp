@@ -3,6 +3,6 @@
 //╚════════════════════════════════════════════════════════╝
 #pragma region [Includes]
 
-#include "nbt.h"
+#include "nbt.hpp"
 
 #pragma endregion [Includes]
@@ -8,10 +8,17 @@
 #include <string_view>
 #include <vector>
 #include <variant>
+#include <memory>
+#include <span>
 #include <cstdint>
 #include <cstddef>
+#include <cstring>
 #include <stdexcept>
 #include <algorithm>
+#include <charconv>
+
+#include "nbt_byteswap.hpp"
+#include "nbt_atom.hpp"
 
 
 namespace nbt
@@ -183,7 +190,7 @@ namespace nbt
 		}
 
 		template<typename T>
-		t_list(std::vector<T>&& rdata) : data(rdata)
+		t_list(std::vector<T>&& rdata) : data(std::move(rdata))
 		{
 			static_assert(is_nbt_t<T>::value, "Must be NBT type.");
 		}
@@ -388,22 +395,66 @@ namespace nbt
 		t_longarray		// 12
 	>; // t_variant
 
+	// Compounds with at least this many entries get a hash index for lookups, smaller ones are scanned.
+	constexpr size_t COMPOUND_INDEX_THRESHOLD = 16;
+
+	// A compound key hashed ahead of time, for lookups done over and over:
+	//	static constexpr nbt::hashed_key x_pos("xPos");
+	//	compound.find(x_pos);
+	struct hashed_key
+	{
+		std::string_view name;
+		uint64_t hash;
+
+		constexpr explicit hashed_key(std::string_view name) : name(name), hash(hash_key(name)) {}
+	};
+
+	// Open addressing table from key hash to entry position, for the entries it was built from.
+	struct compound_index
+	{
+		struct slot
+		{
+			uint32_t hash;
+			// Entry position plus one, zero marks an empty slot.
+			uint32_t position;
+		};
+
+		std::vector<slot> slots;
+		// What the index was built from, so changes made straight to data can be noticed.
+		size_t count = 0;
+		const void* entries = nullptr;
+	};
+
 	class t_compound
 	{
 	public:
-		using map = std::vector<std::pair<std::string, t_variant>>;
+		using map = std::vector<std::pair<atom, t_variant>>;
+		// Entries in insertion order, which is also the order they are written in.
+		// Large compounds keep an index next to this, built when they are constructed or read and kept up to date by set and remove.
+		// Lookups on a const compound never change the index, so a tree can be shared between threads once it is built.
+		// Edits made straight to data leave the index stale. Const lookups then scan until reindex() is called,
+		// non-const ones rebuild it. Edits that keep the count the same, like renaming a key, must be followed by reindex().
 		map data;
 
 		t_compound() = default;
-		t_compound(const map& cdata) : data(cdata) {}
-		t_compound(map&& rdata) : data(rdata) {}
-		t_compound(const t_compound& rhs) = default;
+		t_compound(const map& cdata) : data(cdata)
+		{
+			reindex();
+		}
+		t_compound(map&& rdata) : data(std::move(rdata))
+		{
+			reindex();
+		}
+		t_compound(const t_compound& rhs) : data(rhs.data)
+		{
+			reindex();
+		}
 		t_compound(t_compound&& rhs) = default;
 
 		t_compound& operator=(const map& cdata);
 
 		t_compound& operator=(map&& rdata);
-		t_compound& operator=(const t_compound& rhs) = default;
+		t_compound& operator=(const t_compound& rhs);
 		t_compound& operator=(t_compound&& rhs) = default;
 
 		bool operator==(const t_compound& rhs) const
@@ -447,6 +498,18 @@ namespace nbt
 
 		[[nodiscard]] map::const_iterator find(std::string_view key) const;
 
+		[[nodiscard]] map::iterator find(const hashed_key& key);
+
+		[[nodiscard]] map::const_iterator find(const hashed_key& key) const;
+
+		// Compares atoms by address rather than by text.
+		[[nodiscard]] map::iterator find(const atom& key);
+
+		[[nodiscard]] map::const_iterator find(const atom& key) const;
+
+		// Rebuilds the index after edits made straight to data.
+		void reindex();
+
 		template<typename T>
 		[[nodiscard]] T* get_if(std::string_view key)
 		{
@@ -462,35 +525,48 @@ namespace nbt
 		}
 
 		template<typename T>
-		void set(std::string_view key, const T& value)
+		[[nodiscard]] T* get_if(const hashed_key& key)
 		{
 			static_assert(is_nbt_t<T>::value, "Must be NBT type.");
+
 			map::iterator found = this->find(key);
-			if (found != this->data.end())
-			{
-				found->second = value;
-			}
-			else
+			if (found != data.end() && tag(found->second.index()) == TagType<T>())
 			{
-				this->data.push_back({ key, value });
+				T& result = std::get<T>(found->second);
+				return &result;
 			}
+			return nullptr;
 		}
 
 		template<typename T>
 		void set(std::string_view key, T&& value)
 		{
-			static_assert(is_nbt_t<T>::value, "Must be NBT type.");
+			static_assert(is_nbt_t<std::remove_cvref_t<T>>::value || std::is_same<std::remove_cvref_t<T>, t_variant>::value, "Must be NBT type.");
 			map::iterator found = this->find(key);
 			if (found != this->data.end())
 			{
-				found->second = value;
+				found->second = std::forward<T>(value);
 			}
 			else
 			{
-				this->data.push_back({ key, value });
+				bool indexed = index_current();
+				this->data.emplace_back(atom(key), std::forward<T>(value));
+				if (indexed)
+					index_last();
+				else if (this->data.size() >= COMPOUND_INDEX_THRESHOLD)
+					reindex();
 			}
 		}
 
+	private:
+		std::unique_ptr<compound_index> index;
+
+		[[nodiscard]] bool index_current() const;
+		// Adds the last entry to an index that was current before it was pushed.
+		void index_last();
+		// Looks the key up in the index, which must be current. Returns data.size() when the key is missing.
+		[[nodiscard]] size_t find_position(std::string_view key, uint64_t hash) const;
+
 	};
 
 	template<typename T>
@@ -526,46 +602,63 @@ namespace nbt
 		return T{};
 	}
 
-	t_compound& t_compound::operator=(const map& cdata)
+	inline t_compound& t_compound::operator=(const map& cdata)
 	{
 		this->data = cdata;
+		reindex();
+		return *this;
+	}
+
+	inline t_compound& t_compound::operator=(map&& rdata)
+	{
+		this->data = std::move(rdata);
+		reindex();
 		return *this;
 	}
 
-	t_compound& t_compound::operator=(map&& rdata)
+	inline t_compound& t_compound::operator=(const t_compound& rhs)
 	{
-		this->data = rdata;
+		if (this != &rhs)
+		{
+			this->data = rhs.data;
+			reindex();
+		}
 		return *this;
 	}
 
-	t_compound::map::iterator t_compound::operator[](std::string_view key)
+	inline t_compound::map::iterator t_compound::operator[](std::string_view key)
 	{
 		return this->find(key);
 	}
 
-	t_compound::map::const_iterator t_compound::operator[](std::string_view key) const
+	inline t_compound::map::const_iterator t_compound::operator[](std::string_view key) const
 	{
 		return this->find(key);
 	}
 
-	size_t t_compound::size() const
+	inline size_t t_compound::size() const
 	{
 		return this->data.size();
 	}
 
-	void t_compound::clear()
+	inline void t_compound::clear()
 	{
 		this->data.clear();
+		this->index.reset();
 	}
 
-	void t_compound::remove(std::string_view key)
+	inline void t_compound::remove(std::string_view key)
 	{
 		auto it = this->find(key);
 		if (it != this->data.end())
+		{
 			this->data.erase(it);
+			// Everything after the erased entry moved down one.
+			reindex();
+		}
 	}
 
-	tag t_compound::get_type(std::string_view key) const
+	inline tag t_compound::get_type(std::string_view key) const
 	{
 		t_compound::map::const_iterator found = this->find(key);
 		if (found != this->data.end())
@@ -573,17 +666,132 @@ namespace nbt
 		return tag::NONE;
 	}
 
-	t_compound::map::iterator t_compound::find(std::string_view key)
+	inline t_compound::map::iterator t_compound::find(std::string_view key)
+	{
+		if (data.size() < COMPOUND_INDEX_THRESHOLD)
+			return std::find_if(data.begin(), data.end(), [key](const std::pair<atom, t_variant>& val) { return val.first == key; });
+		if (!index_current())
+			reindex();
+		return data.begin() + find_position(key, hash_key(key));
+	}
+
+	inline t_compound::map::const_iterator t_compound::find(std::string_view key) const
+	{
+		if (data.size() < COMPOUND_INDEX_THRESHOLD || !index_current())
+			return std::find_if(data.begin(), data.end(), [key](const std::pair<atom, t_variant>& val) { return val.first == key; });
+		return data.begin() + find_position(key, hash_key(key));
+	}
+
+	inline t_compound::map::iterator t_compound::find(const hashed_key& key)
+	{
+		if (data.size() < COMPOUND_INDEX_THRESHOLD)
+			return this->find(key.name);
+		if (!index_current())
+			reindex();
+		return data.begin() + find_position(key.name, key.hash);
+	}
+
+	inline t_compound::map::const_iterator t_compound::find(const hashed_key& key) const
+	{
+		if (data.size() < COMPOUND_INDEX_THRESHOLD || !index_current())
+			return this->find(key.name);
+		return data.begin() + find_position(key.name, key.hash);
+	}
+
+	inline t_compound::map::iterator t_compound::find(const atom& key)
+	{
+		if (data.size() < COMPOUND_INDEX_THRESHOLD)
+			return std::find_if(data.begin(), data.end(), [key](const std::pair<atom, t_variant>& val) { return val.first == key; });
+		if (!index_current())
+			reindex();
+		return data.begin() + find_position(key, key.hash());
+	}
+
+	inline t_compound::map::const_iterator t_compound::find(const atom& key) const
+	{
+		if (data.size() < COMPOUND_INDEX_THRESHOLD || !index_current())
+			return std::find_if(data.begin(), data.end(), [key](const std::pair<atom, t_variant>& val) { return val.first == key; });
+		return data.begin() + find_position(key, key.hash());
+	}
+
+	inline bool t_compound::index_current() const
+	{
+		return index && index->count == data.size() && index->entries == data.data();
+	}
+
+	inline void t_compound::reindex()
 	{
-		return std::find_if(data.begin(), data.end(), [key](const std::pair<std::string, t_variant>& val) { return val.first == key; });
+		if (data.size() < COMPOUND_INDEX_THRESHOLD)
+		{
+			index.reset();
+			return;
+		}
+		if (!index)
+			index = std::make_unique<compound_index>();
+
+		// At most half full, so probe runs stay short.
+		size_t capacity = 32;
+		while (capacity < data.size() * 2)
+			capacity *= 2;
+		index->slots.assign(capacity, compound_index::slot{ 0, 0 });
+		size_t mask = capacity - 1;
+		for (size_t i = 0; i < data.size(); i++)
+		{
+			uint64_t hash = data[i].first.hash();
+			size_t at = hash & mask;
+			bool duplicate = false;
+			while (index->slots[at].position != 0)
+			{
+				// With duplicate keys the first one wins, same as a linear scan.
+				const compound_index::slot& slot = index->slots[at];
+				if (slot.hash == static_cast<uint32_t>(hash >> 32) && data[slot.position - 1].first == data[i].first)
+				{
+					duplicate = true;
+					break;
+				}
+				at = (at + 1) & mask;
+			}
+			if (!duplicate)
+				index->slots[at] = compound_index::slot{ static_cast<uint32_t>(hash >> 32), static_cast<uint32_t>(i + 1) };
+		}
+		index->count = data.size();
+		index->entries = data.data();
+	}
+
+	inline void t_compound::index_last()
+	{
+		if (index->count * 2 + 2 > index->slots.size())
+		{
+			reindex();
+			return;
+		}
+		size_t position = data.size() - 1;
+		uint64_t hash = data[position].first.hash();
+		size_t mask = index->slots.size() - 1;
+		size_t at = hash & mask;
+		while (index->slots[at].position != 0)
+			at = (at + 1) & mask;
+		index->slots[at] = compound_index::slot{ static_cast<uint32_t>(hash >> 32), static_cast<uint32_t>(position + 1) };
+		index->count = data.size();
+		index->entries = data.data();
 	}
 
-	t_compound::map::const_iterator t_compound::find(std::string_view key) const
+	inline size_t t_compound::find_position(std::string_view key, uint64_t hash) const
 	{
-		return std::find_if(data.begin(), data.end(), [key](const std::pair<std::string, t_variant>& val) { return val.first == key; });
+		size_t mask = index->slots.size() - 1;
+		size_t at = hash & mask;
+		uint32_t check = static_cast<uint32_t>(hash >> 32);
+		while (index->slots[at].position != 0)
+		{
+			const compound_index::slot& slot = index->slots[at];
+			if (slot.hash == check && data[slot.position - 1].first == key)
+				return slot.position - 1;
+			at = (at + 1) & mask;
+		}
+		return data.size();
 	}
 
-	void t_list::erase(size_t index)
+	inline void t_list::erase(size_t index)
 	{
 
 		switch (this->type())
@@ -675,7 +883,7 @@ namespace nbt
 		}
 	}
 
-	void t_list::erase(size_t start, size_t end)
+	inline void t_list::erase(size_t start, size_t end)
 	{
 		switch (this->type())
 		{
@@ -766,17 +974,17 @@ namespace nbt
 		}
 	}
 
-	void t_list::clear()
+	inline void t_list::clear()
 	{
 		this->data = nullptr;
 	}
 
-	tag t_list::type() const
+	inline tag t_list::type() const
 	{
 		return tag(this->data.index());
 	}
 
-	size_t t_list::size() const
+	inline size_t t_list::size() const
 	{
 		switch (this->type())
 		{
@@ -811,12 +1019,24 @@ namespace nbt
 		return 0;
 	}
 
+	// Limits for reading untrusted data, see load(nbtin&, const read_limits&).
+	// Depth counts nested lists and compounds, bytes what the tree will take in memory, roughly.
+	struct read_limits
+	{
+		size_t max_depth = 512;
+		size_t max_bytes = 256 * 1024 * 1024;
+	};
+
 	class nbtin
 	{
 	public:
 		const std::byte* begin;
 		const std::byte* end;
 		const std::byte* scan;
+		// Checked once per container or array, not per value. Bytes are unlimited unless set with limit,
+		// depth always has the default limit so no reader can recurse deep enough to overflow the stack.
+		size_t depth_left = read_limits{}.max_depth;
+		size_t bytes_left = SIZE_MAX;
 
 		nbtin(const std::vector<std::byte>& buffer) : begin(&*buffer.begin()), end(&*buffer.begin() + buffer.size()), scan(&*buffer.begin()) {}
 		nbtin(const void* begin, const void* end)
@@ -829,10 +1049,10 @@ namespace nbt
 			scan(static_cast<const std::byte*>(begin)) {}
 
 		nbtin(const nbtin& cvalue) = default;
-		nbtin(nbtin&& rvalue) = delete;
+		nbtin(nbtin&& rvalue) = default;
 
 		nbtin& operator=(const nbtin& cvalue) = default;
-		nbtin& operator=(nbtin&& rvalue) = delete;
+		nbtin& operator=(nbtin&& rvalue) = default;
 
 		[[nodiscard]] inline size_t tellg() const
 		{
@@ -844,9 +1064,16 @@ namespace nbt
 			return end - begin;
 		}
 
+		// Bytes left to read.
+		[[nodiscard]] inline size_t remaining() const
+		{
+			return end - scan;
+		}
+
+		// Compares against what's left rather than moving scan, so any count is safe to ask about.
 		[[nodiscard]] inline bool ensure(size_t count) const
 		{
-			return scan + count <= end;
+			return count <= remaining();
 		}
 
 		inline void advance(size_t count)
@@ -905,11 +1132,7 @@ namespace nbt
 
 		[[nodiscard]] inline int16_t read_i16()
 		{
-			if (!ensure(2))
-				throw std::runtime_error("Reached end of buffer.");
-			int16_t result = static_cast<int16_t>(scan[0]) << 8 | static_cast<int8_t>(scan[1]);
-			advance(2);
-			return result;
+			return static_cast<int16_t>(read_u16());
 		}
 
 		[[nodiscard]] inline uint32_t read_u32()
@@ -973,6 +1196,7 @@ namespace nbt
 			const auto length = read_u16();
 			if (!ensure(length))
 				throw std::runtime_error("Reached end of buffer.");
+			charge(length);
 			std::string result(
 				reinterpret_cast<const char*>(scan),
 				reinterpret_cast<const char*>(scan + length));
@@ -986,6 +1210,62 @@ namespace nbt
 			return tag(val);
 		}
 
+		// Same as read_str, but points into the buffer instead of copying.
+		[[nodiscard]] inline std::string_view read_str_view()
+		{
+			const auto length = read_u16();
+			if (!ensure(length))
+				throw std::runtime_error("Reached end of buffer.");
+			std::string_view result(reinterpret_cast<const char*>(scan), length);
+			advance(length);
+			return result;
+		}
+
+		inline void limit(const read_limits& limits)
+		{
+			depth_left = limits.max_depth;
+			bytes_left = limits.max_bytes;
+		}
+
+		// Called around every list and compound read, skipped, visited or hashed.
+		inline void enter()
+		{
+			if (depth_left == 0)
+				throw std::runtime_error("Nesting too deep.");
+			depth_left--;
+		}
+
+		inline void leave()
+		{
+			depth_left++;
+		}
+
+		// Counts bytes about to be allocated for the tree against the limit.
+		inline void charge(size_t bytes)
+		{
+			if (bytes > bytes_left)
+				throw std::runtime_error("Allocation limit exceeded.");
+			bytes_left -= bytes;
+		}
+
+		// Advances past count bytes, throwing if there aren't that many left.
+		inline void skip(size_t count)
+		{
+			if (!ensure(count))
+				throw std::runtime_error("Reached end of buffer.");
+			advance(count);
+		}
+
+		// The next count bytes, without copying them.
+		[[nodiscard]] inline std::span<const std::byte> read_bytes(size_t count)
+		{
+			if (!ensure(count))
+				throw std::runtime_error("Reached end of buffer.");
+			std::span<const std::byte> result(scan, count);
+			advance(count);
+			return result;
+		}
+
 	};
 
 	class nbtout
@@ -1093,7 +1373,7 @@ namespace nbt
 
 		inline void write(std::string_view value)
 		{
-			uint16_t length = value.size();
+			uint16_t length = static_cast<uint16_t>(std::min<size_t>(value.size(), 0xFFFF));
 			write(length);
 			const char* beg = value.data();
 			buffer.insert(buffer.end(),
@@ -1108,6 +1388,103 @@ namespace nbt
 
 	};
 
+	// Writes into memory that was sized up front with encoded_size, so no write checks or grows anything.
+	// This is what nbtout uses under the hood, and it can point straight at a caller's buffer.
+	class nbtspan
+	{
+	public:
+		std::byte* begin;
+		std::byte* end;
+		std::byte* scan;
+
+		nbtspan(void* begin, size_t size)
+			: begin(static_cast<std::byte*>(begin)),
+			end(static_cast<std::byte*>(begin) + size),
+			scan(static_cast<std::byte*>(begin)) {}
+
+		nbtspan(const nbtspan& cvalue) = default;
+		nbtspan(nbtspan&& rvalue) = default;
+
+		nbtspan& operator=(const nbtspan& cvalue) = default;
+		nbtspan& operator=(nbtspan&& rvalue) = default;
+
+		[[nodiscard]] inline size_t tellp() const
+		{
+			return scan - begin;
+		}
+
+		[[nodiscard]] inline size_t size() const
+		{
+			return end - begin;
+		}
+
+		template<typename T>
+		inline void store(T value)
+		{
+			using U = std::conditional_t<sizeof(T) == 2, uint16_t, std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+			U as_int;
+			std::memcpy(&as_int, &value, sizeof(T));
+			if constexpr (std::endian::native == std::endian::little)
+				as_int = byteswap(as_int);
+			std::memcpy(scan, &as_int, sizeof(T));
+			scan += sizeof(T);
+		}
+
+		inline void write(std::byte value)
+		{
+			*scan++ = value;
+		}
+
+		inline void write(uint8_t value)
+		{
+			*scan++ = static_cast<std::byte>(value);
+		}
+
+		inline void write(int8_t value)
+		{
+			*scan++ = static_cast<std::byte>(value);
+		}
+
+		inline void write(uint16_t value) { store(value); }
+		inline void write(int16_t value) { store(value); }
+		inline void write(uint32_t value) { store(value); }
+		inline void write(int32_t value) { store(value); }
+		inline void write(uint64_t value) { store(value); }
+		inline void write(int64_t value) { store(value); }
+		inline void write(float value) { store(value); }
+		inline void write(double value) { store(value); }
+
+		// Same as nbtout, strings longer than 65535 bytes are cut off.
+		inline void write(std::string_view value)
+		{
+			uint16_t length = static_cast<uint16_t>(std::min<size_t>(value.size(), 0xFFFF));
+			write(length);
+			write_bytes(value.data(), length);
+		}
+
+		inline void write(tag value)
+		{
+			write(static_cast<uint8_t>(value));
+		}
+
+		inline void write_bytes(const void* data, size_t count)
+		{
+			if (count == 0)
+				return;
+			std::memcpy(scan, data, count);
+			scan += count;
+		}
+
+		// Writes count native elements of Size bytes as big-endian.
+		template<size_t Size>
+		inline void write_array(const void* data, size_t count)
+		{
+			byteswap_copy<Size>(scan, data, count);
+			scan += count * Size;
+		}
+
+	};
+
 	enum class proxytype : uint8_t
 	{
 		NONE = 0,
@@ -1123,10 +1500,10 @@ namespace nbt
 		COMPOUND = 10,
 		INTARRAY = 11,
 		LONGARRAY = 12,
-		PAIR = 13 // If the type is PAIR, that means that it is a std::pair<std::string, t_variant>
+		PAIR = 13 // If the type is PAIR, that means that it is a std::pair<atom, t_variant>
 	};
 
-	using key_pair = std::pair<std::string, t_variant>;
+	using key_pair = std::pair<atom, t_variant>;
 
 	// TODO:
 	//	Add methods for appending, erasing, and finding.
@@ -2460,7 +2837,7 @@ namespace nbt
 		NBTree() : root(nullptr), name(""), root_tag(Tag()) {}
 
 		NBTree(const t_variant& value, std::string_view tag_name = "") : root(value), name(tag_name), root_tag(Tag(root)) {}
-		NBTree(t_variant&& value, std::string_view tag_name = "") : root(value), name(tag_name), root_tag(Tag(root)) {}
+		NBTree(t_variant&& value, std::string_view tag_name = "") : root(std::move(value)), name(tag_name), root_tag(Tag(root)) {}
 		NBTree(t_byte value, std::string_view tag_name = "") : root(value), name(tag_name), root_tag(Tag(root)) {}
 		NBTree(t_short value, std::string_view tag_name = "") : root(value), name(tag_name), root_tag(Tag(root)) {}
 		NBTree(t_int value, std::string_view tag_name = "") : root(value), name(tag_name), root_tag(Tag(root)) {}
@@ -2476,17 +2853,31 @@ namespace nbt
 		}
 
 		template<typename T>
+			requires is_nbt_t<std::remove_cvref_t<T>>::value
 		NBTree(T&& value, std::string_view tag_name = "")
-			: root(value), name(tag_name), root_tag(Tag(root))
+			: root(std::forward<T>(value)), name(tag_name), root_tag(Tag(root))
 		{
-			static_assert(is_nbt_t<T>::value, "Must be NBT type.");
 		}
 
-		NBTree(const NBTree& rhs) = default;
-		NBTree(NBTree&& rhs) = default;
+		// root_tag points into root, so it is rebound rather than copied.
+		NBTree(const NBTree& rhs) : root(rhs.root), root_tag(Tag(root)), name(rhs.name) {}
+		NBTree(NBTree&& rhs) : root(std::move(rhs.root)), root_tag(Tag(root)), name(std::move(rhs.name)) {}
+
+		NBTree& operator=(const NBTree& rhs)
+		{
+			root = rhs.root;
+			root_tag = Tag(root);
+			name = rhs.name;
+			return *this;
+		}
 
-		NBTree& operator=(const NBTree& rhs) = default;
-		NBTree& operator=(NBTree&& rhs) = default;
+		NBTree& operator=(NBTree&& rhs)
+		{
+			root = std::move(rhs.root);
+			root_tag = Tag(root);
+			name = std::move(rhs.name);
+			return *this;
+		}
 
 		[[nodiscard]] inline size_t size() const
 		{
@@ -2534,6 +2925,7 @@ namespace nbt
 	t_bytearray read_bytearray(nbtin& in);
 	t_string read_string(nbtin& in);
 	t_list read_list(nbtin& in);
+	t_list read_list_elements(nbtin& in, tag list_type, int length);
 	t_compound read_compound(nbtin& in);
 	t_intarray read_intarray(nbtin& in);
 	t_longarray read_longarray(nbtin& in);
@@ -2577,183 +2969,142 @@ namespace nbt
 	[[nodiscard]] inline t_bytearray read_bytearray(nbtin& in)
 	{
 		int length = in.read_i32();
-		if (!in.ensure(length))
+		if (length < 0 || !in.ensure(length))
 			throw std::runtime_error("Reached end of buffer.");
-		t_bytearray result;
-		result.reserve(length);
-		for (int i = 0; i < length; i++)
-		{
-			result.push_back(static_cast<std::byte>(in.read_u8()));
-		}
+		in.charge(length);
+		t_bytearray result(in.scan, in.scan + length);
+		in.advance(length);
 		return result;
 	}
 
+	// Int and long arrays are converted in one pass straight out of the buffer, see nbt_byteswap.hpp.
 	[[nodiscard]] inline t_intarray read_intarray(nbtin& in)
 	{
 		int length = in.read_i32();
-		if (!in.ensure(static_cast<size_t>(length) * 4))
+		if (length < 0 || !in.ensure(static_cast<size_t>(length) * 4))
 			throw std::runtime_error("Reached end of buffer.");
+		in.charge(static_cast<size_t>(length) * 4);
 		t_intarray result(length);
-
+		byteswap_copy<4>(result.data(), in.scan, length);
+		in.advance(static_cast<size_t>(length) * 4);
 		return result;
 	}
 
 	[[nodiscard]] inline t_longarray read_longarray(nbtin& in)
 	{
 		int length = in.read_i32();
-		if (!in.ensure(static_cast<size_t>(length) * 8))
+		if (length < 0 || !in.ensure(static_cast<size_t>(length) * 8))
+			throw std::runtime_error("Reached end of buffer.");
+		in.charge(static_cast<size_t>(length) * 8);
+		t_longarray result(length);
+		byteswap_copy<8>(result.data(), in.scan, length);
+		in.advance(static_cast<size_t>(length) * 8);
+		return result;
+	}
+
+	// Lists of numbers are converted in one pass like int and long arrays.
+	template<typename T>
+	[[nodiscard]] inline t_list read_numeric_list(nbtin& in, int length)
+	{
+		if (!in.ensure(static_cast<size_t>(length) * sizeof(T)))
 			throw std::runtime_error("Reached end of buffer.");
-		t_longarray result;
-		result.reserve(length);
+		in.charge(static_cast<size_t>(length) * sizeof(T));
+		std::vector<T> data(length);
+		byteswap_copy<sizeof(T)>(data.data(), in.scan, length);
+		in.advance(static_cast<size_t>(length) * sizeof(T));
+		return t_list(std::move(data));
+	}
+
+	// Reads the elements of a list of strings, arrays, lists or compounds.
+	template<typename T, typename Read>
+	[[nodiscard]] inline t_list read_element_list(nbtin& in, int length, Read read)
+	{
+		in.charge(static_cast<size_t>(length) * sizeof(T));
+		auto data = std::vector<T>();
+		data.reserve(length);
 		for (int i = 0; i < length; i++)
 		{
-			result.push_back(in.read_i64());
+			data.push_back(read(in));
 		}
-		return result;
+		return t_list(std::move(data));
 	}
 
 	[[nodiscard]] inline t_list read_list(nbtin& in)
 	{
 		tag list_type = in.read_type();
 		int length = in.read_i32();
+		if (length < 0)
+			throw std::runtime_error("Reached end of buffer.");
 
 		if (length == 0 || list_type == tag::NONE)
 			return t_list(tag::NONE);
+		if (list_type > tag::LONGARRAY)
+			throw std::runtime_error("Invalid tag type.");
+		// Every element takes at least a byte, so a length past the end of the buffer is caught
+		// before anything is reserved for it.
+		if (!in.ensure(length))
+			throw std::runtime_error("Reached end of buffer.");
+
+		in.enter();
+		t_list result = read_list_elements(in, list_type, length);
+		in.leave();
+		return result;
+	}
 
+	[[nodiscard]] inline t_list read_list_elements(nbtin& in, tag list_type, int length)
+	{
 		switch (list_type)
 		{
 		case tag::BYTE:
-		{
-			auto data = std::vector<t_byte>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(in.read_i8());
-			}
-			return t_list(std::move(data));
-		}
+			return read_numeric_list<t_byte>(in, length);
 		case tag::SHORT:
-		{
-			auto data = std::vector<t_short>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(in.read_i16());
-			}
-			return t_list(std::move(data));
-		}
+			return read_numeric_list<t_short>(in, length);
 		case tag::INT:
-		{
-			auto data = std::vector<t_int>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(in.read_i32());
-			}
-			return t_list(std::move(data));
-		}
+			return read_numeric_list<t_int>(in, length);
 		case tag::LONG:
-		{
-			auto data = std::vector<t_long>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(in.read_i64());
-			}
-			return t_list(std::move(data));
-		}
+			return read_numeric_list<t_long>(in, length);
 		case tag::FLOAT:
-		{
-			auto data = std::vector<t_float>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(in.read_f32());
-			}
-			return t_list(std::move(data));
-		}
+			return read_numeric_list<t_float>(in, length);
 		case tag::DOUBLE:
-		{
-			auto data = std::vector<t_double>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(in.read_f64());
-			}
-			return t_list(std::move(data));
-		}
+			return read_numeric_list<t_double>(in, length);
 		case tag::BYTEARRAY:
-		{
-			auto data = std::vector<t_bytearray>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(read_bytearray(in));
-			}
-			return t_list(std::move(data));
-		}
+			return read_element_list<t_bytearray>(in, length, [](nbtin& in) { return read_bytearray(in); });
 		case tag::STRING:
-		{
-			auto data = std::vector<t_string>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(in.read_str());
-			}
-			return t_list(std::move(data));
-		}
+			return read_element_list<t_string>(in, length, [](nbtin& in) { return in.read_str(); });
 		case tag::LIST:
-		{
-			auto data = std::vector<t_list>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(read_list(in));
-			}
-			return t_list(std::move(data));
-		}
+			return read_element_list<t_list>(in, length, [](nbtin& in) { return read_list(in); });
 		case tag::COMPOUND:
-		{
-			auto data = std::vector<t_compound>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(read_compound(in));
-			}
-			return t_list(std::move(data));
-		}
+			return read_element_list<t_compound>(in, length, [](nbtin& in) { return read_compound(in); });
 		case tag::INTARRAY:
-		{
-			auto data = std::vector<t_intarray>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(read_intarray(in));
-			}
-			return t_list(std::move(data));
-		}
+			return read_element_list<t_intarray>(in, length, [](nbtin& in) { return read_intarray(in); });
 		case tag::LONGARRAY:
-		{
-			auto data = std::vector<t_longarray>();
-			data.reserve(length);
-			for (int i = 0; i < length; i++)
-			{
-				data.push_back(read_longarray(in));
-			}
-			return t_list(std::move(data));
-		}
+			return read_element_list<t_longarray>(in, length, [](nbtin& in) { return read_longarray(in); });
 		default:
 			return t_list(tag::NONE);
 		}
 	}
 
+	// Makes room for one more compound entry, charging any growth before it is allocated.
+	inline void reserve_entry(nbtin& in, t_compound::map& map)
+	{
+		if (map.size() < map.capacity())
+			return;
+		size_t grown = std::max<size_t>(map.capacity() * 2, 8);
+		in.charge((grown - map.capacity()) * sizeof(t_compound::map::value_type));
+		map.reserve(grown);
+	}
+
 	[[nodiscard]] inline t_compound read_compound(nbtin& in)
 	{
-		std::vector<std::pair<std::string, t_variant>> map;
+		in.enter();
+		t_compound::map map;
 		tag intype = in.read_type();
 		while (intype != tag::NONE)
 		{
-			std::string key = in.read_str();
+			size_t allocated = 0;
+			atom key(in.read_str_view(), allocated);
+			in.charge(allocated);
+			reserve_entry(in, map);
 			switch (intype)
 			{
 			case nbt::tag::BYTE:
@@ -2792,9 +3143,12 @@ namespace nbt
 			case nbt::tag::LONGARRAY:
 				map.push_back(std::make_pair(std::move(key), read_longarray(in)));
 				break;
+			default:
+				throw std::runtime_error("Invalid tag type.");
 			}
 			intype = in.read_type();
 		}
+		in.leave();
 		return t_compound(std::move(map));
 	}
 
@@ -2826,212 +3180,510 @@ namespace nbt
 			return read_intarray(in);
 		case tag::LONGARRAY:
 			return read_longarray(in);
+		case tag::NONE:
+			return nullptr;
+		default:
+			throw std::runtime_error("Invalid tag type.");
 		}
-		return nullptr;
 	}
 
-	void write_tag(t_byte value, nbtout& out);
-	void write_tag(t_short value, nbtout& out);
-	void write_tag(t_int value, nbtout& out);
-	void write_tag(t_long value, nbtout& out);
-	void write_tag(t_float value, nbtout& out);
-	void write_tag(t_double value, nbtout& out);
-	void write_tag(const t_bytearray& value, nbtout& out);
-	void write_tag(const t_string& value, nbtout& out);
-	void write_tag(const t_list& value, nbtout& out);
-	void write_tag(const t_compound& value, nbtout& out);
-	void write_tag(const t_intarray& value, nbtout& out);
-	void write_tag(const t_longarray& value, nbtout& out);
-	void write_tag(const t_variant& value, nbtout& out);
-
-	inline void write_tag(t_byte value, nbtout& out)
+	// Reads an array or list length and makes sure that many elements of element_size bytes are left.
+	[[nodiscard]] inline size_t read_length(nbtin& in, size_t element_size)
 	{
-		out.write(value);
+		int length = in.read_i32();
+		if (length < 0 || !in.ensure(static_cast<size_t>(length) * element_size))
+			throw std::runtime_error("Reached end of buffer.");
+		return static_cast<size_t>(length);
 	}
 
-	inline void write_tag(t_short value, nbtout& out)
+	// The size of a fixed width tag, 0 for strings, arrays, lists and compounds.
+	[[nodiscard]] constexpr size_t TagSize(tag type)
 	{
-		out.write(value);
+		switch (type)
+		{
+		case tag::BYTE:
+			return 1;
+		case tag::SHORT:
+			return 2;
+		case tag::INT:
+		case tag::FLOAT:
+			return 4;
+		case tag::LONG:
+		case tag::DOUBLE:
+			return 8;
+		default:
+			return 0;
+		}
 	}
 
-	inline void write_tag(t_int value, nbtout& out)
+	void skip_tag(nbtin& in, tag type);
+
+	// Skips the entries of a compound, up to and including its end tag.
+	inline void skip_entries(nbtin& in)
 	{
-		out.write(value);
+		in.enter();
+		tag type = in.read_type();
+		while (type != tag::NONE)
+		{
+			in.skip(in.read_u16());
+			skip_tag(in, type);
+			type = in.read_type();
+		}
+		in.leave();
 	}
 
-	inline void write_tag(t_long value, nbtout& out)
+	// Skips length list elements. Fixed width elements are skipped in one step.
+	inline void skip_elements(nbtin& in, tag type, size_t length)
 	{
-		out.write(value);
+		size_t size = TagSize(type);
+		if (size != 0)
+		{
+			in.skip(length * size);
+			return;
+		}
+		in.enter();
+		for (size_t i = 0; i < length; i++)
+		{
+			skip_tag(in, type);
+		}
+		in.leave();
 	}
 
-	inline void write_tag(t_float value, nbtout& out)
+	// Advances past a value without decoding it. Arrays and strings are a single pointer bump,
+	// only compounds and lists of compounds or lists are walked.
+	inline void skip_tag(nbtin& in, tag type)
 	{
-		out.write(value);
+		switch (type)
+		{
+		case tag::BYTE:
+		case tag::SHORT:
+		case tag::INT:
+		case tag::LONG:
+		case tag::FLOAT:
+		case tag::DOUBLE:
+			in.skip(TagSize(type));
+			break;
+		case tag::BYTEARRAY:
+			in.advance(read_length(in, 1));
+			break;
+		case tag::STRING:
+			in.skip(in.read_u16());
+			break;
+		case tag::INTARRAY:
+			in.advance(read_length(in, 4) * 4);
+			break;
+		case tag::LONGARRAY:
+			in.advance(read_length(in, 8) * 8);
+			break;
+		case tag::LIST:
+		{
+			tag element = in.read_type();
+			size_t length = read_length(in, std::max<size_t>(TagSize(element), 1));
+			if (element != tag::NONE)
+				skip_elements(in, element, length);
+			break;
+		}
+		case tag::COMPOUND:
+			skip_entries(in);
+			break;
+		default:
+			throw std::runtime_error("Invalid tag type.");
+		}
 	}
 
-	inline void write_tag(t_double value, nbtout& out)
+	// Follows a path from the root tag at the current position of in, without decoding anything
+	// along the way. Components are separated by dots and are either compound keys or list indices,
+	// as in "Level.sections" or "sections.3.Y". An empty path is the root itself.
+	// Returns a reader over just the value, positioned at its payload, and leaves in just past it.
+	// Returns an empty reader and type NONE if the path doesn't exist.
+	[[nodiscard]] inline nbtin find_path(nbtin& in, std::string_view path, tag& type)
 	{
-		out.write(value);
+		type = in.read_type();
+		in.skip(in.read_u16());
+
+		while (!path.empty())
+		{
+			size_t dot = path.find('.');
+			std::string_view component = path.substr(0, dot);
+			path = dot == std::string_view::npos ? std::string_view() : path.substr(dot + 1);
+
+			if (type == tag::COMPOUND)
+			{
+				tag child = in.read_type();
+				while (child != tag::NONE)
+				{
+					if (in.read_str_view() == component)
+						break;
+					skip_tag(in, child);
+					child = in.read_type();
+				}
+				type = child;
+			}
+			else if (type == tag::LIST)
+			{
+				tag element = in.read_type();
+				size_t length = read_length(in, std::max<size_t>(TagSize(element), 1));
+				size_t index = 0;
+				auto [end, error] = std::from_chars(component.data(), component.data() + component.size(), index);
+				if (error != std::errc() || end != component.data() + component.size() || index >= length)
+					type = tag::NONE;
+				else
+				{
+					skip_elements(in, element, index);
+					type = element;
+				}
+			}
+			else
+			{
+				type = tag::NONE;
+			}
+
+			if (type == tag::NONE)
+				return nbtin(nullptr, size_t(0));
+		}
+
+		const std::byte* start = in.scan;
+		skip_tag(in, type);
+		return nbtin(start, in.scan);
 	}
 
-	inline void write_tag(const t_string& value, nbtout& out)
+	[[nodiscard]] inline nbtin find_path(nbtin& in, std::string_view path)
 	{
-		out.write(value);
+		tag type;
+		return find_path(in, path, type);
 	}
 
-	inline void write_tag(const t_bytearray& value, nbtout& out)
+	// Event based reading, for scans that don't need a tree at all.
+	// visit walks the buffer and calls these on the visitor. Derive from sax_visitor and
+	// hide the ones you need; the calls are resolved at compile time, so the ones you don't are free.
+	// name is the key in the parent compound, the tree's name for the root and empty for list elements.
+	// bytes is the raw big-endian payload: the number itself, the characters of a string or the elements of an array.
+	// Returning false from begin_compound or begin_list skips the value with skip_tag, with no more events and no end_ call.
+	struct sax_visitor
 	{
-		out.write(static_cast<int>(value.size()));
-		for (auto v : value)
+		inline bool begin_compound(std::string_view)
 		{
-			out.write(v);
+			return true;
 		}
-	}
 
-	inline void write_tag(const t_intarray& value, nbtout& out)
+		inline void end_compound() {}
+
+		inline bool begin_list(std::string_view, tag, size_t)
+		{
+			return true;
+		}
+
+		inline void end_list() {}
+
+		inline void value(std::string_view, tag, std::span<const std::byte>) {}
+	};
+
+	template<typename Visitor>
+	void visit_tag(nbtin& in, tag type, std::string_view name, Visitor& visitor);
+
+	template<typename Visitor>
+	inline void visit_entries(nbtin& in, Visitor& visitor)
 	{
-		out.write(static_cast<int>(value.size()));
-		for (auto v : value)
+		in.enter();
+		tag type = in.read_type();
+		while (type != tag::NONE)
 		{
-			out.write(v);
+			std::string_view name = in.read_str_view();
+			visit_tag(in, type, name, visitor);
+			type = in.read_type();
 		}
+		in.leave();
 	}
 
-	inline void write_tag(const t_longarray& value, nbtout& out)
+	template<typename Visitor>
+	inline void visit_elements(nbtin& in, tag type, size_t length, Visitor& visitor)
 	{
-		out.write(static_cast<int>(value.size()));
-		for (auto v : value)
+		in.enter();
+		for (size_t i = 0; i < length; i++)
 		{
-			out.write(v);
+			visit_tag(in, type, std::string_view(), visitor);
 		}
+		in.leave();
 	}
 
-	inline void write_tag(const t_list& value, nbtout& out)
+	template<typename Visitor>
+	inline void visit_tag(nbtin& in, tag type, std::string_view name, Visitor& visitor)
 	{
-		out.write(value.type());
-		switch (value.type())
+		switch (type)
 		{
 		case tag::BYTE:
+			visitor.value(name, type, in.read_bytes(1));
+			break;
+		case tag::SHORT:
+			visitor.value(name, type, in.read_bytes(2));
+			break;
+		case tag::INT:
+		case tag::FLOAT:
+			visitor.value(name, type, in.read_bytes(4));
+			break;
+		case tag::LONG:
+		case tag::DOUBLE:
+			visitor.value(name, type, in.read_bytes(8));
+			break;
+		case tag::BYTEARRAY:
+			visitor.value(name, type, in.read_bytes(read_length(in, 1)));
+			break;
+		case tag::STRING:
+			visitor.value(name, type, in.read_bytes(in.read_u16()));
+			break;
+		case tag::INTARRAY:
+			visitor.value(name, type, in.read_bytes(read_length(in, 4) * 4));
+			break;
+		case tag::LONGARRAY:
+			visitor.value(name, type, in.read_bytes(read_length(in, 8) * 8));
+			break;
+		case tag::LIST:
 		{
-			const std::vector<t_byte>& sub = std::get<std::vector<t_byte>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto v : sub)
+			tag element = in.read_type();
+			// Every element takes at least one byte.
+			size_t length = read_length(in, element == tag::NONE ? 0 : 1);
+			if (element == tag::NONE)
+				length = 0;
+			if (visitor.begin_list(name, element, length))
 			{
-				out.write(v);
+				visit_elements(in, element, length, visitor);
+				visitor.end_list();
 			}
-		}
-		case tag::SHORT:
-		{
-			const std::vector<t_short>& sub = std::get<std::vector<t_short>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto v : sub)
+			else
 			{
-				out.write(v);
+				skip_elements(in, element, length);
 			}
+			break;
 		}
-		case tag::INT:
+		case tag::COMPOUND:
 		{
-			const std::vector<t_int>& sub = std::get<std::vector<t_int>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto v : sub)
+			if (visitor.begin_compound(name))
 			{
-				out.write(v);
+				visit_entries(in, visitor);
+				visitor.end_compound();
 			}
-		}
-		case tag::LONG:
-		{
-			const std::vector<t_long>& sub = std::get<std::vector<t_long>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto v : sub)
+			else
 			{
-				out.write(v);
+				skip_entries(in);
 			}
+			break;
 		}
-		case tag::FLOAT:
+		default:
+			throw std::runtime_error("Invalid tag type.");
+		}
+	}
+
+	// Walks a whole tree (the named root tag at the current position) without building it.
+	template<typename Visitor>
+	inline void visit(nbtin& in, Visitor& visitor)
+	{
+		tag type = in.read_type();
+		std::string_view name = in.read_str_view();
+		visit_tag(in, type, name, visitor);
+	}
+
+	// Serializing is done in two passes. encoded_size walks the tree once to find the exact number
+	// of bytes, then the tree is written into memory of exactly that size through nbtspan.
+
+	[[nodiscard]] size_t encoded_size(const t_list& value);
+	[[nodiscard]] size_t encoded_size(const t_compound& value);
+	[[nodiscard]] size_t encoded_size(const t_variant& value);
+
+	[[nodiscard]] inline size_t encoded_size(const t_string& value)
+	{
+		return 2 + std::min<size_t>(value.size(), 0xFFFF);
+	}
+
+	[[nodiscard]] inline size_t encoded_size(const t_bytearray& value)
+	{
+		return 4 + value.size();
+	}
+
+	[[nodiscard]] inline size_t encoded_size(const t_intarray& value)
+	{
+		return 4 + value.size() * 4;
+	}
+
+	[[nodiscard]] inline size_t encoded_size(const t_longarray& value)
+	{
+		return 4 + value.size() * 8;
+	}
+
+	template<typename T>
+	[[nodiscard]] inline size_t encoded_size(const std::vector<T>& values)
+	{
+		size_t total = 0;
+		for (auto& v : values)
+			total += encoded_size(v);
+		return total;
+	}
+
+	[[nodiscard]] inline size_t encoded_size(const t_list& value)
+	{
+		// Element type and length.
+		size_t total = 5;
+		switch (value.type())
 		{
-			const std::vector<t_float>& sub = std::get<std::vector<t_float>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto v : sub)
-			{
-				out.write(v);
-			}
+		case tag::BYTE:
+			return total + value.size();
+		case tag::SHORT:
+			return total + value.size() * 2;
+		case tag::INT:
+		case tag::FLOAT:
+			return total + value.size() * 4;
+		case tag::LONG:
+		case tag::DOUBLE:
+			return total + value.size() * 8;
+		case tag::BYTEARRAY:
+			return total + encoded_size(std::get<std::vector<t_bytearray>>(value.data));
+		case tag::STRING:
+			return total + encoded_size(std::get<std::vector<t_string>>(value.data));
+		case tag::LIST:
+			return total + encoded_size(std::get<std::vector<t_list>>(value.data));
+		case tag::COMPOUND:
+			return total + encoded_size(std::get<std::vector<t_compound>>(value.data));
+		case tag::INTARRAY:
+			return total + encoded_size(std::get<std::vector<t_intarray>>(value.data));
+		case tag::LONGARRAY:
+			return total + encoded_size(std::get<std::vector<t_longarray>>(value.data));
+		default:
+			return total;
 		}
+	}
+
+	[[nodiscard]] inline size_t encoded_size(const t_compound& value)
+	{
+		// End tag.
+		size_t total = 1;
+		for (auto& v : value.data)
+			total += 1 + encoded_size(v.first.str()) + encoded_size(v.second);
+		return total;
+	}
+
+	[[nodiscard]] inline size_t encoded_size(const t_variant& node)
+	{
+		switch (tag(node.index()))
+		{
+		case tag::BYTE:
+		case tag::SHORT:
+		case tag::INT:
+		case tag::LONG:
+		case tag::FLOAT:
 		case tag::DOUBLE:
+			return TagSize(tag(node.index()));
+		case tag::BYTEARRAY:
+			return encoded_size(std::get<t_bytearray>(node));
+		case tag::STRING:
+			return encoded_size(std::get<t_string>(node));
+		case tag::LIST:
+			return encoded_size(std::get<t_list>(node));
+		case tag::COMPOUND:
+			return encoded_size(std::get<t_compound>(node));
+		case tag::INTARRAY:
+			return encoded_size(std::get<t_intarray>(node));
+		case tag::LONGARRAY:
+			return encoded_size(std::get<t_longarray>(node));
+		default:
+			return 0;
+		}
+	}
+
+	// The full size of a dump, root type and name included.
+	[[nodiscard]] inline size_t encoded_size(const NBTree& tree)
+	{
+		return 1 + encoded_size(tree.name) + encoded_size(tree.root);
+	}
+
+	void write_tag(const t_list& value, nbtspan& out);
+	void write_tag(const t_compound& value, nbtspan& out);
+	void write_tag(const t_variant& value, nbtspan& out);
+
+	inline void write_tag(const t_bytearray& value, nbtspan& out)
+	{
+		out.write(static_cast<int>(value.size()));
+		out.write_bytes(value.data(), value.size());
+	}
+
+	inline void write_tag(const t_intarray& value, nbtspan& out)
+	{
+		out.write(static_cast<int>(value.size()));
+		out.write_array<4>(value.data(), value.size());
+	}
+
+	inline void write_tag(const t_longarray& value, nbtspan& out)
+	{
+		out.write(static_cast<int>(value.size()));
+		out.write_array<8>(value.data(), value.size());
+	}
+
+	template<typename T>
+	inline void write_elements(const std::vector<T>& values, nbtspan& out)
+	{
+		out.write(static_cast<int>(values.size()));
+		if constexpr (std::is_arithmetic_v<T>)
 		{
-			const std::vector<t_double>& sub = std::get<std::vector<t_double>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto v : sub)
-			{
+			out.write_array<sizeof(T)>(values.data(), values.size());
+		}
+		else if constexpr (std::is_same_v<T, t_string>)
+		{
+			for (auto& v : values)
 				out.write(v);
-			}
 		}
-		case tag::BYTEARRAY:
+		else
 		{
-			const std::vector<t_bytearray>& sub = std::get<std::vector<t_bytearray>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto& v : sub)
-			{
+			for (auto& v : values)
 				write_tag(v, out);
-			}
-			break;
 		}
-		case tag::STRING:
+	}
+
+	inline void write_tag(const t_list& value, nbtspan& out)
+	{
+		out.write(value.type());
+		switch (value.type())
 		{
-			const std::vector<t_string>& sub = std::get<std::vector<t_string>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto& v : sub)
-			{
-				out.write(v);
-			}
+		case tag::BYTE:
+			write_elements(std::get<std::vector<t_byte>>(value.data), out);
+			break;
+		case tag::SHORT:
+			write_elements(std::get<std::vector<t_short>>(value.data), out);
+			break;
+		case tag::INT:
+			write_elements(std::get<std::vector<t_int>>(value.data), out);
+			break;
+		case tag::LONG:
+			write_elements(std::get<std::vector<t_long>>(value.data), out);
+			break;
+		case tag::FLOAT:
+			write_elements(std::get<std::vector<t_float>>(value.data), out);
+			break;
+		case tag::DOUBLE:
+			write_elements(std::get<std::vector<t_double>>(value.data), out);
+			break;
+		case tag::BYTEARRAY:
+			write_elements(std::get<std::vector<t_bytearray>>(value.data), out);
+			break;
+		case tag::STRING:
+			write_elements(std::get<std::vector<t_string>>(value.data), out);
 			break;
-		}
 		case tag::LIST:
-		{
-			const std::vector<t_list>& sub = std::get<std::vector<t_list>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto& v : sub)
-			{
-				write_tag(v, out);
-			}
+			write_elements(std::get<std::vector<t_list>>(value.data), out);
 			break;
-		}
 		case tag::COMPOUND:
-		{
-			const std::vector<t_compound>& sub = std::get<std::vector<t_compound>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto& v : sub)
-			{
-				write_tag(v, out);
-			}
+			write_elements(std::get<std::vector<t_compound>>(value.data), out);
 			break;
-		}
 		case tag::INTARRAY:
-		{
-			const std::vector<t_intarray>& sub = std::get<std::vector<t_intarray>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto& v : sub)
-			{
-				write_tag(v, out);
-			}
+			write_elements(std::get<std::vector<t_intarray>>(value.data), out);
 			break;
-		}
 		case tag::LONGARRAY:
-		{
-			const std::vector<t_longarray>& sub = std::get<std::vector<t_longarray>>(value.data);
-			out.write(static_cast<int>(sub.size()));
-			for (auto& v : sub)
-			{
-				write_tag(v, out);
-			}
+			write_elements(std::get<std::vector<t_longarray>>(value.data), out);
 			break;
-		}
 		default:
 			out.write(int(0));
 			break;
 		}
 	}
 
-	inline void write_tag(const t_compound& value, nbtout& out)
+	inline void write_tag(const t_compound& value, nbtspan& out)
 	{
 		for (auto& v : value.data)
 		{
@@ -3043,7 +3695,7 @@ namespace nbt
 		out.write(tag::NONE);
 	}
 
-	inline void write_tag(const t_variant& node, nbtout& out)
+	inline void write_tag(const t_variant& node, nbtspan& out)
 	{
 		switch (tag(node.index()))
 		{
@@ -3086,6 +3738,82 @@ namespace nbt
 		}
 	}
 
+	// Grows the buffer once by the exact encoded size and writes the value into the new space.
+	template<typename T>
+	inline void write_sized(const T& value, nbtout& out)
+	{
+		size_t offset = out.buffer.size();
+		size_t size = encoded_size(value);
+		out.buffer.resize(offset + size);
+		nbtspan span(out.buffer.data() + offset, size);
+		write_tag(value, span);
+	}
+
+	inline void write_tag(t_byte value, nbtout& out)
+	{
+		out.write(value);
+	}
+
+	inline void write_tag(t_short value, nbtout& out)
+	{
+		out.write(value);
+	}
+
+	inline void write_tag(t_int value, nbtout& out)
+	{
+		out.write(value);
+	}
+
+	inline void write_tag(t_long value, nbtout& out)
+	{
+		out.write(value);
+	}
+
+	inline void write_tag(t_float value, nbtout& out)
+	{
+		out.write(value);
+	}
+
+	inline void write_tag(t_double value, nbtout& out)
+	{
+		out.write(value);
+	}
+
+	inline void write_tag(const t_string& value, nbtout& out)
+	{
+		out.write(value);
+	}
+
+	inline void write_tag(const t_bytearray& value, nbtout& out)
+	{
+		write_sized(value, out);
+	}
+
+	inline void write_tag(const t_intarray& value, nbtout& out)
+	{
+		write_sized(value, out);
+	}
+
+	inline void write_tag(const t_longarray& value, nbtout& out)
+	{
+		write_sized(value, out);
+	}
+
+	inline void write_tag(const t_list& value, nbtout& out)
+	{
+		write_sized(value, out);
+	}
+
+	inline void write_tag(const t_compound& value, nbtout& out)
+	{
+		write_sized(value, out);
+	}
+
+	inline void write_tag(const t_variant& node, nbtout& out)
+	{
+		write_sized(node, out);
+	}
+
 	[[nodiscard]] inline NBTree load(nbtin& in)
 	{
 		tag node_type = in.read_type();
@@ -3102,7 +3830,14 @@ namespace nbt
 		}
 	}
 
-	inline void dump(const NBTree& tree, nbtout& out)
+	// Reads untrusted data, throwing once it nests deeper or would take more memory than allowed.
+	[[nodiscard]] inline NBTree load(nbtin& in, const read_limits& limits)
+	{
+		in.limit(limits);
+		return load(in);
+	}
+
+	inline void dump(const NBTree& tree, nbtspan& out)
 	{
 		tag node_type = tag(tree.root.index());
 		out.write(node_type);
@@ -3110,6 +3845,26 @@ namespace nbt
 		write_tag(tree.root, out);
 	}
 
+	inline void dump(const NBTree& tree, nbtout& out)
+	{
+		size_t offset = out.buffer.size();
+		size_t size = encoded_size(tree);
+		out.buffer.resize(offset + size);
+		nbtspan span(out.buffer.data() + offset, size);
+		dump(tree, span);
+	}
+
+	// Writes the tree straight into output, such as the sectors of a region file, and returns how many bytes it took.
+	inline size_t dump(const NBTree& tree, std::span<std::byte> output)
+	{
+		size_t size = encoded_size(tree);
+		if (size > output.size())
+			throw std::runtime_error("Output buffer too small.");
+		nbtspan span(output.data(), size);
+		dump(tree, span);
+		return size;
+	}
+
 }
 
 #endif // NBT_TAGS_HEADER_FILE
\ No newline at end of file
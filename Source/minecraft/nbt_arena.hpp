@@ -0,0 +1,586 @@
+﻿#ifndef NBT_ARENA_HEADER_FILE
+#define NBT_ARENA_HEADER_FILE
+
+// An alternative to NBTree where every node, key, string and array of a tree
+// lives in one bump allocated arena. Parsing does no per-node heap allocation,
+// and the whole tree goes away when the arena is reset or destroyed.
+// Arena trees are read only and are only valid as long as their arena.
+
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "nbt.hpp"
+
+namespace nbt
+{
+
+	class arena
+	{
+	public:
+		// Blocks are at least block_size bytes. Larger allocations get a block of their own.
+		arena(size_t block_size = 64 * 1024) : block_size(block_size) {}
+
+		~arena()
+		{
+			release();
+		}
+
+		arena(const arena&) = delete;
+		arena& operator=(const arena&) = delete;
+
+		arena(arena&& rhs) noexcept
+		{
+			*this = std::move(rhs);
+		}
+
+		arena& operator=(arena&& rhs) noexcept
+		{
+			if (this != &rhs)
+			{
+				release();
+				first = std::exchange(rhs.first, nullptr);
+				current = std::exchange(rhs.current, nullptr);
+				cursor = std::exchange(rhs.cursor, nullptr);
+				limit = std::exchange(rhs.limit, nullptr);
+				block_size = rhs.block_size;
+			}
+			return *this;
+		}
+
+		[[nodiscard]] inline void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+		{
+			std::byte* start = align(cursor, alignment);
+			if (start == nullptr || start > limit || size > static_cast<size_t>(limit - start))
+			{
+				next_block(size + alignment);
+				start = align(cursor, alignment);
+			}
+			cursor = start + size;
+			return start;
+		}
+
+		// Uninitialized storage for count objects. Only meant for trivially destructible types,
+		// since nothing in the arena is ever destroyed.
+		template<typename T>
+		[[nodiscard]] inline T* allocate_array(size_t count)
+		{
+			static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed.");
+			if (count == 0)
+				return nullptr;
+			return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+		}
+
+		// Forgets everything allocated so far but keeps the blocks around for reuse.
+		inline void reset()
+		{
+			current = first;
+			if (current != nullptr)
+			{
+				cursor = current->data();
+				limit = cursor + current->size;
+			}
+			else
+			{
+				cursor = nullptr;
+				limit = nullptr;
+			}
+		}
+
+		// Total bytes reserved from the system.
+		[[nodiscard]] inline size_t capacity() const
+		{
+			size_t total = 0;
+			for (block* b = first; b != nullptr; b = b->next)
+				total += b->size;
+			return total;
+		}
+
+	private:
+		struct block
+		{
+			block* next;
+			size_t size;
+
+			inline std::byte* data()
+			{
+				return reinterpret_cast<std::byte*>(this + 1);
+			}
+		};
+
+		block* first = nullptr;
+		block* current = nullptr;
+		std::byte* cursor = nullptr;
+		std::byte* limit = nullptr;
+		size_t block_size = 0;
+
+		static inline std::byte* align(std::byte* pointer, size_t alignment)
+		{
+			uintptr_t value = reinterpret_cast<uintptr_t>(pointer);
+			return reinterpret_cast<std::byte*>((value + alignment - 1) & ~(alignment - 1));
+		}
+
+		inline void next_block(size_t minimum)
+		{
+			// Blocks left over from before a reset are reused when they are big enough.
+			while (current != nullptr && current->next != nullptr)
+			{
+				current = current->next;
+				if (current->size >= minimum)
+				{
+					cursor = current->data();
+					limit = cursor + current->size;
+					return;
+				}
+			}
+
+			size_t size = std::max(minimum, block_size);
+			block* fresh = static_cast<block*>(::operator new(sizeof(block) + size));
+			fresh->next = nullptr;
+			fresh->size = size;
+			if (current != nullptr)
+			{
+				// Keep any blocks after current so a later reset can still use them.
+				fresh->next = current->next;
+				current->next = fresh;
+			}
+			else
+			{
+				first = fresh;
+			}
+			current = fresh;
+			cursor = fresh->data();
+			limit = cursor + size;
+		}
+
+		inline void release()
+		{
+			block* b = first;
+			while (b != nullptr)
+			{
+				block* next = b->next;
+				::operator delete(b);
+				b = next;
+			}
+			first = nullptr;
+			current = nullptr;
+			cursor = nullptr;
+			limit = nullptr;
+		}
+	};
+
+	class a_value;
+	class a_list;
+	class a_compound;
+
+	using a_entry = std::pair<std::string_view, a_value>;
+
+	class a_value
+	{
+	public:
+		a_value() : _type(tag::NONE), _size(0), _long(0) {}
+
+		[[nodiscard]] inline tag type() const
+		{
+			return _type;
+		}
+
+		// Length of strings and arrays, 0 for everything else.
+		[[nodiscard]] inline size_t size() const
+		{
+			return _size;
+		}
+
+		// Only for the numeric types. Returns nullptr if the value is of another type.
+		template<typename T>
+		[[nodiscard]] inline const T* get_if() const
+		{
+			static_assert(is_nbt_t<T>::value, "Must be NBT type.");
+			static_assert(std::is_arithmetic<T>::value, "Use the as_ accessors for strings, arrays, lists and compounds.");
+			if (_type != TagType<T>())
+				return nullptr;
+			if constexpr (std::is_same<T, t_byte>::value)
+				return &_byte;
+			if constexpr (std::is_same<T, t_short>::value)
+				return &_short;
+			if constexpr (std::is_same<T, t_int>::value)
+				return &_int;
+			if constexpr (std::is_same<T, t_long>::value)
+				return &_long;
+			if constexpr (std::is_same<T, t_float>::value)
+				return &_float;
+			if constexpr (std::is_same<T, t_double>::value)
+				return &_double;
+		}
+
+		[[nodiscard]] inline std::string_view as_string() const
+		{
+			if (_type != tag::STRING)
+				return {};
+			return std::string_view(static_cast<const char*>(_pointer), _size);
+		}
+
+		[[nodiscard]] inline std::span<const std::byte> as_bytearray() const
+		{
+			if (_type != tag::BYTEARRAY)
+				return {};
+			return std::span<const std::byte>(static_cast<const std::byte*>(_pointer), _size);
+		}
+
+		[[nodiscard]] inline std::span<const int32_t> as_intarray() const
+		{
+			if (_type != tag::INTARRAY)
+				return {};
+			return std::span<const int32_t>(static_cast<const int32_t*>(_pointer), _size);
+		}
+
+		[[nodiscard]] inline std::span<const int64_t> as_longarray() const
+		{
+			if (_type != tag::LONGARRAY)
+				return {};
+			return std::span<const int64_t>(static_cast<const int64_t*>(_pointer), _size);
+		}
+
+		[[nodiscard]] inline const a_list* as_list() const
+		{
+			return _type == tag::LIST ? static_cast<const a_list*>(_pointer) : nullptr;
+		}
+
+		[[nodiscard]] inline const a_compound* as_compound() const
+		{
+			return _type == tag::COMPOUND ? static_cast<const a_compound*>(_pointer) : nullptr;
+		}
+
+		// Looks up a key if this is a compound. Returns nullptr otherwise or if the key is missing.
+		[[nodiscard]] inline const a_value* operator[](std::string_view key) const;
+
+		template<typename T>
+		[[nodiscard]] static inline a_value make(T value)
+		{
+			static_assert(std::is_arithmetic<T>::value && is_nbt_t<T>::value, "Must be a numeric NBT type.");
+			a_value result;
+			result._type = TagType<T>();
+			if constexpr (std::is_same<T, t_byte>::value)
+				result._byte = value;
+			if constexpr (std::is_same<T, t_short>::value)
+				result._short = value;
+			if constexpr (std::is_same<T, t_int>::value)
+				result._int = value;
+			if constexpr (std::is_same<T, t_long>::value)
+				result._long = value;
+			if constexpr (std::is_same<T, t_float>::value)
+				result._float = value;
+			if constexpr (std::is_same<T, t_double>::value)
+				result._double = value;
+			return result;
+		}
+
+		[[nodiscard]] static inline a_value make(tag type, const void* pointer, size_t size = 0)
+		{
+			a_value result;
+			result._type = type;
+			result._size = static_cast<uint32_t>(size);
+			result._pointer = pointer;
+			return result;
+		}
+
+	private:
+		tag _type;
+		uint32_t _size;
+		union
+		{
+			t_byte _byte;
+			t_short _short;
+			t_int _int;
+			t_long _long;
+			t_float _float;
+			t_double _double;
+			const void* _pointer;
+		};
+	};
+
+	class a_list
+	{
+	public:
+		a_list() = default;
+		a_list(tag type, const a_value* data, size_t count) : _type(type), _count(static_cast<uint32_t>(count)), _data(data) {}
+
+		// The element type. NONE for empty lists.
+		[[nodiscard]] inline tag type() const
+		{
+			return _type;
+		}
+
+		[[nodiscard]] inline size_t size() const
+		{
+			return _count;
+		}
+
+		[[nodiscard]] inline const a_value* begin() const
+		{
+			return _data;
+		}
+
+		[[nodiscard]] inline const a_value* end() const
+		{
+			return _data + _count;
+		}
+
+		[[nodiscard]] inline const a_value& operator[](size_t index) const
+		{
+			return _data[index];
+		}
+
+		// Returns a nullptr upon any kind of failure, including out of range failure.
+		template<typename T>
+		[[nodiscard]] inline const T* get(size_t index) const
+		{
+			if (index >= _count)
+				return nullptr;
+			return _data[index].get_if<T>();
+		}
+
+	private:
+		tag _type = tag::NONE;
+		uint32_t _count = 0;
+		const a_value* _data = nullptr;
+	};
+
+	class a_compound
+	{
+	public:
+		a_compound() = default;
+		a_compound(const a_entry* data, size_t count) : _data(data), _count(count) {}
+
+		[[nodiscard]] inline size_t size() const
+		{
+			return _count;
+		}
+
+		[[nodiscard]] inline const a_entry* begin() const
+		{
+			return _data;
+		}
+
+		[[nodiscard]] inline const a_entry* end() const
+		{
+			return _data + _count;
+		}
+
+		// Returns end() if the key is missing.
+		[[nodiscard]] inline const a_entry* find(std::string_view key) const
+		{
+			return std::find_if(begin(), end(), [key](const a_entry& val) { return val.first == key; });
+		}
+
+		[[nodiscard]] inline const a_value* operator[](std::string_view key) const
+		{
+			const a_entry* found = find(key);
+			return found != end() ? &found->second : nullptr;
+		}
+
+		[[nodiscard]] inline tag get_type(std::string_view key) const
+		{
+			const a_entry* found = find(key);
+			return found != end() ? found->second.type() : tag::NONE;
+		}
+
+		template<typename T>
+		[[nodiscard]] inline const T* get_if(std::string_view key) const
+		{
+			const a_entry* found = find(key);
+			return found != end() ? found->second.get_if<T>() : nullptr;
+		}
+
+	private:
+		const a_entry* _data = nullptr;
+		size_t _count = 0;
+	};
+
+	inline const a_value* a_value::operator[](std::string_view key) const
+	{
+		const a_compound* compound = as_compound();
+		return compound != nullptr ? (*compound)[key] : nullptr;
+	}
+
+	// The root of a tree read with load_arena. Everything it points to lives in the arena it was read into.
+	struct a_tree
+	{
+		a_value root;
+		std::string_view name;
+
+		[[nodiscard]] inline tag type() const
+		{
+			return root.type();
+		}
+
+		[[nodiscard]] inline const a_value* operator[](std::string_view key) const
+		{
+			return root[key];
+		}
+	};
+
+	// Reads NBT straight into an arena.
+	// Compound entries are collected on a scratch stack, which is reused for every compound,
+	// and copied into the arena once the compound's end tag is reached.
+	// Keep one reader for a run of trees and its stack is reused too, so once the arena is reset
+	// between trees and has grown its blocks, loading allocates nothing.
+	class arena_reader
+	{
+	public:
+		arena_reader(arena& memory) : memory(memory) {}
+
+		[[nodiscard]] inline a_tree load(nbtin& in)
+		{
+			a_tree result;
+			tag type = in.read_type();
+			result.name = read_string(in);
+			result.root = read(in, type);
+			return result;
+		}
+
+		[[nodiscard]] inline a_value read(nbtin& in, tag type)
+		{
+			switch (type)
+			{
+			case tag::BYTE:
+				return a_value::make(in.read_i8());
+			case tag::SHORT:
+				return a_value::make(in.read_i16());
+			case tag::INT:
+				return a_value::make(in.read_i32());
+			case tag::LONG:
+				return a_value::make(in.read_i64());
+			case tag::FLOAT:
+				return a_value::make(in.read_f32());
+			case tag::DOUBLE:
+				return a_value::make(in.read_f64());
+			case tag::BYTEARRAY:
+			{
+				size_t length = read_length(in, 1);
+				in.charge(length);
+				std::byte* data = memory.allocate_array<std::byte>(length);
+				if (length != 0)
+					std::memcpy(data, in.scan, length);
+				in.advance(length);
+				return a_value::make(tag::BYTEARRAY, data, length);
+			}
+			case tag::STRING:
+			{
+				std::string_view value = read_string(in);
+				return a_value::make(tag::STRING, value.data(), value.size());
+			}
+			case tag::LIST:
+				return read_list(in);
+			case tag::COMPOUND:
+				return read_compound(in);
+			case tag::INTARRAY:
+			{
+				size_t length = read_length(in, 4);
+				in.charge(length * 4);
+				int32_t* data = memory.allocate_array<int32_t>(length);
+				byteswap_copy<4>(data, in.scan, length);
+				in.advance(length * 4);
+				return a_value::make(tag::INTARRAY, data, length);
+			}
+			case tag::LONGARRAY:
+			{
+				size_t length = read_length(in, 8);
+				in.charge(length * 8);
+				int64_t* data = memory.allocate_array<int64_t>(length);
+				byteswap_copy<8>(data, in.scan, length);
+				in.advance(length * 8);
+				return a_value::make(tag::LONGARRAY, data, length);
+			}
+			default:
+				throw std::runtime_error("Invalid tag type.");
+			}
+		}
+
+	private:
+		arena& memory;
+		std::vector<a_entry> stack;
+
+		// Array and list lengths are signed. Makes sure there are at least length * element_size bytes left.
+		[[nodiscard]] static inline size_t read_length(nbtin& in, size_t element_size)
+		{
+			int32_t length = in.read_i32();
+			if (length < 0 || !in.ensure(static_cast<size_t>(length) * element_size))
+				throw std::runtime_error("Reached end of buffer.");
+			return static_cast<size_t>(length);
+		}
+
+		[[nodiscard]] inline std::string_view read_string(nbtin& in)
+		{
+			uint16_t length = in.read_u16();
+			if (!in.ensure(length))
+				throw std::runtime_error("Reached end of buffer.");
+			char* data = memory.allocate_array<char>(length);
+			if (length != 0)
+				std::memcpy(data, in.scan, length);
+			in.advance(length);
+			return std::string_view(data, length);
+		}
+
+		[[nodiscard]] inline a_value read_list(nbtin& in)
+		{
+			tag type = in.read_type();
+			// Every element takes at least one byte.
+			size_t length = read_length(in, type == tag::NONE ? 0 : 1);
+			if (type == tag::NONE)
+				length = 0;
+
+			in.enter();
+			in.charge(length * sizeof(a_value));
+			a_value* data = memory.allocate_array<a_value>(length);
+			for (size_t i = 0; i < length; i++)
+				new (&data[i]) a_value(read(in, type));
+			in.leave();
+
+			a_list* list = new (memory.allocate_array<a_list>(1)) a_list(length == 0 ? tag::NONE : type, data, length);
+			return a_value::make(tag::LIST, list);
+		}
+
+		[[nodiscard]] inline a_value read_compound(nbtin& in)
+		{
+			in.enter();
+			size_t base = stack.size();
+			tag type = in.read_type();
+			while (type != tag::NONE)
+			{
+				std::string_view key = read_string(in);
+				// read may grow the stack, so don't hold a reference into it.
+				a_value value = read(in, type);
+				stack.emplace_back(key, value);
+				type = in.read_type();
+			}
+
+			size_t count = stack.size() - base;
+			in.charge(count * sizeof(a_entry));
+			in.leave();
+			a_entry* data = memory.allocate_array<a_entry>(count);
+			for (size_t i = 0; i < count; i++)
+				new (&data[i]) a_entry(stack[base + i]);
+			stack.resize(base);
+
+			a_compound* compound = new (memory.allocate_array<a_compound>(1)) a_compound(data, count);
+			return a_value::make(tag::COMPOUND, compound);
+		}
+	};
+
+	// Reads a whole tree into memory. Reset the arena between trees to reuse its blocks.
+	// Each call builds a reader of its own whose stack is allocated again, use arena_reader to avoid that.
+	[[nodiscard]] inline a_tree load_arena(nbtin& in, arena& memory)
+	{
+		arena_reader reader(memory);
+		return reader.load(in);
+	}
+
+}
+
+#endif // NBT_ARENA_HEADER_FILE
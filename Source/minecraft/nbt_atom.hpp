@@ -0,0 +1,277 @@
+﻿#ifndef NBT_ATOM_HEADER_FILE
+#define NBT_ATOM_HEADER_FILE
+
+// Compound keys are interned into one process wide pool, so the few hundred keys every chunk
+// repeats are stored once and compared by address. Interned strings live until the process ends.
+// The pool only takes short keys and stops growing at a fixed size, so untrusted data full of
+// made up keys can't fill it. Keys it turns away get an entry of their own, freed with the last
+// atom that uses it.
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
+#include <optional>
+#include <mutex>
+#include <shared_mutex>
+#include <cstdint>
+#include <cstddef>
+
+namespace nbt
+{
+
+	// 64 bit FNV-1a, usable at compile time.
+	[[nodiscard]] constexpr uint64_t hash_key(std::string_view key)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		for (char c : key)
+		{
+			hash ^= static_cast<uint8_t>(c);
+			hash *= 0x100000001b3ull;
+		}
+		return hash;
+	}
+
+	// Keys longer than this are never interned. Real compound keys are short identifiers.
+	constexpr size_t ATOM_MAX_LENGTH = 64;
+	// The pool stops taking new keys once its entries take up this many bytes.
+	constexpr size_t ATOM_POOL_BUDGET = 1024 * 1024;
+	// The id of keys the pool turned away.
+	constexpr uint32_t ATOM_UNPOOLED = 0xFFFFFFFF;
+
+	struct atom_entry
+	{
+		std::string text;
+		uint64_t hash;
+		uint32_t id;
+		// Atoms using an entry that isn't in the pool. Pool entries are never freed and don't count.
+		mutable std::atomic<uint32_t> references;
+
+		atom_entry(std::string_view text, uint32_t id) : text(text), hash(hash_key(text)), id(id), references(1) {}
+
+		[[nodiscard]] inline bool pooled() const
+		{
+			return id != ATOM_UNPOOLED;
+		}
+
+		// Roughly what an entry holding text costs.
+		[[nodiscard]] static constexpr size_t footprint(size_t length)
+		{
+			return sizeof(atom_entry) + length + 1;
+		}
+	};
+
+	// Lookups are served from a per thread cache first and only take the shared lock on a miss,
+	// so threads loading chunks side by side do not fight over the pool. The cache only holds
+	// pool entries, so it is bounded along with the pool.
+	class atom_pool
+	{
+	public:
+		static atom_pool& instance()
+		{
+			static atom_pool pool;
+			return pool;
+		}
+
+		// Returns nullptr if text was never interned.
+		[[nodiscard]] const atom_entry* find(std::string_view text)
+		{
+			thread_local std::unordered_map<std::string_view, const atom_entry*> cache;
+			auto cached = cache.find(text);
+			if (cached != cache.end())
+				return cached->second;
+
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			auto found = lookup.find(text);
+			if (found == lookup.end())
+				return nullptr;
+			// Keys point into the pool, which never frees them.
+			cache.emplace(found->first, found->second);
+			return found->second;
+		}
+
+		// Returns the pool's entry for text, adding it if there is room. Otherwise returns a new entry
+		// owned by the caller, with one reference. allocated grows by the bytes either one took.
+		[[nodiscard]] const atom_entry* intern(std::string_view text, size_t& allocated)
+		{
+			if (const atom_entry* found = find(text))
+				return found;
+
+			if (text.size() <= ATOM_MAX_LENGTH && !full.load(std::memory_order_relaxed))
+			{
+				std::unique_lock<std::shared_mutex> lock(mutex);
+				auto found = lookup.find(text);
+				if (found != lookup.end())
+					return found->second;
+				if (bytes + atom_entry::footprint(text.size()) <= ATOM_POOL_BUDGET)
+				{
+					// A deque never moves its elements, so views into them stay valid.
+					const atom_entry& added = entries.emplace_back(text, static_cast<uint32_t>(entries.size()));
+					lookup.emplace(added.text, &added);
+					bytes += atom_entry::footprint(text.size());
+					allocated += atom_entry::footprint(text.size());
+					return &added;
+				}
+				full.store(true, std::memory_order_relaxed);
+			}
+			allocated += atom_entry::footprint(text.size());
+			return new atom_entry(text, ATOM_UNPOOLED);
+		}
+
+		[[nodiscard]] size_t size()
+		{
+			std::shared_lock<std::shared_mutex> lock(mutex);
+			return entries.size();
+		}
+
+	private:
+		std::shared_mutex mutex;
+		std::deque<atom_entry> entries;
+		std::unordered_map<std::string_view, const atom_entry*> lookup;
+		size_t bytes = 0;
+		std::atomic<bool> full = false;
+
+		// The empty key is what default constructed and moved from atoms hold, so it is always pooled,
+		// whatever the budget, and never freed. It gets id 0.
+		atom_pool()
+		{
+			const atom_entry& added = entries.emplace_back(std::string_view(), 0);
+			lookup.emplace(added.text, &added);
+			bytes += atom_entry::footprint(0);
+		}
+	};
+
+	// An interned compound key. Two pooled atoms are equal exactly when they point at the same entry,
+	// keys the pool turned away are compared by text.
+	class atom
+	{
+	public:
+		atom() : entry(empty()) {}
+		explicit atom(std::string_view text)
+		{
+			size_t allocated = 0;
+			entry = atom_pool::instance().intern(text, allocated);
+		}
+		// Adds the bytes the key took, if it wasn't interned already, to allocated.
+		atom(std::string_view text, size_t& allocated) : entry(atom_pool::instance().intern(text, allocated)) {}
+
+		atom(const atom& cvalue) : entry(cvalue.entry)
+		{
+			retain();
+		}
+
+		atom(atom&& rvalue) noexcept : entry(rvalue.entry)
+		{
+			rvalue.entry = empty();
+		}
+
+		~atom()
+		{
+			release();
+		}
+
+		atom& operator=(const atom& cvalue)
+		{
+			if (entry != cvalue.entry)
+			{
+				cvalue.retain();
+				release();
+				entry = cvalue.entry;
+			}
+			return *this;
+		}
+
+		atom& operator=(atom&& rvalue) noexcept
+		{
+			std::swap(entry, rvalue.entry);
+			return *this;
+		}
+
+		// Gets the atom for text without adding it to the pool.
+		[[nodiscard]] static std::optional<atom> lookup(std::string_view text)
+		{
+			const atom_entry* found = atom_pool::instance().find(text);
+			if (found == nullptr)
+				return std::nullopt;
+			return atom(found);
+		}
+
+		[[nodiscard]] inline const std::string& str() const
+		{
+			return entry->text;
+		}
+
+		[[nodiscard]] inline std::string_view view() const
+		{
+			return entry->text;
+		}
+
+		[[nodiscard]] inline size_t size() const
+		{
+			return entry->text.size();
+		}
+
+		// Same as hash_key(view()).
+		[[nodiscard]] inline uint64_t hash() const
+		{
+			return entry->hash;
+		}
+
+		// Dense and unique per string, in the order strings were first interned. ATOM_UNPOOLED for keys the pool turned away.
+		[[nodiscard]] inline uint32_t id() const
+		{
+			return entry->id;
+		}
+
+		operator std::string_view() const
+		{
+			return entry->text;
+		}
+
+		friend bool operator==(const atom& lhs, const atom& rhs)
+		{
+			// A key is either always pooled or never, so a pooled atom only ever equals the same entry.
+			if (lhs.entry == rhs.entry)
+				return true;
+			return !lhs.entry->pooled() && !rhs.entry->pooled() && lhs.entry->hash == rhs.entry->hash && lhs.entry->text == rhs.entry->text;
+		}
+
+		friend bool operator==(const atom& lhs, std::string_view rhs)
+		{
+			return lhs.entry->text == rhs;
+		}
+
+		friend bool operator<(const atom& lhs, const atom& rhs)
+		{
+			return lhs.entry->text < rhs.entry->text;
+		}
+
+	private:
+		const atom_entry* entry;
+
+		explicit atom(const atom_entry* entry) : entry(entry) {}
+
+		inline void retain() const
+		{
+			if (!entry->pooled())
+				entry->references.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		inline void release()
+		{
+			if (!entry->pooled() && entry->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete entry;
+		}
+
+		// Always in the pool, see atom_pool.
+		static const atom_entry* empty()
+		{
+			static const atom_entry* entry = atom_pool::instance().find(std::string_view());
+			return entry;
+		}
+	};
+
+}
+
+#endif // NBT_ATOM_HEADER_FILE
@@ -0,0 +1,170 @@
+﻿#ifndef NBT_BYTESWAP_HEADER_FILE
+#define NBT_BYTESWAP_HEADER_FILE
+
+// Bulk conversion between NBT's big-endian arrays and native integers.
+// On x86 the widest shuffle the CPU supports (AVX2, then SSSE3) is picked at
+// runtime, so no special compiler flags are needed. Everything else gets a
+// plain loop the compiler can vectorize on its own.
+
+#include <bit>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define NBT_BYTESWAP_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC lets intrinsics be used anywhere, GCC and Clang need the function to be compiled for the target.
+#if defined(NBT_BYTESWAP_X86) && !defined(_MSC_VER)
+#define NBT_TARGET(name) __attribute__((target(name)))
+#else
+#define NBT_TARGET(name)
+#endif
+
+namespace nbt
+{
+
+	[[nodiscard]] inline uint16_t byteswap(uint16_t value)
+	{
+		return static_cast<uint16_t>(value << 8 | value >> 8);
+	}
+
+	[[nodiscard]] inline uint32_t byteswap(uint32_t value)
+	{
+#ifdef _MSC_VER
+		return _byteswap_ulong(value);
+#else
+		return __builtin_bswap32(value);
+#endif
+	}
+
+	[[nodiscard]] inline uint64_t byteswap(uint64_t value)
+	{
+#ifdef _MSC_VER
+		return _byteswap_uint64(value);
+#else
+		return __builtin_bswap64(value);
+#endif
+	}
+
+#ifdef NBT_BYTESWAP_X86
+	// 0 for neither, 1 for SSSE3, 2 for AVX2.
+	[[nodiscard]] inline int simd_level()
+	{
+		static const int level = []()
+		{
+#ifdef _MSC_VER
+			int info[4];
+			__cpuid(info, 0);
+			int highest = info[0];
+			__cpuid(info, 1);
+			bool ssse3 = (info[2] & (1 << 9)) != 0;
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			bool avx2 = false;
+			// AVX2 also needs the OS to save the upper halves of the registers.
+			if (highest >= 7 && osxsave && avx && (_xgetbv(0) & 6) == 6)
+			{
+				__cpuidex(info, 7, 0);
+				avx2 = (info[1] & (1 << 5)) != 0;
+			}
+#else
+			__builtin_cpu_init();
+			bool ssse3 = __builtin_cpu_supports("ssse3");
+			bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+			return avx2 ? 2 : ssse3 ? 1 : 0;
+		}();
+		return level;
+	}
+
+	// Shuffle mask that reverses every Size byte group of a 16 byte lane.
+	template<size_t Size>
+	[[nodiscard]] inline __m128i byteswap_mask()
+	{
+		alignas(16) uint8_t mask[16];
+		for (size_t i = 0; i < 16; i++)
+			mask[i] = static_cast<uint8_t>(i - i % Size + (Size - 1 - i % Size));
+		return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+	}
+
+	// Both return how many bytes they converted, a multiple of their vector width.
+	NBT_TARGET("ssse3") inline size_t byteswap_ssse3(std::byte* dst, const std::byte* src, size_t bytes, __m128i mask)
+	{
+		size_t i = 0;
+		for (; i + 16 <= bytes; i += 16)
+		{
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+		}
+		return i;
+	}
+
+	NBT_TARGET("avx2") inline size_t byteswap_avx2(std::byte* dst, const std::byte* src, size_t bytes, __m128i mask)
+	{
+		// vpshufb shuffles within each 128 bit lane, so the same mask goes in both.
+		__m256i wide = _mm256_broadcastsi128_si256(mask);
+		size_t i = 0;
+		for (; i + 64 <= bytes; i += 64)
+		{
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			__m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(a, wide));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), _mm256_shuffle_epi8(b, wide));
+		}
+		for (; i + 32 <= bytes; i += 32)
+		{
+			__m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(a, wide));
+		}
+		return i;
+	}
+#endif
+
+	// Copies count elements of Size bytes from src to dst, reversing the bytes of each one.
+	// Reads big-endian arrays into native integers and writes native integers out as big-endian,
+	// the swap being its own inverse. dst and src must not overlap.
+	template<size_t Size>
+	inline void byteswap_copy(void* dst, const void* src, size_t count)
+	{
+		static_assert(Size == 1 || Size == 2 || Size == 4 || Size == 8, "Only 1, 2, 4 and 8 byte elements.");
+		std::byte* out = static_cast<std::byte*>(dst);
+		const std::byte* in = static_cast<const std::byte*>(src);
+		size_t bytes = count * Size;
+		if (bytes == 0)
+			return;
+
+		if constexpr (Size == 1 || std::endian::native == std::endian::big)
+		{
+			std::memcpy(out, in, bytes);
+			return;
+		}
+		else
+		{
+			size_t done = 0;
+#ifdef NBT_BYTESWAP_X86
+			int level = simd_level();
+			if (level == 2)
+				done = byteswap_avx2(out, in, bytes, byteswap_mask<Size>());
+			else if (level == 1)
+				done = byteswap_ssse3(out, in, bytes, byteswap_mask<Size>());
+#endif
+			using U = std::conditional_t<Size == 2, uint16_t, std::conditional_t<Size == 4, uint32_t, uint64_t>>;
+			for (; done < bytes; done += Size)
+			{
+				U value;
+				std::memcpy(&value, in + done, Size);
+				value = byteswap(value);
+				std::memcpy(out + done, &value, Size);
+			}
+		}
+	}
+
+}
+
+#endif // NBT_BYTESWAP_HEADER_FILE
@@ -0,0 +1,438 @@
+﻿#ifndef NBT_COW_HEADER_FILE
+#define NBT_COW_HEADER_FILE
+
+// Copy-on-write NBT trees for keeping many versions of the same data around, such as undo history.
+// Compounds and lists of compounds or lists hold their children through shared pointers, so copying
+// a cow_tree copies one pointer and every version shares whatever it did not change. edit clones just
+// the nodes from the root down to the one being changed; long arrays and other subtrees off that path
+// stay shared.
+//
+//	nbt::cow_tree before(tree);
+//	nbt::cow_tree after = before;
+//	nbt::Tag heights(*after.edit("Heightmaps.OCEAN_FLOOR")->leaf());
+//
+// Copies can be read and edited from different threads, one cow_tree must not be edited from two at once.
+
+#include <memory>
+#include <variant>
+
+#include "nbt.hpp"
+
+namespace nbt
+{
+
+	class cow_node;
+	using cow_ptr = std::shared_ptr<cow_node>;
+
+	class cow_node
+	{
+	public:
+		using entries = std::vector<std::pair<atom, cow_ptr>>;
+
+		struct elements
+		{
+			tag type = tag::NONE;
+			std::vector<cow_ptr> items;
+		};
+
+		// Scalars, strings, arrays and lists of those are leaves and are copied whole when edited.
+		std::variant<t_variant, entries, elements> data;
+
+		cow_node() : data(entries()) {}
+		explicit cow_node(const t_variant& leaf) : data(leaf) {}
+		explicit cow_node(t_variant&& leaf) : data(std::move(leaf)) {}
+		explicit cow_node(entries&& compound) : data(std::move(compound)) {}
+		explicit cow_node(elements&& list) : data(std::move(list)) {}
+
+		[[nodiscard]] inline tag type() const
+		{
+			if (const t_variant* value = std::get_if<t_variant>(&data))
+				return tag(value->index());
+			return std::holds_alternative<entries>(data) ? tag::COMPOUND : tag::LIST;
+		}
+
+		[[nodiscard]] inline const t_variant* leaf() const
+		{
+			return std::get_if<t_variant>(&data);
+		}
+
+		[[nodiscard]] inline t_variant* leaf()
+		{
+			return std::get_if<t_variant>(&data);
+		}
+
+		[[nodiscard]] inline const entries* compound() const
+		{
+			return std::get_if<entries>(&data);
+		}
+
+		[[nodiscard]] inline const elements* list() const
+		{
+			return std::get_if<elements>(&data);
+		}
+
+		// Entry count of a compound or element count of a list of compounds or lists, 0 for leaves.
+		[[nodiscard]] inline size_t size() const
+		{
+			if (const entries* compound = std::get_if<entries>(&data))
+				return compound->size();
+			if (const elements* list = std::get_if<elements>(&data))
+				return list->items.size();
+			return 0;
+		}
+
+		// Returns nullptr if this isn't a compound or has no such key.
+		[[nodiscard]] const cow_node* find(std::string_view key) const
+		{
+			const entries* compound = std::get_if<entries>(&data);
+			if (compound == nullptr)
+				return nullptr;
+			for (auto& entry : *compound)
+			{
+				if (entry.first == key)
+					return entry.second.get();
+			}
+			return nullptr;
+		}
+
+		// Returns nullptr if this isn't a list of compounds or lists, or index is out of range.
+		[[nodiscard]] const cow_node* at(size_t index) const
+		{
+			const elements* list = std::get_if<elements>(&data);
+			if (list == nullptr || index >= list->items.size())
+				return nullptr;
+			return list->items[index].get();
+		}
+	};
+
+	[[nodiscard]] cow_ptr make_cow(const t_compound& value);
+	[[nodiscard]] cow_ptr make_cow(const t_list& value);
+
+	[[nodiscard]] inline cow_ptr make_cow(const t_variant& value)
+	{
+		if (const t_compound* compound = std::get_if<t_compound>(&value))
+			return make_cow(*compound);
+		if (const t_list* list = std::get_if<t_list>(&value))
+			return make_cow(*list);
+		return std::make_shared<cow_node>(value);
+	}
+
+	[[nodiscard]] inline cow_ptr make_cow(const t_compound& value)
+	{
+		cow_node::entries result;
+		result.reserve(value.size());
+		for (auto& entry : value)
+			result.emplace_back(entry.first, make_cow(entry.second));
+		return std::make_shared<cow_node>(std::move(result));
+	}
+
+	[[nodiscard]] inline cow_ptr make_cow(const t_list& value)
+	{
+		cow_node::elements result;
+		result.type = value.type();
+		if (const auto* compounds = std::get_if<std::vector<t_compound>>(&value.data))
+		{
+			result.items.reserve(compounds->size());
+			for (auto& item : *compounds)
+				result.items.push_back(make_cow(item));
+		}
+		else if (const auto* lists = std::get_if<std::vector<t_list>>(&value.data))
+		{
+			result.items.reserve(lists->size());
+			for (auto& item : *lists)
+				result.items.push_back(make_cow(item));
+		}
+		else
+		{
+			return std::make_shared<cow_node>(t_variant(value));
+		}
+		return std::make_shared<cow_node>(std::move(result));
+	}
+
+	// Builds an ordinary deep tree out of a node.
+	[[nodiscard]] inline t_variant to_variant(const cow_node& node)
+	{
+		if (const t_variant* value = node.leaf())
+			return *value;
+		if (const cow_node::entries* compound = node.compound())
+		{
+			t_compound result;
+			result.data.reserve(compound->size());
+			for (auto& entry : *compound)
+				result.data.emplace_back(entry.first, to_variant(*entry.second));
+			result.reindex();
+			return result;
+		}
+		const cow_node::elements& list = *node.list();
+		t_list result;
+		if (list.type == tag::COMPOUND)
+		{
+			std::vector<t_compound> items;
+			items.reserve(list.items.size());
+			for (auto& item : list.items)
+				items.push_back(std::get<t_compound>(to_variant(*item)));
+			result.data = std::move(items);
+		}
+		else
+		{
+			std::vector<t_list> items;
+			items.reserve(list.items.size());
+			for (auto& item : list.items)
+				items.push_back(std::get<t_list>(to_variant(*item)));
+			result.data = std::move(items);
+		}
+		return result;
+	}
+
+	// Subtrees both sides share compare equal without being looked at.
+	[[nodiscard]] inline bool equal(const cow_node& lhs, const cow_node& rhs)
+	{
+		if (&lhs == &rhs)
+			return true;
+		if (lhs.data.index() != rhs.data.index())
+			return false;
+		if (const t_variant* value = lhs.leaf())
+			return *value == *rhs.leaf();
+		if (const cow_node::entries* compound = lhs.compound())
+		{
+			const cow_node::entries& other = *rhs.compound();
+			if (compound->size() != other.size())
+				return false;
+			for (size_t i = 0; i < compound->size(); i++)
+			{
+				if ((*compound)[i].first != other[i].first || !equal(*(*compound)[i].second, *other[i].second))
+					return false;
+			}
+			return true;
+		}
+		const cow_node::elements& list = *lhs.list();
+		const cow_node::elements& other = *rhs.list();
+		if (list.type != other.type || list.items.size() != other.items.size())
+			return false;
+		for (size_t i = 0; i < list.items.size(); i++)
+		{
+			if (!equal(*list.items[i], *other.items[i]))
+				return false;
+		}
+		return true;
+	}
+
+	class cow_tree
+	{
+	public:
+		std::string name;
+
+		cow_tree() : root_node(std::make_shared<cow_node>()) {}
+		explicit cow_tree(const NBTree& tree) : name(tree.name), root_node(make_cow(tree.root)) {}
+
+		cow_tree(const cow_tree& rhs) = default;
+		cow_tree(cow_tree&& rhs) = default;
+
+		cow_tree& operator=(const cow_tree& rhs) = default;
+		cow_tree& operator=(cow_tree&& rhs) = default;
+
+		bool operator==(const cow_tree& rhs) const
+		{
+			return name == rhs.name && equal(*root_node, *rhs.root_node);
+		}
+
+		[[nodiscard]] inline const cow_node& root() const
+		{
+			return *root_node;
+		}
+
+		// True if both trees are the same version, without comparing any content.
+		[[nodiscard]] inline bool same(const cow_tree& rhs) const
+		{
+			return root_node == rhs.root_node;
+		}
+
+		[[nodiscard]] NBTree to_tree() const
+		{
+			return NBTree(to_variant(*root_node), name);
+		}
+
+		// Same path syntax as find_path: "sections.3.block_states". Returns nullptr if the path doesn't exist.
+		[[nodiscard]] const cow_node* find(std::string_view path) const
+		{
+			const cow_node* node = root_node.get();
+			while (node != nullptr && !path.empty())
+				node = step(*node, next_component(path));
+			return node;
+		}
+
+		// Gets the node at path for changing it, first cloning every node on the way that another version still shares.
+		// Returns nullptr, and clones nothing, if the path doesn't exist.
+		[[nodiscard]] cow_node* edit(std::string_view path)
+		{
+			if (find(path) == nullptr)
+				return nullptr;
+			cow_ptr* slot = &root_node;
+			unshare(*slot);
+			while (!path.empty())
+			{
+				slot = child_slot(**slot, next_component(path));
+				unshare(*slot);
+			}
+			return slot->get();
+		}
+
+		// Sets the compound key or list element named by the last component of path.
+		// Returns false if the parent doesn't exist, or the element index is out of range.
+		bool set(std::string_view path, const t_variant& value)
+		{
+			auto [parent_path, last] = split_last(path);
+			cow_node* parent = edit(parent_path);
+			if (parent == nullptr)
+				return false;
+			if (auto* compound = std::get_if<cow_node::entries>(&parent->data))
+			{
+				for (auto& entry : *compound)
+				{
+					if (entry.first == last)
+					{
+						entry.second = make_cow(value);
+						return true;
+					}
+				}
+				compound->emplace_back(atom(last), make_cow(value));
+				return true;
+			}
+			cow_ptr* slot = child_slot(*parent, last);
+			if (slot == nullptr)
+				return false;
+			*slot = make_cow(value);
+			return true;
+		}
+
+		// Removes the compound key or list element named by the last component of path.
+		bool remove(std::string_view path)
+		{
+			auto [parent_path, last] = split_last(path);
+			if (find(path) == nullptr || path.empty())
+				return false;
+			cow_node* parent = edit(parent_path);
+			if (auto* compound = std::get_if<cow_node::entries>(&parent->data))
+			{
+				compound->erase(std::find_if(compound->begin(), compound->end(), [last](const auto& entry) { return entry.first == last; }));
+				return true;
+			}
+			auto& items = std::get<cow_node::elements>(parent->data).items;
+			items.erase(items.begin() + (child_slot(*parent, last) - items.data()));
+			return true;
+		}
+
+	private:
+		cow_ptr root_node;
+
+		static std::string_view next_component(std::string_view& path)
+		{
+			size_t dot = path.find('.');
+			std::string_view component = path.substr(0, dot);
+			path = dot == std::string_view::npos ? std::string_view() : path.substr(dot + 1);
+			return component;
+		}
+
+		static std::pair<std::string_view, std::string_view> split_last(std::string_view path)
+		{
+			size_t dot = path.rfind('.');
+			if (dot == std::string_view::npos)
+				return { std::string_view(), path };
+			return { path.substr(0, dot), path.substr(dot + 1) };
+		}
+
+		static bool parse_index(std::string_view component, size_t& index)
+		{
+			auto [end, error] = std::from_chars(component.data(), component.data() + component.size(), index);
+			return error == std::errc() && end == component.data() + component.size();
+		}
+
+		static const cow_node* step(const cow_node& node, std::string_view component)
+		{
+			if (node.compound() != nullptr)
+				return node.find(component);
+			size_t index = 0;
+			if (!parse_index(component, index))
+				return nullptr;
+			return node.at(index);
+		}
+
+		static cow_ptr* child_slot(cow_node& node, std::string_view component)
+		{
+			if (auto* compound = std::get_if<cow_node::entries>(&node.data))
+			{
+				for (auto& entry : *compound)
+				{
+					if (entry.first == component)
+						return &entry.second;
+				}
+				return nullptr;
+			}
+			auto* list = std::get_if<cow_node::elements>(&node.data);
+			size_t index = 0;
+			if (list == nullptr || !parse_index(component, index) || index >= list->items.size())
+				return nullptr;
+			return &list->items[index];
+		}
+
+		// A node nobody else points at can be changed in place.
+		static void unshare(cow_ptr& node)
+		{
+			if (node.use_count() > 1)
+				node = std::make_shared<cow_node>(*node);
+		}
+	};
+
+	[[nodiscard]] inline size_t encoded_size(const cow_node& node)
+	{
+		if (const t_variant* value = node.leaf())
+			return encoded_size(*value);
+		if (const cow_node::entries* compound = node.compound())
+		{
+			size_t total = 1;
+			for (auto& entry : *compound)
+				total += 1 + encoded_size(entry.first.str()) + encoded_size(*entry.second);
+			return total;
+		}
+		size_t total = 5;
+		for (auto& item : node.list()->items)
+			total += encoded_size(*item);
+		return total;
+	}
+
+	inline void write_tag(const cow_node& node, nbtspan& out)
+	{
+		if (const t_variant* value = node.leaf())
+			return write_tag(*value, out);
+		if (const cow_node::entries* compound = node.compound())
+		{
+			for (auto& entry : *compound)
+			{
+				out.write(entry.second->type());
+				out.write(entry.first);
+				write_tag(*entry.second, out);
+			}
+			out.write(tag::NONE);
+			return;
+		}
+		const cow_node::elements& list = *node.list();
+		out.write(list.type);
+		out.write(static_cast<int>(list.items.size()));
+		for (auto& item : list.items)
+			write_tag(*item, out);
+	}
+
+	inline void dump(const cow_tree& tree, nbtout& out)
+	{
+		size_t offset = out.buffer.size();
+		size_t size = 1 + encoded_size(tree.name) + encoded_size(tree.root());
+		out.buffer.resize(offset + size);
+		nbtspan span(out.buffer.data() + offset, size);
+		span.write(tree.root().type());
+		span.write(tree.name);
+		write_tag(tree.root(), span);
+	}
+
+}
+
+#endif // NBT_COW_HEADER_FILE
@@ -0,0 +1,459 @@
+﻿#ifndef NBT_DIALECT_HEADER_FILE
+#define NBT_DIALECT_HEADER_FILE
+
+// The same tags encoded three ways. Java edition files are big-endian, which is what nbtin and
+// nbtout read and write. Bedrock stores little-endian NBT in LevelDB and level.dat, and its network
+// protocol packs ints, longs and lengths as varints on top of that.
+//
+//	nbt::NBTree tree = nbt::load<nbt::dialect::bedrock>(in);
+//	nbt::dump<nbt::dialect::network>(tree, out);
+//
+// The dialect is a template parameter, so each one compiles to its own reader and writer
+// with no per value checks of which encoding is in use.
+
+#include <bit>
+
+#include "nbt.hpp"
+
+namespace nbt
+{
+
+	namespace dialect
+	{
+		struct java
+		{
+			static constexpr std::endian order = std::endian::big;
+			static constexpr bool varints = false;
+		};
+
+		struct bedrock
+		{
+			static constexpr std::endian order = std::endian::little;
+			static constexpr bool varints = false;
+		};
+
+		// Ints, longs and array and list lengths are zigzag varints, string lengths plain varints.
+		struct network
+		{
+			static constexpr std::endian order = std::endian::little;
+			static constexpr bool varints = true;
+		};
+	}
+
+	template<typename Dialect>
+	struct codec
+	{
+		template<typename T>
+		[[nodiscard]] static T read_fixed(nbtin& in)
+		{
+			if (!in.ensure(sizeof(T)))
+				throw std::runtime_error("Reached end of buffer.");
+			T value;
+			copy_in<sizeof(T)>(&value, in.scan, 1);
+			in.advance(sizeof(T));
+			return value;
+		}
+
+		// Copies count elements of Size bytes from the dialect's byte order into native order, or back.
+		template<size_t Size>
+		static void copy_in(void* dst, const void* src, size_t count)
+		{
+			if constexpr (Dialect::order == std::endian::native)
+			{
+				if (count != 0)
+					std::memcpy(dst, src, count * Size);
+			}
+			else
+			{
+				byteswap_copy<Size>(dst, src, count);
+			}
+		}
+
+		[[nodiscard]] static uint64_t read_varuint(nbtin& in)
+		{
+			uint64_t value = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				uint8_t byte = in.read_u8();
+				value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0)
+					return value;
+			}
+			throw std::runtime_error("Invalid varint.");
+		}
+
+		[[nodiscard]] static t_int read_int(nbtin& in)
+		{
+			if constexpr (Dialect::varints)
+			{
+				uint32_t raw = static_cast<uint32_t>(read_varuint(in));
+				return static_cast<t_int>((raw >> 1) ^ (0u - (raw & 1)));
+			}
+			else
+			{
+				return read_fixed<t_int>(in);
+			}
+		}
+
+		[[nodiscard]] static t_long read_long(nbtin& in)
+		{
+			if constexpr (Dialect::varints)
+			{
+				uint64_t raw = read_varuint(in);
+				return static_cast<t_long>((raw >> 1) ^ (0ull - (raw & 1)));
+			}
+			else
+			{
+				return read_fixed<t_long>(in);
+			}
+		}
+
+		// Makes sure at least length elements of element_size bytes are left, varints take one byte at least.
+		[[nodiscard]] static size_t read_length(nbtin& in, size_t element_size)
+		{
+			t_int length = read_int(in);
+			if (length < 0 || !in.ensure(static_cast<size_t>(length) * element_size))
+				throw std::runtime_error("Reached end of buffer.");
+			return static_cast<size_t>(length);
+		}
+
+		[[nodiscard]] static std::string_view read_str_view(nbtin& in)
+		{
+			size_t length;
+			if constexpr (Dialect::varints)
+				length = static_cast<size_t>(read_varuint(in));
+			else
+				length = read_fixed<uint16_t>(in);
+			if (!in.ensure(length))
+				throw std::runtime_error("Reached end of buffer.");
+			std::string_view result(reinterpret_cast<const char*>(in.scan), length);
+			in.advance(length);
+			return result;
+		}
+
+		template<typename T>
+		static void write_fixed(nbtout& out, T value)
+		{
+			write_fixed(out, &value, 1);
+		}
+
+		// Writes a run of fixed size values with one resize for all of them.
+		template<typename T>
+		static void write_fixed(nbtout& out, const T* values, size_t count)
+		{
+			size_t offset = out.buffer.size();
+			out.buffer.resize(offset + count * sizeof(T));
+			copy_in<sizeof(T)>(out.buffer.data() + offset, values, count);
+		}
+
+		// Writes a run of ints or longs as zigzag varints, sized for the longest encoding up front and trimmed after.
+		template<typename T>
+		static void write_varints(nbtout& out, const T* values, size_t count)
+		{
+			using U = std::make_unsigned_t<T>;
+			constexpr size_t longest = (sizeof(T) * 8 + 6) / 7;
+			size_t offset = out.buffer.size();
+			out.buffer.resize(offset + count * longest);
+			std::byte* p = out.buffer.data() + offset;
+			for (size_t i = 0; i < count; i++)
+			{
+				U raw = static_cast<U>(static_cast<U>(values[i]) << 1) ^ static_cast<U>(values[i] >> (sizeof(T) * 8 - 1));
+				while (raw >= 0x80)
+				{
+					*p++ = static_cast<std::byte>(raw | 0x80);
+					raw >>= 7;
+				}
+				*p++ = static_cast<std::byte>(raw);
+			}
+			out.buffer.resize(static_cast<size_t>(p - out.buffer.data()));
+		}
+
+		static void write_varuint(nbtout& out, uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				out.write(static_cast<uint8_t>(value | 0x80));
+				value >>= 7;
+			}
+			out.write(static_cast<uint8_t>(value));
+		}
+
+		static void write_int(nbtout& out, t_int value)
+		{
+			if constexpr (Dialect::varints)
+				write_varuint(out, (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31));
+			else
+				write_fixed(out, value);
+		}
+
+		static void write_long(nbtout& out, t_long value)
+		{
+			if constexpr (Dialect::varints)
+				write_varuint(out, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+			else
+				write_fixed(out, value);
+		}
+
+		static void write_str(nbtout& out, std::string_view value)
+		{
+			if constexpr (Dialect::varints)
+			{
+				write_varuint(out, value.size());
+			}
+			else
+			{
+				value = value.substr(0, 0xFFFF);
+				write_fixed(out, static_cast<uint16_t>(value.size()));
+			}
+			out.buffer.insert(out.buffer.end(),
+				reinterpret_cast<const std::byte*>(value.data()),
+				reinterpret_cast<const std::byte*>(value.data() + value.size()));
+		}
+	};
+
+	template<typename Dialect>
+	t_variant read_tag(nbtin& in, tag type);
+
+	template<typename Dialect>
+	t_compound read_compound(nbtin& in)
+	{
+		using C = codec<Dialect>;
+		in.enter();
+		t_compound result;
+		tag type = in.read_type();
+		while (type != tag::NONE)
+		{
+			size_t allocated = 0;
+			atom key(C::read_str_view(in), allocated);
+			in.charge(allocated);
+			reserve_entry(in, result.data);
+			result.data.emplace_back(std::move(key), read_tag<Dialect>(in, type));
+			type = in.read_type();
+		}
+		in.leave();
+		result.reindex();
+		return result;
+	}
+
+	template<typename Dialect, typename T>
+	std::vector<T> read_array(nbtin& in)
+	{
+		using C = codec<Dialect>;
+		std::vector<T> result;
+		if constexpr (Dialect::varints && sizeof(T) > 1)
+		{
+			size_t length = C::read_length(in, 1);
+			in.charge(length * sizeof(T));
+			result.resize(length);
+			for (T& value : result)
+			{
+				if constexpr (sizeof(T) == 4)
+					value = C::read_int(in);
+				else
+					value = C::read_long(in);
+			}
+		}
+		else
+		{
+			size_t length = C::read_length(in, sizeof(T));
+			in.charge(length * sizeof(T));
+			result.resize(length);
+			C::template copy_in<sizeof(T)>(result.data(), in.scan, result.size());
+			in.advance(result.size() * sizeof(T));
+		}
+		return result;
+	}
+
+	template<typename Dialect>
+	t_list read_list(nbtin& in)
+	{
+		using C = codec<Dialect>;
+		tag element = in.read_type();
+		if (element > tag::LONGARRAY)
+			throw std::runtime_error("Invalid tag type.");
+		size_t length = C::read_length(in, std::max<size_t>(Dialect::varints ? 1 : TagSize(element), 1));
+		if (length == 0 || element == tag::NONE)
+			return t_list(tag::NONE);
+
+		t_list result(element);
+		std::visit([&](auto& items)
+		{
+			using V = std::decay_t<decltype(items)>;
+			if constexpr (!std::is_same<V, std::nullptr_t>::value)
+			{
+				using T = typename V::value_type;
+				in.charge(length * sizeof(T));
+				// Fixed size numbers are converted in one pass, like read_numeric_list.
+				if constexpr (std::is_arithmetic<T>::value && !(Dialect::varints && std::is_integral<T>::value && sizeof(T) >= 4))
+				{
+					if (!in.ensure(length * sizeof(T)))
+						throw std::runtime_error("Reached end of buffer.");
+					items.resize(length);
+					C::template copy_in<sizeof(T)>(items.data(), in.scan, length);
+					in.advance(length * sizeof(T));
+				}
+				else
+				{
+					in.enter();
+					items.reserve(length);
+					for (size_t i = 0; i < length; i++)
+						items.push_back(std::get<T>(read_tag<Dialect>(in, element)));
+					in.leave();
+				}
+			}
+		}, result.data);
+		return result;
+	}
+
+	template<typename Dialect>
+	t_variant read_tag(nbtin& in, tag type)
+	{
+		using C = codec<Dialect>;
+		switch (type)
+		{
+		case tag::BYTE:
+			return in.read_i8();
+		case tag::SHORT:
+			return C::template read_fixed<t_short>(in);
+		case tag::INT:
+			return C::read_int(in);
+		case tag::LONG:
+			return C::read_long(in);
+		case tag::FLOAT:
+			return C::template read_fixed<t_float>(in);
+		case tag::DOUBLE:
+			return C::template read_fixed<t_double>(in);
+		case tag::BYTEARRAY:
+			return read_array<Dialect, std::byte>(in);
+		case tag::STRING:
+		{
+			std::string_view value = C::read_str_view(in);
+			in.charge(value.size());
+			return t_string(value);
+		}
+		case tag::LIST:
+			return read_list<Dialect>(in);
+		case tag::COMPOUND:
+			return read_compound<Dialect>(in);
+		case tag::INTARRAY:
+			return read_array<Dialect, int32_t>(in);
+		case tag::LONGARRAY:
+			return read_array<Dialect, int64_t>(in);
+		default:
+			throw std::runtime_error("Invalid tag type.");
+		}
+	}
+
+	// Every dialect, java included, goes through the same reader, so they can't drift apart.
+	template<typename Dialect>
+	[[nodiscard]] NBTree load(nbtin& in)
+	{
+		tag type = in.read_type();
+		std::string name(codec<Dialect>::read_str_view(in));
+		return NBTree(read_tag<Dialect>(in, type), name);
+	}
+
+	template<typename Dialect, typename T>
+	void write_payload(const T& value, nbtout& out);
+
+	template<typename Dialect, typename T>
+	void write_array(const std::vector<T>& values, nbtout& out)
+	{
+		using C = codec<Dialect>;
+		C::write_int(out, static_cast<t_int>(values.size()));
+		if constexpr (Dialect::varints && sizeof(T) > 1)
+			C::write_varints(out, values.data(), values.size());
+		else
+			C::write_fixed(out, values.data(), values.size());
+	}
+
+	template<typename Dialect>
+	void write_list(const t_list& list, nbtout& out)
+	{
+		using C = codec<Dialect>;
+		out.write(list.type());
+		C::write_int(out, static_cast<t_int>(list.size()));
+		std::visit([&](const auto& items)
+		{
+			using V = std::decay_t<decltype(items)>;
+			if constexpr (!std::is_same<V, std::nullptr_t>::value)
+			{
+				using T = typename V::value_type;
+				// Numbers are converted in one pass like read_list reads them, everything else is written where it is.
+				if constexpr (Dialect::varints && std::is_integral<T>::value && sizeof(T) >= 4)
+					C::write_varints(out, items.data(), items.size());
+				else if constexpr (std::is_arithmetic<T>::value)
+					C::write_fixed(out, items.data(), items.size());
+				else
+					for (const T& item : items)
+						write_payload<Dialect>(item, out);
+			}
+		}, list.data);
+	}
+
+	template<typename Dialect>
+	void write_compound(const t_compound& compound, nbtout& out)
+	{
+		using C = codec<Dialect>;
+		for (auto& entry : compound)
+		{
+			out.write(tag(entry.second.index()));
+			C::write_str(out, entry.first);
+			std::visit([&](const auto& payload)
+			{
+				write_payload<Dialect>(payload, out);
+			}, entry.second);
+		}
+		out.write(tag::NONE);
+	}
+
+	// Writes a payload whose type is known, so list elements don't have to be wrapped in a t_variant first.
+	template<typename Dialect, typename T>
+	void write_payload(const T& value, nbtout& out)
+	{
+		using C = codec<Dialect>;
+		if constexpr (std::is_same<T, t_byte>::value)
+			out.write(value);
+		else if constexpr (std::is_same<T, t_int>::value)
+			C::write_int(out, value);
+		else if constexpr (std::is_same<T, t_long>::value)
+			C::write_long(out, value);
+		else if constexpr (std::is_arithmetic<T>::value)
+			C::write_fixed(out, value);
+		else if constexpr (std::is_same<T, t_string>::value)
+			C::write_str(out, value);
+		else if constexpr (std::is_same<T, t_list>::value)
+			write_list<Dialect>(value, out);
+		else if constexpr (std::is_same<T, t_compound>::value)
+			write_compound<Dialect>(value, out);
+		else if constexpr (!std::is_same<T, std::nullptr_t>::value)
+			write_array<Dialect>(value, out);
+	}
+
+	template<typename Dialect>
+	void write_tag(const t_variant& value, nbtout& out)
+	{
+		std::visit([&](const auto& payload)
+		{
+			write_payload<Dialect>(payload, out);
+		}, value);
+	}
+
+	template<typename Dialect>
+	void dump(const NBTree& tree, nbtout& out)
+	{
+		if constexpr (std::is_same<Dialect, dialect::java>::value)
+		{
+			dump(tree, out);
+		}
+		else
+		{
+			out.write(tag(tree.root.index()));
+			codec<Dialect>::write_str(out, tree.name);
+			write_tag<Dialect>(tree.root, out);
+		}
+	}
+
+}
+
+#endif // NBT_DIALECT_HEADER_FILE
@@ -0,0 +1,458 @@
+﻿#ifndef NBT_HASH_HEADER_FILE
+#define NBT_HASH_HEADER_FILE
+
+// Stable 128-bit content hashes of trees, for spotting identical chunks, structures and block entities
+// without comparing them element by element.
+//
+//	nbt::hash128 key = nbt::hash(tree);
+//	nbt::hash128 same = nbt::hash(in);	// straight from the serialized bytes, matches hash(load(in))
+//
+// The hash is defined over a little-endian stream of every tag's type and value, so it is the same on
+// every machine and for every in-memory layout. With ignore_key_order, compound entries are hashed on
+// their own and summed, so two compounds holding the same entries in a different order hash the same.
+// Floating point values are hashed by their bits. This is not a cryptographic hash.
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+#include "nbt.hpp"
+
+namespace nbt
+{
+
+	struct hash128
+	{
+		uint64_t low = 0;
+		uint64_t high = 0;
+
+		friend bool operator==(const hash128& lhs, const hash128& rhs) = default;
+
+		hash128& operator+=(const hash128& rhs)
+		{
+			uint64_t sum = low + rhs.low;
+			high += rhs.high + (sum < low ? 1 : 0);
+			low = sum;
+			return *this;
+		}
+	};
+
+	// Multiplies two 64-bit values and folds the 128-bit product back into 64 bits.
+	[[nodiscard]] inline uint64_t hash_mix(uint64_t a, uint64_t b)
+	{
+#ifdef _MSC_VER
+		uint64_t high;
+		uint64_t low = _umul128(a, b, &high);
+		return low ^ high;
+#else
+		__uint128_t product = static_cast<__uint128_t>(a) * b;
+		return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#endif
+	}
+
+	class hasher
+	{
+	public:
+		hasher(uint64_t seed = 0) : lanes{ seed ^ 0x243F6A8885A308D3ull, seed ^ 0x13198A2E03707344ull } {}
+
+		void update(const void* data, size_t size)
+		{
+			const std::byte* bytes = static_cast<const std::byte*>(data);
+			total += size;
+			// Tag types, lengths and scalars mostly fit in what's left of the pending block.
+			if (used + size < sizeof(pending))
+			{
+				// Empty arrays can come with a null pointer.
+				if (size != 0)
+					std::memcpy(pending + used, bytes, size);
+				used += size;
+				return;
+			}
+			if (used != 0)
+			{
+				size_t take = std::min(size, sizeof(pending) - used);
+				std::memcpy(pending + used, bytes, take);
+				used += take;
+				bytes += take;
+				size -= take;
+				if (used < sizeof(pending))
+					return;
+				block(pending);
+				used = 0;
+			}
+			for (; size >= sizeof(pending); bytes += sizeof(pending), size -= sizeof(pending))
+				block(bytes);
+			if (size != 0)
+			{
+				std::memcpy(pending, bytes, size);
+				used = size;
+			}
+		}
+
+		// Adds the value as sizeof(T) little-endian bytes.
+		template<typename T>
+		void update_value(T value)
+		{
+			static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Must be a number.");
+			if (std::endian::native == std::endian::little && used + sizeof(T) < sizeof(pending))
+			{
+				// A fixed size copy the compiler inlines, rather than a call to memcpy.
+				std::memcpy(pending + used, &value, sizeof(T));
+				used += sizeof(T);
+				total += sizeof(T);
+				return;
+			}
+			update_elements(&value, 1);
+		}
+
+		template<typename T>
+		void update_elements(const T* values, size_t count)
+		{
+			if constexpr (sizeof(T) == 1 || std::endian::native == std::endian::little)
+			{
+				update(values, count * sizeof(T));
+			}
+			else
+			{
+				for (size_t i = 0; i < count; i++)
+				{
+					std::byte bytes[sizeof(T)];
+					byteswap_copy<sizeof(T)>(bytes, values + i, 1);
+					update(bytes, sizeof(T));
+				}
+			}
+		}
+
+		// Adds count elements of Size bytes stored big-endian, as they are in a Java edition buffer.
+		template<size_t Size>
+		void update_big_endian(const std::byte* data, size_t count)
+		{
+			using U = std::conditional_t<Size == 1, uint8_t, std::conditional_t<Size == 2, uint16_t, std::conditional_t<Size == 4, uint32_t, uint64_t>>>;
+			U values[512];
+			while (count != 0)
+			{
+				size_t step = std::min<size_t>(count, std::size(values));
+				byteswap_copy<Size>(values, data, step);
+				update_elements(values, step);
+				data += step * Size;
+				count -= step;
+			}
+		}
+
+		void update_str(std::string_view value)
+		{
+			update_value(static_cast<uint32_t>(value.size()));
+			update(value.data(), value.size());
+		}
+
+		[[nodiscard]] hash128 digest() const
+		{
+			uint64_t a = lanes[0];
+			uint64_t b = lanes[1];
+			if (used != 0)
+			{
+				std::byte last[sizeof(pending)]{};
+				std::memcpy(last, pending, used);
+				fold(a, b, load(last), load(last + 8));
+			}
+			a = hash_mix(a ^ total, 0x452821E638D01377ull);
+			b = hash_mix(b ^ total, 0xBE5466CF34E90C6Cull);
+			return hash128{ hash_mix(a, b ^ 0xC0AC29B7C97C50DDull), hash_mix(b, a ^ 0x3F84D5B5B5470917ull) };
+		}
+
+	private:
+		uint64_t lanes[2];
+		uint64_t total = 0;
+		std::byte pending[16];
+		size_t used = 0;
+
+		[[nodiscard]] static uint64_t load(const std::byte* data)
+		{
+			uint64_t value;
+			std::memcpy(&value, data, sizeof(value));
+			if constexpr (std::endian::native == std::endian::big)
+				value = byteswap(value);
+			return value;
+		}
+
+		// The product is 0 when a word equals its constant, so the lane it came from is added back in
+		// rather than replaced, and rotated first so that blocks still can't trade places.
+		static void fold(uint64_t& a, uint64_t& b, uint64_t w0, uint64_t w1)
+		{
+			uint64_t mixed0 = hash_mix(w0 ^ 0xA4093822299F31D0ull, w1 ^ a);
+			uint64_t mixed1 = hash_mix(w1 ^ 0x082EFA98EC4E6C89ull, w0 ^ b);
+			a = std::rotl(a, 29) + mixed0;
+			b = std::rotl(b, 29) + mixed1;
+		}
+
+		void block(const std::byte* data)
+		{
+			fold(lanes[0], lanes[1], load(data), load(data + 8));
+		}
+	};
+
+	void hash_payload(hasher& h, const t_variant& value, bool ignore_key_order);
+
+	inline void hash_payload(hasher& h, const t_list& value, bool ignore_key_order)
+	{
+		// Empty lists are read back as lists of NONE, so they all hash the same whatever their type.
+		if (value.size() == 0)
+		{
+			h.update_value(tag::NONE);
+			h.update_value(uint32_t(0));
+			return;
+		}
+		h.update_value(value.type());
+		h.update_value(static_cast<uint32_t>(value.size()));
+		std::visit([&](const auto& items)
+		{
+			using V = std::decay_t<decltype(items)>;
+			if constexpr (!std::is_same<V, std::nullptr_t>::value)
+			{
+				using T = typename V::value_type;
+				if constexpr (std::is_arithmetic<T>::value)
+				{
+					h.update_elements(items.data(), items.size());
+				}
+				else
+				{
+					for (const T& item : items)
+					{
+						if constexpr (std::is_same<T, t_string>::value)
+						{
+							h.update_str(item);
+						}
+						else if constexpr (std::is_same<T, t_list>::value || std::is_same<T, t_compound>::value)
+						{
+							hash_payload(h, item, ignore_key_order);
+						}
+						else
+						{
+							h.update_value(static_cast<uint32_t>(item.size()));
+							h.update_elements(item.data(), item.size());
+						}
+					}
+				}
+			}
+		}, value.data);
+	}
+
+	inline void hash_payload(hasher& h, const t_compound& value, bool ignore_key_order)
+	{
+		if (ignore_key_order)
+		{
+			hash128 sum;
+			for (const auto& entry : value)
+			{
+				hasher item;
+				item.update_value(tag(entry.second.index()));
+				item.update_str(entry.first);
+				hash_payload(item, entry.second, true);
+				sum += item.digest();
+			}
+			h.update_value(static_cast<uint32_t>(value.size()));
+			h.update_value(sum.low);
+			h.update_value(sum.high);
+			return;
+		}
+		for (const auto& entry : value)
+		{
+			h.update_value(tag(entry.second.index()));
+			h.update_str(entry.first);
+			hash_payload(h, entry.second, false);
+		}
+		h.update_value(tag::NONE);
+	}
+
+	inline void hash_payload(hasher& h, const t_variant& value, bool ignore_key_order)
+	{
+		std::visit([&](const auto& item)
+		{
+			using T = std::decay_t<decltype(item)>;
+			if constexpr (std::is_same<T, std::nullptr_t>::value)
+			{
+			}
+			else if constexpr (std::is_arithmetic<T>::value)
+			{
+				h.update_value(item);
+			}
+			else if constexpr (std::is_same<T, t_string>::value)
+			{
+				h.update_str(item);
+			}
+			else if constexpr (std::is_same<T, t_list>::value || std::is_same<T, t_compound>::value)
+			{
+				hash_payload(h, item, ignore_key_order);
+			}
+			else
+			{
+				h.update_value(static_cast<uint32_t>(item.size()));
+				h.update_elements(item.data(), item.size());
+			}
+		}, value);
+	}
+
+	// Hashes a serialized payload of the given type the same way as the tree it would load into.
+	inline void hash_payload(hasher& h, nbtin& in, tag type, bool ignore_key_order)
+	{
+		auto big_endian = [&]<size_t Size>(size_t count)
+		{
+			if (!in.ensure(count * Size))
+				throw std::runtime_error("Reached end of buffer.");
+			h.update_big_endian<Size>(in.scan, count);
+			in.advance(count * Size);
+		};
+		auto length = [&]()
+		{
+			int32_t count = in.read_i32();
+			if (count < 0)
+				throw std::runtime_error("Reached end of buffer.");
+			h.update_value(static_cast<uint32_t>(count));
+			return static_cast<size_t>(count);
+		};
+
+		switch (type)
+		{
+		case tag::BYTE:
+			h.update_value(in.read_i8());
+			break;
+		case tag::SHORT:
+			h.update_value(in.read_i16());
+			break;
+		case tag::INT:
+		case tag::FLOAT:
+			big_endian.operator()<4>(1);
+			break;
+		case tag::LONG:
+		case tag::DOUBLE:
+			big_endian.operator()<8>(1);
+			break;
+		case tag::BYTEARRAY:
+			big_endian.operator()<1>(length());
+			break;
+		case tag::STRING:
+			h.update_str(in.read_str_view());
+			break;
+		case tag::LIST:
+		{
+			tag element = in.read_type();
+			int32_t count = in.read_i32();
+			if (count < 0 || element > tag::LONGARRAY)
+				throw std::runtime_error("Invalid list.");
+			if (count == 0 || element == tag::NONE)
+			{
+				h.update_value(tag::NONE);
+				h.update_value(uint32_t(0));
+				break;
+			}
+			h.update_value(element);
+			h.update_value(static_cast<uint32_t>(count));
+			size_t size = TagSize(element);
+			if (size == 1)
+				big_endian.operator()<1>(count);
+			else if (size == 2)
+				big_endian.operator()<2>(count);
+			else if (size == 4)
+				big_endian.operator()<4>(count);
+			else if (size == 8)
+				big_endian.operator()<8>(count);
+			else
+			{
+				in.enter();
+				for (int32_t i = 0; i < count; i++)
+					hash_payload(h, in, element, ignore_key_order);
+				in.leave();
+			}
+			break;
+		}
+		case tag::COMPOUND:
+		{
+			in.enter();
+			hash128 sum;
+			uint32_t count = 0;
+			for (tag child = in.read_type(); child != tag::NONE; child = in.read_type())
+			{
+				if (child > tag::LONGARRAY)
+					throw std::runtime_error("Invalid tag type.");
+				if (ignore_key_order)
+				{
+					hasher item;
+					item.update_value(child);
+					item.update_str(in.read_str_view());
+					hash_payload(item, in, child, true);
+					sum += item.digest();
+					count++;
+				}
+				else
+				{
+					h.update_value(child);
+					h.update_str(in.read_str_view());
+					hash_payload(h, in, child, false);
+				}
+			}
+			if (ignore_key_order)
+			{
+				h.update_value(count);
+				h.update_value(sum.low);
+				h.update_value(sum.high);
+			}
+			else
+			{
+				h.update_value(tag::NONE);
+			}
+			in.leave();
+			break;
+		}
+		case tag::INTARRAY:
+			big_endian.operator()<4>(length());
+			break;
+		case tag::LONGARRAY:
+			big_endian.operator()<8>(length());
+			break;
+		default:
+			throw std::runtime_error("Invalid tag type.");
+		}
+	}
+
+	[[nodiscard]] inline hash128 hash(const t_variant& value, bool ignore_key_order = false)
+	{
+		hasher h;
+		h.update_value(tag(value.index()));
+		hash_payload(h, value, ignore_key_order);
+		return h.digest();
+	}
+
+	// Includes the root name, as the serialized form does.
+	[[nodiscard]] inline hash128 hash(const NBTree& tree, bool ignore_key_order = false)
+	{
+		hasher h;
+		h.update_value(tag(tree.root.index()));
+		h.update_str(tree.name);
+		hash_payload(h, tree.root, ignore_key_order);
+		return h.digest();
+	}
+
+	// Hashes one serialized tree without loading it, leaving in past its end.
+	[[nodiscard]] inline hash128 hash(nbtin& in, bool ignore_key_order = false)
+	{
+		hasher h;
+		tag type = in.read_type();
+		h.update_value(type);
+		h.update_str(in.read_str_view());
+		hash_payload(h, in, type, ignore_key_order);
+		return h.digest();
+	}
+
+}
+
+template<>
+struct std::hash<nbt::hash128>
+{
+	size_t operator()(const nbt::hash128& value) const noexcept
+	{
+		return static_cast<size_t>(value.low);
+	}
+};
+
+#endif // NBT_HASH_HEADER_FILE
@@ -0,0 +1,469 @@
+﻿#ifndef NBT_PATCH_HEADER_FILE
+#define NBT_PATCH_HEADER_FILE
+
+// Structural diffs between two versions of a tree, and a compact binary form for them.
+// diff(a, b) returns the operations that turn a into b, patch applies them:
+//
+//	nbt::tree_patch changes = nbt::diff(before, after);
+//	nbt::write_patch(changes, out);
+//	...
+//	nbt::patch(tree, nbt::read_patch(in));
+//
+// Compounds are diffed key by key, and lists of compounds or lists element by element with
+// elements added or removed in the middle. Byte, int and long arrays are diffed by element range, so changing a few entries of
+// a block state array costs a few bytes rather than the whole array. Everything else that changed
+// is replaced whole. Keys added by a patch go to the end of their compound.
+
+#include <variant>
+#include <vector>
+#include <string>
+
+#include "nbt.hpp"
+
+namespace nbt
+{
+
+	// Compound keys and list indices from the root down to the node an operation applies to.
+	using patch_path = std::vector<std::variant<std::string, size_t>>;
+
+	struct patch_op
+	{
+		enum class kind : uint8_t
+		{
+			// Replaces the node at path, or adds it if its parent is a compound without that key.
+			SET = 1,
+			// Removes the compound key or list element at path.
+			REMOVE = 2,
+			// Replaces removed elements of the array at path, starting at offset, with the elements of value.
+			RANGE = 3,
+			// Inserts value into a list of compounds or lists, before the element at path.
+			INSERT = 4,
+		};
+
+		kind type = kind::SET;
+		patch_path path;
+		t_variant value;
+		size_t offset = 0;
+		size_t removed = 0;
+	};
+
+	struct tree_patch
+	{
+		std::vector<patch_op> ops;
+
+		[[nodiscard]] inline bool empty() const
+		{
+			return ops.empty();
+		}
+	};
+
+	constexpr uint8_t PATCH_VERSION = 1;
+
+	inline void write_varint(nbtout& out, uint64_t value)
+	{
+		while (value >= 0x80)
+		{
+			out.write(static_cast<uint8_t>(value | 0x80));
+			value >>= 7;
+		}
+		out.write(static_cast<uint8_t>(value));
+	}
+
+	[[nodiscard]] inline uint64_t read_varint(nbtin& in)
+	{
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			uint8_t byte = in.read_u8();
+			value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return value;
+		}
+		throw std::runtime_error("Invalid varint.");
+	}
+
+	// Array elements that match between two changed runs are rewritten rather than splitting the run,
+	// when they take fewer bytes than the header of another operation would.
+	constexpr size_t PATCH_RANGE_GAP_BYTES = 16;
+
+	template<typename T>
+	void diff_array(const std::vector<T>& a, const std::vector<T>& b, patch_path& path, tree_patch& out)
+	{
+		size_t prefix = 0;
+		size_t common = std::min(a.size(), b.size());
+		while (prefix < common && a[prefix] == b[prefix])
+			prefix++;
+		if (prefix == a.size() && prefix == b.size())
+			return;
+
+		auto emit = [&](size_t offset, size_t removed, size_t added_begin, size_t added_end)
+		{
+			patch_op& op = out.ops.emplace_back();
+			op.type = patch_op::kind::RANGE;
+			op.path = path;
+			op.offset = offset;
+			op.removed = removed;
+			op.value = std::vector<T>(b.begin() + added_begin, b.begin() + added_end);
+		};
+
+		if (a.size() != b.size())
+		{
+			size_t suffix = 0;
+			while (suffix < common - prefix && a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix])
+				suffix++;
+			emit(prefix, a.size() - prefix - suffix, prefix, b.size() - suffix);
+			return;
+		}
+
+		const size_t gap = std::max<size_t>(PATCH_RANGE_GAP_BYTES / sizeof(T), 1);
+		size_t i = prefix;
+		while (i < a.size())
+		{
+			size_t start = i;
+			size_t end = i + 1;
+			size_t same = 0;
+			for (i = end; i < a.size() && same <= gap; i++)
+			{
+				if (a[i] == b[i])
+				{
+					same++;
+				}
+				else
+				{
+					same = 0;
+					end = i + 1;
+				}
+			}
+			emit(start, end - start, start, end);
+			i = end;
+			while (i < a.size() && a[i] == b[i])
+				i++;
+		}
+	}
+
+	void diff_value(const t_variant& a, const t_variant& b, patch_path& path, tree_patch& out);
+
+	inline void diff_compound(const t_compound& a, const t_compound& b, patch_path& path, tree_patch& out)
+	{
+		for (auto& entry : a)
+		{
+			if (b.find(entry.first) == b.end())
+			{
+				path.emplace_back(entry.first.str());
+				out.ops.push_back(patch_op{ patch_op::kind::REMOVE, path, t_variant() });
+				path.pop_back();
+			}
+		}
+		for (auto& entry : b)
+		{
+			path.emplace_back(entry.first.str());
+			auto found = a.find(entry.first);
+			if (found == a.end())
+				out.ops.push_back(patch_op{ patch_op::kind::SET, path, entry.second });
+			else
+				diff_value(found->second, entry.second, path, out);
+			path.pop_back();
+		}
+	}
+
+	void diff_list(const t_list& a, const t_list& b, patch_path& path, tree_patch& out);
+
+	// Skips the elements both ends have in common, diffs the rest pairwise,
+	// and removes or inserts whatever is left over on one side.
+	template<typename T>
+	void diff_elements(const std::vector<T>& a, const std::vector<T>& b, patch_path& path, tree_patch& out)
+	{
+		size_t common = std::min(a.size(), b.size());
+		size_t prefix = 0;
+		while (prefix < common && a[prefix] == b[prefix])
+			prefix++;
+		size_t suffix = 0;
+		while (suffix < common - prefix && a[a.size() - 1 - suffix] == b[b.size() - 1 - suffix])
+			suffix++;
+
+		size_t a_end = a.size() - suffix;
+		size_t b_end = b.size() - suffix;
+		size_t paired = std::min(a_end, b_end) - prefix;
+		for (size_t i = prefix; i < prefix + paired; i++)
+		{
+			path.emplace_back(i);
+			if constexpr (std::is_same<T, t_compound>::value)
+				diff_compound(a[i], b[i], path, out);
+			else
+				diff_list(a[i], b[i], path, out);
+			path.pop_back();
+		}
+		// Back to front, so the indices of the ones still to go don't move.
+		for (size_t i = a_end; i > prefix + paired; i--)
+		{
+			path.emplace_back(i - 1);
+			out.ops.push_back(patch_op{ patch_op::kind::REMOVE, path, t_variant() });
+			path.pop_back();
+		}
+		for (size_t i = prefix + paired; i < b_end; i++)
+		{
+			path.emplace_back(i);
+			out.ops.push_back(patch_op{ patch_op::kind::INSERT, path, b[i] });
+			path.pop_back();
+		}
+	}
+
+	inline void diff_list(const t_list& a, const t_list& b, patch_path& path, tree_patch& out)
+	{
+		if (a.type() == b.type())
+		{
+			if (const auto* compounds = std::get_if<std::vector<t_compound>>(&a.data))
+				return diff_elements(*compounds, std::get<std::vector<t_compound>>(b.data), path, out);
+			if (const auto* lists = std::get_if<std::vector<t_list>>(&a.data))
+				return diff_elements(*lists, std::get<std::vector<t_list>>(b.data), path, out);
+		}
+		if (!(a == b))
+			out.ops.push_back(patch_op{ patch_op::kind::SET, path, b });
+	}
+
+	inline void diff_value(const t_variant& a, const t_variant& b, patch_path& path, tree_patch& out)
+	{
+		if (a.index() != b.index())
+		{
+			out.ops.push_back(patch_op{ patch_op::kind::SET, path, b });
+			return;
+		}
+		switch (tag(a.index()))
+		{
+		case tag::COMPOUND:
+			diff_compound(std::get<t_compound>(a), std::get<t_compound>(b), path, out);
+			break;
+		case tag::LIST:
+			diff_list(std::get<t_list>(a), std::get<t_list>(b), path, out);
+			break;
+		case tag::BYTEARRAY:
+			diff_array(std::get<t_bytearray>(a), std::get<t_bytearray>(b), path, out);
+			break;
+		case tag::INTARRAY:
+			diff_array(std::get<t_intarray>(a), std::get<t_intarray>(b), path, out);
+			break;
+		case tag::LONGARRAY:
+			diff_array(std::get<t_longarray>(a), std::get<t_longarray>(b), path, out);
+			break;
+		default:
+			if (!(a == b))
+				out.ops.push_back(patch_op{ patch_op::kind::SET, path, b });
+			break;
+		}
+	}
+
+	// The operations that turn a into b. The root name is not part of the diff.
+	[[nodiscard]] inline tree_patch diff(const NBTree& a, const NBTree& b)
+	{
+		tree_patch result;
+		patch_path path;
+		diff_value(a.root, b.root, path, result);
+		return result;
+	}
+
+	void apply_op(t_variant& node, const patch_op& op, size_t depth);
+
+	template<typename T>
+	void apply_range(std::vector<T>& array, const patch_op& op)
+	{
+		const std::vector<T>* added = std::get_if<std::vector<T>>(&op.value);
+		if (added == nullptr || op.offset > array.size() || op.removed > array.size() - op.offset)
+			throw std::runtime_error("Patch does not match tree.");
+		auto start = array.begin() + op.offset;
+		if (op.removed == added->size())
+		{
+			std::copy(added->begin(), added->end(), start);
+			return;
+		}
+		start = array.erase(start, start + op.removed);
+		array.insert(start, added->begin(), added->end());
+	}
+
+	inline void apply_op(t_compound& node, const patch_op& op, size_t depth)
+	{
+		const std::string* key = std::get_if<std::string>(&op.path[depth]);
+		if (key == nullptr)
+			throw std::runtime_error("Patch does not match tree.");
+		if (depth + 1 == op.path.size() && op.type != patch_op::kind::RANGE)
+		{
+			if (op.type == patch_op::kind::REMOVE)
+				node.remove(*key);
+			else if (op.type == patch_op::kind::SET)
+				node.set(*key, op.value);
+			else
+				throw std::runtime_error("Patch does not match tree.");
+			return;
+		}
+		auto found = node.find(*key);
+		if (found == node.end())
+			throw std::runtime_error("Patch does not match tree.");
+		apply_op(found->second, op, depth + 1);
+	}
+
+	template<typename T>
+	void apply_element(std::vector<T>& items, const patch_op& op, size_t depth)
+	{
+		const size_t* index = std::get_if<size_t>(&op.path[depth]);
+		bool last = depth + 1 == op.path.size();
+		if (index == nullptr || *index > items.size() || (*index == items.size() && !(last && op.type == patch_op::kind::INSERT)))
+			throw std::runtime_error("Patch does not match tree.");
+		if (!last)
+			return apply_op(items[*index], op, depth + 1);
+		if (op.type == patch_op::kind::INSERT)
+		{
+			const T* value = std::get_if<T>(&op.value);
+			if (value == nullptr)
+				throw std::runtime_error("Patch does not match tree.");
+			items.insert(items.begin() + *index, *value);
+		}
+		else if (op.type == patch_op::kind::REMOVE)
+			items.erase(items.begin() + *index);
+		else if (const T* value = std::get_if<T>(&op.value))
+			items[*index] = *value;
+		else
+			throw std::runtime_error("Patch does not match tree.");
+	}
+
+	inline void apply_op(t_list& node, const patch_op& op, size_t depth)
+	{
+		if (auto* compounds = std::get_if<std::vector<t_compound>>(&node.data))
+			apply_element(*compounds, op, depth);
+		else if (auto* lists = std::get_if<std::vector<t_list>>(&node.data))
+			apply_element(*lists, op, depth);
+		else
+			throw std::runtime_error("Patch does not match tree.");
+	}
+
+	inline void apply_op(t_variant& node, const patch_op& op, size_t depth)
+	{
+		if (depth == op.path.size())
+		{
+			switch (op.type)
+			{
+			case patch_op::kind::SET:
+				node = op.value;
+				return;
+			case patch_op::kind::RANGE:
+				if (auto* bytes = std::get_if<t_bytearray>(&node))
+					return apply_range(*bytes, op);
+				if (auto* ints = std::get_if<t_intarray>(&node))
+					return apply_range(*ints, op);
+				if (auto* longs = std::get_if<t_longarray>(&node))
+					return apply_range(*longs, op);
+				break;
+			default:
+				break;
+			}
+			throw std::runtime_error("Patch does not match tree.");
+		}
+		if (auto* compound = std::get_if<t_compound>(&node))
+			apply_op(*compound, op, depth);
+		else if (auto* list = std::get_if<t_list>(&node))
+			apply_op(*list, op, depth);
+		else
+			throw std::runtime_error("Patch does not match tree.");
+	}
+
+	// Applies the operations in order. Throws if one of them doesn't fit the tree.
+	inline void patch(NBTree& tree, const tree_patch& changes)
+	{
+		for (const patch_op& op : changes.ops)
+			apply_op(tree.root, op, 0);
+	}
+
+	// Layout: version byte, varint operation count, then per operation its kind byte, varint path length,
+	// and per path component either varint (index << 1 | 1) or varint (key length << 1) and the key bytes.
+	// SET and INSERT are followed by a tag byte and the value as in a compound, RANGE by a tag byte, varint offset,
+	// varint removed count and the new elements as an array payload.
+	inline void write_patch(const tree_patch& changes, nbtout& out)
+	{
+		out.write(PATCH_VERSION);
+		write_varint(out, changes.ops.size());
+		for (const patch_op& op : changes.ops)
+		{
+			out.write(static_cast<uint8_t>(op.type));
+			write_varint(out, op.path.size());
+			for (auto& component : op.path)
+			{
+				if (const size_t* index = std::get_if<size_t>(&component))
+				{
+					write_varint(out, (static_cast<uint64_t>(*index) << 1) | 1);
+				}
+				else
+				{
+					const std::string& key = std::get<std::string>(component);
+					write_varint(out, static_cast<uint64_t>(key.size()) << 1);
+					out.buffer.insert(out.buffer.end(),
+						reinterpret_cast<const std::byte*>(key.data()),
+						reinterpret_cast<const std::byte*>(key.data() + key.size()));
+				}
+			}
+			if (op.type == patch_op::kind::REMOVE)
+				continue;
+			out.write(tag(op.value.index()));
+			if (op.type == patch_op::kind::RANGE)
+			{
+				write_varint(out, op.offset);
+				write_varint(out, op.removed);
+			}
+			write_tag(op.value, out);
+		}
+	}
+
+	[[nodiscard]] inline tree_patch read_patch(nbtin& in)
+	{
+		if (in.read_u8() != PATCH_VERSION)
+			throw std::runtime_error("Unsupported patch version.");
+		tree_patch result;
+		uint64_t count = read_varint(in);
+		// Every operation takes at least two bytes. Divided rather than multiplied, a varint count can be anything.
+		if (count > in.remaining() / 2)
+			throw std::runtime_error("Reached end of buffer.");
+		result.ops.reserve(count);
+		for (uint64_t i = 0; i < count; i++)
+		{
+			patch_op& op = result.ops.emplace_back();
+			uint8_t kind = in.read_u8();
+			if (kind < 1 || kind > 4)
+				throw std::runtime_error("Invalid patch operation.");
+			op.type = static_cast<patch_op::kind>(kind);
+			uint64_t depth = read_varint(in);
+			// Every path component takes at least a byte.
+			if (depth > in.remaining())
+				throw std::runtime_error("Reached end of buffer.");
+			for (uint64_t j = 0; j < depth; j++)
+			{
+				uint64_t component = read_varint(in);
+				if (component & 1)
+				{
+					op.path.emplace_back(static_cast<size_t>(component >> 1));
+				}
+				else
+				{
+					if ((component >> 1) > in.remaining())
+						throw std::runtime_error("Reached end of buffer.");
+					size_t length = static_cast<size_t>(component >> 1);
+					op.path.emplace_back(std::string(reinterpret_cast<const char*>(in.scan), length));
+					in.advance(length);
+				}
+			}
+			if (op.type == patch_op::kind::REMOVE)
+				continue;
+			tag type = in.read_type();
+			if (op.type == patch_op::kind::RANGE)
+			{
+				if (type != tag::BYTEARRAY && type != tag::INTARRAY && type != tag::LONGARRAY)
+					throw std::runtime_error("Invalid patch operation.");
+				op.offset = static_cast<size_t>(read_varint(in));
+				op.removed = static_cast<size_t>(read_varint(in));
+			}
+			if (type == tag::NONE || type > tag::LONGARRAY)
+				throw std::runtime_error("Invalid tag type.");
+			op.value = read_tag(in, type);
+		}
+		return result;
+	}
+
+}
+
+#endif // NBT_PATCH_HEADER_FILE
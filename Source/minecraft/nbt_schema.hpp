@@ -0,0 +1,278 @@
+﻿#ifndef NBT_SCHEMA_HEADER_FILE
+#define NBT_SCHEMA_HEADER_FILE
+
+// Decoders for compounds whose layout is known ahead of time.
+// A struct lists the keys it cares about and read_schema fills its members straight from the buffer,
+// skipping every other key without building a t_compound or a t_variant:
+//
+//	struct section
+//	{
+//		t_byte Y = 0;
+//		t_bytearray light;
+//		NBT_SCHEMA(section,
+//			NBT_FIELD(Y),
+//			NBT_FIELD_AS(light, "BlockLight"));
+//	};
+//
+// Members can be any NBT type, bool (from a byte), another schema struct (from a compound),
+// std::vector of any of those (from a list, or from the matching array tag), std::optional of any of those
+// (engaged whenever the key is present) and std::vector<std::pair<atom, T>> for compounds whose keys are not known ahead of time.
+// Keys whose tag does not fit the member are skipped and leave the member as it was.
+
+#include <tuple>
+#include <optional>
+#include <type_traits>
+
+#include "nbt.hpp"
+
+#define NBT_SCHEMA(Type, ...)\
+	using nbt_schema_type = Type;\
+	static constexpr auto nbt_fields() { return std::make_tuple(__VA_ARGS__); }
+
+#define NBT_FIELD(member) ::nbt::field(#member, &nbt_schema_type::member)
+
+#define NBT_FIELD_AS(member, key) ::nbt::field(key, &nbt_schema_type::member)
+
+namespace nbt
+{
+
+	template<typename Class, typename T>
+	struct field
+	{
+		std::string_view key;
+		T Class::* member;
+
+		constexpr field(std::string_view key, T Class::* member) : key(key), member(member) {}
+	};
+
+	template<typename T>
+	concept schema = requires { T::nbt_fields(); };
+
+	template<typename T>
+	struct is_optional : std::false_type {};
+
+	template<typename T>
+	struct is_optional<std::optional<T>> : std::true_type {};
+
+	template<typename T>
+	struct is_vector : std::false_type {};
+
+	template<typename T>
+	struct is_vector<std::vector<T>> : std::true_type {};
+
+	template<typename T>
+	struct is_entry : std::false_type {};
+
+	template<typename T>
+	struct is_entry<std::pair<atom, T>> : std::true_type {};
+
+	template<schema T>
+	void read_schema(nbtin& in, T& out);
+
+	// The array tag a vector of T can also be read from, NONE if there isn't one.
+	template<typename T>
+	[[nodiscard]] constexpr tag ArrayTag()
+	{
+		if constexpr (std::is_same<T, std::byte>::value || std::is_same<T, t_byte>::value)
+			return tag::BYTEARRAY;
+		if constexpr (std::is_same<T, t_int>::value)
+			return tag::INTARRAY;
+		if constexpr (std::is_same<T, t_long>::value)
+			return tag::LONGARRAY;
+		return tag::NONE;
+	}
+
+	// The tag of a single element of type T inside a list.
+	template<typename T>
+	[[nodiscard]] constexpr tag ElementTag()
+	{
+		if constexpr (std::is_same<T, std::byte>::value)
+			return tag::BYTE;
+		else
+			return TagType<T>();
+	}
+
+	template<typename T>
+	void read_value(nbtin& in, tag type, T& value);
+
+	// Compounds with keys not known ahead of time, read in order into key and value pairs.
+	template<typename T>
+	void read_entries(nbtin& in, tag type, std::vector<std::pair<atom, T>>& value)
+	{
+		if (type != tag::COMPOUND)
+			return skip_tag(in, type);
+		in.enter();
+		value.clear();
+		tag entry_type = in.read_type();
+		while (entry_type != tag::NONE)
+		{
+			std::pair<atom, T>& entry = value.emplace_back();
+			size_t allocated = 0;
+			entry.first = atom(in.read_str_view(), allocated);
+			in.charge(allocated);
+			read_value(in, entry_type, entry.second);
+			entry_type = in.read_type();
+		}
+		in.leave();
+	}
+
+	template<typename T>
+	void read_elements(nbtin& in, tag type, std::vector<T>& value)
+	{
+		constexpr bool numeric = (std::is_arithmetic<T>::value && !std::is_same<T, bool>::value) || std::is_same<T, std::byte>::value;
+		if constexpr (ArrayTag<T>() != tag::NONE)
+		{
+			if (type == ArrayTag<T>())
+			{
+				size_t length = read_length(in, sizeof(T));
+				value.resize(length);
+				byteswap_copy<sizeof(T)>(value.data(), in.scan, length);
+				in.advance(length * sizeof(T));
+				return;
+			}
+		}
+		if (type != tag::LIST)
+			return skip_tag(in, type);
+		tag element = in.read_type();
+		if constexpr (numeric)
+		{
+			if (element == ElementTag<T>())
+			{
+				size_t length = read_length(in, sizeof(T));
+				value.resize(length);
+				byteswap_copy<sizeof(T)>(value.data(), in.scan, length);
+				in.advance(length * sizeof(T));
+				return;
+			}
+		}
+		// Every element takes at least one byte, which keeps a bad length from allocating a huge vector.
+		size_t length = read_length(in, 1);
+		in.enter();
+		value.clear();
+		value.resize(length);
+		for (T& item : value)
+			read_value(in, element, item);
+		in.leave();
+	}
+
+	template<typename T>
+	void read_value(nbtin& in, tag type, T& value)
+	{
+		if constexpr (schema<T>)
+		{
+			if (type != tag::COMPOUND)
+				return skip_tag(in, type);
+			read_schema(in, value);
+		}
+		else if constexpr (is_optional<T>::value)
+		{
+			read_value(in, type, value.emplace());
+		}
+		else if constexpr (std::is_same<T, std::byte>::value)
+		{
+			if (type != tag::BYTE)
+				return skip_tag(in, type);
+			value = static_cast<std::byte>(in.read_i8());
+		}
+		else if constexpr (std::is_same<T, bool>::value)
+		{
+			if (type != tag::BYTE)
+				return skip_tag(in, type);
+			value = in.read_i8() != 0;
+		}
+		else if constexpr (std::is_arithmetic<T>::value)
+		{
+			static_assert(is_nbt_t<T>::value, "Must be NBT type.");
+			if (type != TagType<T>())
+				return skip_tag(in, type);
+			if constexpr (std::is_same<T, t_byte>::value)
+				value = read_byte(in);
+			else if constexpr (std::is_same<T, t_short>::value)
+				value = read_short(in);
+			else if constexpr (std::is_same<T, t_int>::value)
+				value = read_int(in);
+			else if constexpr (std::is_same<T, t_long>::value)
+				value = read_long(in);
+			else if constexpr (std::is_same<T, t_float>::value)
+				value = read_float(in);
+			else
+				value = read_double(in);
+		}
+		else if constexpr (std::is_same<T, t_string>::value)
+		{
+			if (type != tag::STRING)
+				return skip_tag(in, type);
+			value = in.read_str();
+		}
+		else if constexpr (std::is_same<T, t_compound>::value)
+		{
+			if (type != tag::COMPOUND)
+				return skip_tag(in, type);
+			value = read_compound(in);
+		}
+		else if constexpr (std::is_same<T, t_list>::value)
+		{
+			if (type != tag::LIST)
+				return skip_tag(in, type);
+			value = read_list(in);
+		}
+		else if constexpr (std::is_same<T, t_variant>::value)
+		{
+			value = read_tag(in, type);
+		}
+		else if constexpr (is_vector<T>::value)
+		{
+			if constexpr (is_entry<typename T::value_type>::value)
+				read_entries(in, type, value);
+			else
+				read_elements(in, type, value);
+		}
+		else
+		{
+			static_assert(is_nbt_t<T>::value, "Member type has no NBT decoding.");
+		}
+	}
+
+	template<typename T, typename Class, typename Member>
+	inline bool read_field(nbtin& in, tag type, std::string_view key, T& out, const field<Class, Member>& entry)
+	{
+		if (key != entry.key)
+			return false;
+		read_value(in, type, out.*(entry.member));
+		return true;
+	}
+
+	// Reads the entries of a compound into out, up to and including its end tag.
+	template<schema T>
+	void read_schema(nbtin& in, T& out)
+	{
+		static constexpr auto fields = T::nbt_fields();
+		in.enter();
+		tag type = in.read_type();
+		while (type != tag::NONE)
+		{
+			std::string_view key = in.read_str_view();
+			bool known = std::apply([&](const auto&... entries) { return (read_field(in, type, key, out, entries) || ...); }, fields);
+			if (!known)
+				skip_tag(in, type);
+			type = in.read_type();
+		}
+		in.leave();
+	}
+
+	// Reads a whole file or chunk whose root compound follows the schema T.
+	template<schema T>
+	[[nodiscard]] T load_schema(nbtin& in)
+	{
+		tag type = in.read_type();
+		in.skip(in.read_u16());
+		if (type != tag::COMPOUND)
+			throw std::runtime_error("Root tag is not a compound.");
+		T result{};
+		read_schema(in, result);
+		return result;
+	}
+
+}
+
+#endif // NBT_SCHEMA_HEADER_FILE
@@ -0,0 +1,562 @@
+﻿#ifndef NBT_SNBT_HEADER_FILE
+#define NBT_SNBT_HEADER_FILE
+
+// https://minecraft.fandom.com/wiki/NBT_format#SNBT_format
+// Stringified NBT, as used in commands and data packs:
+//
+//	{Name: "minecraft:chest", Items: [{Slot: 0b, Count: 3b}], Pos: [I; 1, 64, -2]}
+//
+// parse_snbt reads straight into t_compound and t_list without a token stream in between,
+// unquoted keys are interned straight from the text and numbers go through std::from_chars.
+
+#include <charconv>
+#include <string>
+#include <string_view>
+
+#include "nbt.hpp"
+
+namespace nbt
+{
+
+	struct snbt_options
+	{
+		// Puts every entry and element on its own line.
+		bool pretty = false;
+		// Spaces per level when pretty.
+		size_t indent = 4;
+	};
+
+	// Characters allowed in unquoted keys and values.
+	[[nodiscard]] constexpr bool snbt_bare(char c)
+	{
+		return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c == '-' || c == '.' || c == '+';
+	}
+
+	class snbt_parser
+	{
+	public:
+		snbt_parser(std::string_view text) : text(text), scan(0) {}
+
+		[[nodiscard]] t_variant parse()
+		{
+			t_variant result = read_value();
+			skip_space();
+			if (scan != text.size())
+				fail();
+			return result;
+		}
+
+	private:
+		std::string_view text;
+		size_t scan;
+		// Nesting left, the same default limit binary reads get.
+		size_t depth_left = read_limits{}.max_depth;
+
+		[[noreturn]] void fail() const
+		{
+			throw std::runtime_error("Invalid SNBT at offset " + std::to_string(scan) + ".");
+		}
+
+		void skip_space()
+		{
+			while (scan < text.size() && (text[scan] == ' ' || text[scan] == '\t' || text[scan] == '\n' || text[scan] == '\r'))
+				scan++;
+		}
+
+		[[nodiscard]] char peek()
+		{
+			skip_space();
+			if (scan >= text.size())
+				fail();
+			return text[scan];
+		}
+
+		void expect(char c)
+		{
+			if (peek() != c)
+				fail();
+			scan++;
+		}
+
+		[[nodiscard]] std::string_view read_bare()
+		{
+			size_t start = scan;
+			while (scan < text.size() && snbt_bare(text[scan]))
+				scan++;
+			if (scan == start)
+				fail();
+			return text.substr(start, scan - start);
+		}
+
+		// Quoted strings without escapes come back as a view into the text, the rest are unescaped into storage.
+		[[nodiscard]] std::string_view read_quoted(std::string& storage)
+		{
+			char quote = text[scan++];
+			size_t start = scan;
+			size_t end = text.find(quote, scan);
+			if (end == std::string_view::npos)
+				fail();
+			size_t escape = text.substr(0, end).find('\\', scan);
+			if (escape == std::string_view::npos)
+			{
+				scan = end + 1;
+				return text.substr(start, end - start);
+			}
+			storage.assign(text.data() + start, escape - start);
+			scan = escape;
+			while (scan < text.size() && text[scan] != quote)
+			{
+				if (text[scan] == '\\')
+				{
+					if (++scan >= text.size())
+						fail();
+				}
+				storage.push_back(text[scan++]);
+			}
+			if (scan >= text.size())
+				fail();
+			scan++;
+			return storage;
+		}
+
+		[[nodiscard]] std::string_view read_key(std::string& storage)
+		{
+			char c = peek();
+			if (c == '"' || c == '\'')
+				return read_quoted(storage);
+			return read_bare();
+		}
+
+		template<typename T>
+		[[nodiscard]] static bool parse_number(std::string_view token, T& value)
+		{
+			if (!token.empty() && token.front() == '+')
+				token.remove_prefix(1);
+			if (token.empty())
+				return false;
+			auto [end, error] = std::from_chars(token.data(), token.data() + token.size(), value);
+			return error == std::errc() && end == token.data() + token.size();
+		}
+
+		// Unquoted values are numbers when they parse as one, otherwise strings, same as the game.
+		[[nodiscard]] static t_variant read_scalar(std::string_view token)
+		{
+			if (token == "true")
+				return t_byte(1);
+			if (token == "false")
+				return t_byte(0);
+
+			char suffix = token.back();
+			std::string_view digits = token.substr(0, token.size() - 1);
+			switch (suffix)
+			{
+			case 'b': case 'B':
+			{
+				t_byte value;
+				if (parse_number(digits, value))
+					return value;
+				break;
+			}
+			case 's': case 'S':
+			{
+				t_short value;
+				if (parse_number(digits, value))
+					return value;
+				break;
+			}
+			case 'l': case 'L':
+			{
+				t_long value;
+				if (parse_number(digits, value))
+					return value;
+				break;
+			}
+			case 'f': case 'F':
+			{
+				t_float value;
+				if (parse_number(digits, value))
+					return value;
+				break;
+			}
+			case 'd': case 'D':
+			{
+				t_double value;
+				if (parse_number(digits, value))
+					return value;
+				break;
+			}
+			default:
+			{
+				t_int integer;
+				if (parse_number(token, integer))
+					return integer;
+				t_double real;
+				if (token.find_first_of(".eE") != std::string_view::npos && parse_number(token, real))
+					return real;
+				break;
+			}
+			}
+			return t_string(token);
+		}
+
+		[[nodiscard]] t_variant read_value()
+		{
+			char c = peek();
+			if (c == '{' || c == '[')
+			{
+				if (depth_left == 0)
+					throw std::runtime_error("Nesting too deep.");
+				depth_left--;
+				t_variant result = c == '{' ? t_variant(read_compound()) : read_list();
+				depth_left++;
+				return result;
+			}
+			if (c == '"' || c == '\'')
+			{
+				std::string storage;
+				std::string_view value = read_quoted(storage);
+				if (value.data() == storage.data())
+					return storage;
+				return t_string(value);
+			}
+			return read_scalar(read_bare());
+		}
+
+		[[nodiscard]] t_compound read_compound()
+		{
+			t_compound result;
+			std::string storage;
+			expect('{');
+			if (peek() == '}')
+			{
+				scan++;
+				return result;
+			}
+			for (;;)
+			{
+				std::string_view key = read_key(storage);
+				expect(':');
+				t_variant value = read_value();
+				// A repeated key replaces the earlier value, same as the game.
+				result.set(key, std::move(value));
+				char next = peek();
+				scan++;
+				if (next == '}')
+					return result;
+				if (next != ',')
+				{
+					scan--;
+					fail();
+				}
+			}
+		}
+
+		// Arrays skip the generic value path, every element is parsed straight as the array's type.
+		// Byte arrays take plain numbers and booleans as well, long arrays take plain numbers.
+		template<typename T, typename Number>
+		[[nodiscard]] std::vector<T> read_array(char suffix)
+		{
+			std::vector<T> result;
+			if (peek() == ']')
+			{
+				scan++;
+				return result;
+			}
+			for (;;)
+			{
+				skip_space();
+				std::string_view token = read_bare();
+				if (token.size() > 1 && (token.back() == suffix || token.back() == suffix + ('a' - 'A')))
+					token.remove_suffix(1);
+				Number value;
+				if (std::is_same<T, std::byte>::value && (token == "true" || token == "false"))
+					value = token == "true";
+				else if (!parse_number(token, value))
+				{
+					scan -= token.size();
+					fail();
+				}
+				result.push_back(static_cast<T>(value));
+				char next = peek();
+				scan++;
+				if (next == ']')
+					return result;
+				if (next != ',')
+				{
+					scan--;
+					fail();
+				}
+			}
+		}
+
+		static void append(t_list& list, t_variant&& value)
+		{
+			switch (tag(value.index()))
+			{
+			case tag::BYTE:
+				std::get<std::vector<t_byte>>(list.data).push_back(std::get<t_byte>(value));
+				break;
+			case tag::SHORT:
+				std::get<std::vector<t_short>>(list.data).push_back(std::get<t_short>(value));
+				break;
+			case tag::INT:
+				std::get<std::vector<t_int>>(list.data).push_back(std::get<t_int>(value));
+				break;
+			case tag::LONG:
+				std::get<std::vector<t_long>>(list.data).push_back(std::get<t_long>(value));
+				break;
+			case tag::FLOAT:
+				std::get<std::vector<t_float>>(list.data).push_back(std::get<t_float>(value));
+				break;
+			case tag::DOUBLE:
+				std::get<std::vector<t_double>>(list.data).push_back(std::get<t_double>(value));
+				break;
+			case tag::BYTEARRAY:
+				std::get<std::vector<t_bytearray>>(list.data).push_back(std::move(std::get<t_bytearray>(value)));
+				break;
+			case tag::STRING:
+				std::get<std::vector<t_string>>(list.data).push_back(std::move(std::get<t_string>(value)));
+				break;
+			case tag::LIST:
+				std::get<std::vector<t_list>>(list.data).push_back(std::move(std::get<t_list>(value)));
+				break;
+			case tag::COMPOUND:
+				std::get<std::vector<t_compound>>(list.data).push_back(std::move(std::get<t_compound>(value)));
+				break;
+			case tag::INTARRAY:
+				std::get<std::vector<t_intarray>>(list.data).push_back(std::move(std::get<t_intarray>(value)));
+				break;
+			case tag::LONGARRAY:
+				std::get<std::vector<t_longarray>>(list.data).push_back(std::move(std::get<t_longarray>(value)));
+				break;
+			default:
+				break;
+			}
+		}
+
+		[[nodiscard]] t_variant read_list()
+		{
+			expect('[');
+			if (scan + 1 < text.size() && text[scan + 1] == ';')
+			{
+				char kind = text[scan];
+				scan += 2;
+				switch (kind)
+				{
+				case 'B':
+					return read_array<std::byte, t_byte>('B');
+				case 'I':
+					return read_array<int32_t, t_int>('\0');
+				case 'L':
+					return read_array<int64_t, t_long>('L');
+				default:
+					scan -= 2;
+					fail();
+				}
+			}
+
+			t_list result;
+			if (peek() == ']')
+			{
+				scan++;
+				return result;
+			}
+			for (;;)
+			{
+				size_t start = scan;
+				t_variant value = read_value();
+				if (result.type() == tag::NONE)
+					result = t_list(tag(value.index()));
+				// Every element of a list has to be the same type.
+				if (tag(value.index()) != result.type())
+				{
+					scan = start;
+					fail();
+				}
+				append(result, std::move(value));
+				char next = peek();
+				scan++;
+				if (next == ']')
+					return result;
+				if (next != ',')
+				{
+					scan--;
+					fail();
+				}
+			}
+		}
+	};
+
+	// Throws if text isn't valid SNBT. The tree gets an empty name.
+	[[nodiscard]] inline NBTree parse_snbt(std::string_view text)
+	{
+		snbt_parser parser(text);
+		return NBTree(parser.parse(), "");
+	}
+
+	class snbt_printer
+	{
+	public:
+		std::string output;
+
+		snbt_printer(const snbt_options& options) : options(options) {}
+
+		void print(const t_variant& value)
+		{
+			std::visit([this](const auto& item)
+			{
+				if constexpr (!std::is_same<std::decay_t<decltype(item)>, std::nullptr_t>::value)
+					print(item);
+			}, value);
+		}
+
+		void print(t_byte value) { print_number(value, "b"); }
+		void print(t_short value) { print_number(value, "s"); }
+		void print(t_int value) { print_number(value, ""); }
+		void print(t_long value) { print_number(value, "L"); }
+		void print(t_float value) { print_number(value, "f"); }
+		// Always suffixed, a double without a fraction would read back as an int.
+		void print(t_double value) { print_number(value, "d"); }
+		void print(const t_bytearray& value) { print_array(value, "B", "b"); }
+		void print(const t_intarray& value) { print_array(value, "I", ""); }
+		void print(const t_longarray& value) { print_array(value, "L", "L"); }
+
+		void print(const t_string& value)
+		{
+			print_string(value);
+		}
+
+		void print(const t_compound& value)
+		{
+			output.push_back('{');
+			depth++;
+			bool first = true;
+			for (auto& entry : value)
+			{
+				separator(first);
+				print_key(entry.first);
+				output += options.pretty ? ": " : ":";
+				print(entry.second);
+			}
+			depth--;
+			if (!first)
+				newline();
+			output.push_back('}');
+		}
+
+		void print(const t_list& value)
+		{
+			output.push_back('[');
+			// Lists of numbers stay on one line even when pretty.
+			bool nested = value.type() >= tag::BYTEARRAY;
+			depth++;
+			bool first = true;
+			std::visit([&](const auto& items)
+			{
+				if constexpr (!std::is_same<std::decay_t<decltype(items)>, std::nullptr_t>::value)
+				{
+					for (auto& item : items)
+					{
+						if (nested)
+							separator(first);
+						else if (!first)
+							output += options.pretty ? ", " : ",";
+						first = false;
+						print(item);
+					}
+				}
+			}, value.data);
+			depth--;
+			if (nested && !first)
+				newline();
+			output.push_back(']');
+		}
+
+	private:
+		snbt_options options;
+		size_t depth = 0;
+
+		void newline()
+		{
+			if (!options.pretty)
+				return;
+			output.push_back('\n');
+			output.append(depth * options.indent, ' ');
+		}
+
+		void separator(bool& first)
+		{
+			if (!first)
+				output.push_back(',');
+			first = false;
+			newline();
+		}
+
+		template<typename T>
+		void print_number(T value, const char* suffix)
+		{
+			char buffer[32];
+			auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+			output.append(buffer, end);
+			output += suffix;
+		}
+
+		template<typename T>
+		void print_array(const std::vector<T>& values, const char* kind, const char* suffix)
+		{
+			output.push_back('[');
+			output += kind;
+			output.push_back(';');
+			for (size_t i = 0; i < values.size(); i++)
+			{
+				output += i == 0 ? (options.pretty ? " " : "") : (options.pretty ? ", " : ",");
+				if constexpr (std::is_same<T, std::byte>::value)
+					print_number(static_cast<int8_t>(values[i]), suffix);
+				else
+					print_number(values[i], suffix);
+			}
+			output.push_back(']');
+		}
+
+		void print_string(std::string_view value)
+		{
+			// Single quotes save escaping when the string has double quotes but no single ones.
+			char quote = value.find('"') != std::string_view::npos && value.find('\'') == std::string_view::npos ? '\'' : '"';
+			output.push_back(quote);
+			for (char c : value)
+			{
+				if (c == quote || c == '\\')
+					output.push_back('\\');
+				output.push_back(c);
+			}
+			output.push_back(quote);
+		}
+
+		void print_key(std::string_view key)
+		{
+			bool bare = !key.empty();
+			for (char c : key)
+				bare = bare && snbt_bare(c);
+			if (bare)
+				output += key;
+			else
+				print_string(key);
+		}
+	};
+
+	[[nodiscard]] inline std::string to_snbt(const t_variant& value, const snbt_options& options = {})
+	{
+		snbt_printer printer(options);
+		printer.print(value);
+		return std::move(printer.output);
+	}
+
+	// The root name isn't part of SNBT and is left out.
+	[[nodiscard]] inline std::string to_snbt(const NBTree& tree, const snbt_options& options = {})
+	{
+		return to_snbt(tree.root, options);
+	}
+
+}
+
+#endif // NBT_SNBT_HEADER_FILE
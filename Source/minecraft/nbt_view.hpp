@@ -0,0 +1,539 @@
+﻿#ifndef NBT_VIEW_HEADER_FILE
+#define NBT_VIEW_HEADER_FILE
+
+// Read-only access to NBT without decoding it.
+// A view scans the buffer once and records where every compound entry, list
+// and string starts. Keys and strings are handed out as string_views into the
+// buffer, arrays as spans that byte swap on access, and numbers are only
+// decoded when they are asked for. The buffer must outlive the view.
+
+#include <cstdint>
+#include <cstddef>
+#include <iterator>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#include "nbt.hpp"
+
+namespace nbt
+{
+
+	// Decodes one big-endian number.
+	template<typename T>
+	[[nodiscard]] inline T read_be(const std::byte* p)
+	{
+		static_assert(std::is_arithmetic<T>::value, "Must be a number.");
+		if constexpr (sizeof(T) == 1)
+		{
+			return static_cast<T>(p[0]);
+		}
+		else
+		{
+			using U = std::conditional_t<sizeof(T) == 2, uint16_t, std::conditional_t<sizeof(T) == 4, uint32_t, uint64_t>>;
+			U value = 0;
+			for (size_t i = 0; i < sizeof(T); i++)
+				value = static_cast<U>(value << 8 | static_cast<U>(p[i]));
+			T result;
+			std::memcpy(&result, &value, sizeof(T));
+			return result;
+		}
+	}
+
+	// A span over big-endian numbers, still in the buffer.
+	template<typename T>
+	class be_span
+	{
+	public:
+		class iterator
+		{
+		public:
+			using iterator_category = std::input_iterator_tag;
+			using value_type = T;
+			using difference_type = std::ptrdiff_t;
+			using pointer = void;
+			using reference = T;
+
+			iterator(const std::byte* p) : p(p) {}
+
+			inline T operator*() const
+			{
+				return read_be<T>(p);
+			}
+
+			inline iterator& operator++()
+			{
+				p += sizeof(T);
+				return *this;
+			}
+
+			inline iterator operator++(int)
+			{
+				iterator result = *this;
+				p += sizeof(T);
+				return result;
+			}
+
+			inline bool operator==(const iterator& rhs) const
+			{
+				return p == rhs.p;
+			}
+
+			inline bool operator!=(const iterator& rhs) const
+			{
+				return p != rhs.p;
+			}
+
+		private:
+			const std::byte* p;
+		};
+
+		be_span() = default;
+		be_span(const std::byte* data, size_t count) : data(data), count(count) {}
+
+		[[nodiscard]] inline size_t size() const
+		{
+			return count;
+		}
+
+		[[nodiscard]] inline bool empty() const
+		{
+			return count == 0;
+		}
+
+		[[nodiscard]] inline T operator[](size_t index) const
+		{
+			return read_be<T>(data + index * sizeof(T));
+		}
+
+		[[nodiscard]] inline iterator begin() const
+		{
+			return iterator(data);
+		}
+
+		[[nodiscard]] inline iterator end() const
+		{
+			return iterator(data + count * sizeof(T));
+		}
+
+		// The raw big-endian bytes.
+		[[nodiscard]] inline std::span<const std::byte> bytes() const
+		{
+			return std::span<const std::byte>(data, count * sizeof(T));
+		}
+
+		// Decodes every element into output, which must hold size() elements.
+		inline void copy_to(T* output) const
+		{
+			byteswap_copy<sizeof(T)>(output, data, count);
+		}
+
+		[[nodiscard]] inline std::vector<T> to_vector() const
+		{
+			std::vector<T> result(count);
+			copy_to(result.data());
+			return result;
+		}
+
+	private:
+		const std::byte* data = nullptr;
+		size_t count = 0;
+	};
+
+	class view;
+
+	// A value inside a view. Cheap to copy. Invalid values (missing keys, out of range
+	// indices) are falsy and return empty results from every accessor.
+	class view_value
+	{
+	public:
+		view_value() = default;
+
+		[[nodiscard]] inline explicit operator bool() const
+		{
+			return _type != tag::NONE;
+		}
+
+		[[nodiscard]] inline tag type() const
+		{
+			return _type;
+		}
+
+		// The key of a compound entry. Empty for list elements.
+		[[nodiscard]] inline std::string_view key() const
+		{
+			return _key;
+		}
+
+		// Entries of a compound, elements of a list, or the length of a string or array.
+		[[nodiscard]] inline size_t size() const;
+
+		// The element type of a list.
+		[[nodiscard]] inline tag element_type() const;
+
+		// Decodes a number, converting between numeric types like cast_t_var does.
+		// Returns fallback for anything that isn't a number.
+		template<typename T>
+		[[nodiscard]] inline T get(T fallback = T{}) const
+		{
+			static_assert(std::is_arithmetic<T>::value && is_nbt_t<T>::value, "Must be a numeric NBT type.");
+			switch (_type)
+			{
+			case tag::BYTE:
+				return static_cast<T>(read_be<t_byte>(_data));
+			case tag::SHORT:
+				return static_cast<T>(read_be<t_short>(_data));
+			case tag::INT:
+				return static_cast<T>(read_be<t_int>(_data));
+			case tag::LONG:
+				return static_cast<T>(read_be<t_long>(_data));
+			case tag::FLOAT:
+				return static_cast<T>(read_be<t_float>(_data));
+			case tag::DOUBLE:
+				return static_cast<T>(read_be<t_double>(_data));
+			default:
+				return fallback;
+			}
+		}
+
+		[[nodiscard]] inline std::string_view as_string() const
+		{
+			if (_type != tag::STRING)
+				return {};
+			return std::string_view(reinterpret_cast<const char*>(_data + 2), read_be<uint16_t>(_data));
+		}
+
+		[[nodiscard]] inline std::span<const std::byte> as_bytearray() const
+		{
+			if (_type != tag::BYTEARRAY)
+				return {};
+			return std::span<const std::byte>(_data + 4, static_cast<size_t>(read_be<int32_t>(_data)));
+		}
+
+		[[nodiscard]] inline be_span<int32_t> as_intarray() const
+		{
+			if (_type != tag::INTARRAY)
+				return {};
+			return be_span<int32_t>(_data + 4, static_cast<size_t>(read_be<int32_t>(_data)));
+		}
+
+		[[nodiscard]] inline be_span<int64_t> as_longarray() const
+		{
+			if (_type != tag::LONGARRAY)
+				return {};
+			return be_span<int64_t>(_data + 4, static_cast<size_t>(read_be<int32_t>(_data)));
+		}
+
+		// Looks up a compound entry.
+		[[nodiscard]] inline view_value operator[](std::string_view key) const;
+
+		// Looks up a list element.
+		[[nodiscard]] inline view_value operator[](size_t index) const;
+
+		// Compound entries and list elements in order, by index.
+		[[nodiscard]] inline view_value at(size_t index) const
+		{
+			return operator[](index);
+		}
+
+		// Where the value starts in the buffer, for handing it to an nbtin.
+		[[nodiscard]] inline const std::byte* data() const
+		{
+			return _data;
+		}
+
+	private:
+		friend class view;
+
+		// Values without an index entry (elements of numeric lists) use NO_ENTRY.
+		static constexpr uint32_t NO_ENTRY = 0xFFFFFFFF;
+
+		const view* _owner = nullptr;
+		const std::byte* _data = nullptr;
+		std::string_view _key;
+		uint32_t _entry = NO_ENTRY;
+		tag _type = tag::NONE;
+
+		view_value(const view* owner, uint32_t entry);
+		view_value(const view* owner, const std::byte* data, tag type) : _owner(owner), _data(data), _type(type) {}
+	};
+
+	class view
+	{
+	public:
+		view() = default;
+
+		// Indexes the named root tag at the current position of in and advances in past it.
+		view(nbtin& in)
+		{
+			parse(in);
+		}
+
+		// Indexes another tree, reusing the index's memory.
+		inline void parse(nbtin& in)
+		{
+			entries.clear();
+			base = in.begin;
+			if (in.size() > 0xFFFFFFFF)
+				throw std::runtime_error("NBT buffer is too large to index.");
+			tag type = in.read_type();
+			root_name = read_key(in);
+			add(in, type, std::string_view());
+		}
+
+		[[nodiscard]] inline view_value root() const
+		{
+			if (entries.empty())
+				return view_value();
+			return view_value(this, 0);
+		}
+
+		[[nodiscard]] inline std::string_view name() const
+		{
+			return root_name;
+		}
+
+		[[nodiscard]] inline view_value operator[](std::string_view key) const
+		{
+			return root()[key];
+		}
+
+		// Number of index entries, one per compound entry and per element of non-numeric lists.
+		[[nodiscard]] inline size_t entry_count() const
+		{
+			return entries.size();
+		}
+
+	private:
+		friend class view_value;
+
+		struct entry
+		{
+			uint32_t key;
+			uint16_t key_length;
+			tag type;
+			tag element;
+			uint32_t offset;
+			// Entries of a compound, elements of a list.
+			uint32_t count;
+			// The index just past this entry's subtree, where its next sibling starts.
+			uint32_t end;
+		};
+
+		const std::byte* base = nullptr;
+		std::string_view root_name;
+		std::vector<entry> entries;
+
+		[[nodiscard]] static inline std::string_view read_key(nbtin& in)
+		{
+			uint16_t length = in.read_u16();
+			if (!in.ensure(length))
+				throw std::runtime_error("Reached end of buffer.");
+			std::string_view result(reinterpret_cast<const char*>(in.scan), length);
+			in.advance(length);
+			return result;
+		}
+
+		// Makes sure count elements of size bytes are left and skips over them.
+		static inline void skip_elements(nbtin& in, int32_t count, size_t size)
+		{
+			if (count < 0 || !in.ensure(static_cast<size_t>(count) * size))
+				throw std::runtime_error("Reached end of buffer.");
+			in.advance(static_cast<size_t>(count) * size);
+		}
+
+		inline void add(nbtin& in, tag type, std::string_view key)
+		{
+			uint32_t index = static_cast<uint32_t>(entries.size());
+			entry& e = entries.emplace_back();
+			e.key = key.empty() ? 0 : static_cast<uint32_t>(reinterpret_cast<const std::byte*>(key.data()) - base);
+			e.key_length = static_cast<uint16_t>(key.size());
+			e.type = type;
+			e.element = tag::NONE;
+			e.offset = static_cast<uint32_t>(in.tellg());
+			e.count = 0;
+
+			// entries may grow while the subtree is added, so e is not used past this point.
+			uint32_t count = 0;
+			tag element = tag::NONE;
+			switch (type)
+			{
+			case tag::BYTE:
+				skip_elements(in, 1, 1);
+				break;
+			case tag::SHORT:
+				skip_elements(in, 1, 2);
+				break;
+			case tag::INT:
+			case tag::FLOAT:
+				skip_elements(in, 1, 4);
+				break;
+			case tag::LONG:
+			case tag::DOUBLE:
+				skip_elements(in, 1, 8);
+				break;
+			case tag::BYTEARRAY:
+				skip_elements(in, in.read_i32(), 1);
+				break;
+			case tag::STRING:
+				skip_elements(in, in.read_u16(), 1);
+				break;
+			case tag::INTARRAY:
+				skip_elements(in, in.read_i32(), 4);
+				break;
+			case tag::LONGARRAY:
+				skip_elements(in, in.read_i32(), 8);
+				break;
+			case tag::LIST:
+			{
+				element = in.read_type();
+				int32_t length = in.read_i32();
+				if (length < 0)
+					throw std::runtime_error("Reached end of buffer.");
+				count = static_cast<uint32_t>(length);
+				switch (element)
+				{
+				case tag::NONE:
+					count = 0;
+					break;
+				// Numeric elements are found arithmetically and don't get entries.
+				case tag::BYTE:
+					skip_elements(in, length, 1);
+					break;
+				case tag::SHORT:
+					skip_elements(in, length, 2);
+					break;
+				case tag::INT:
+				case tag::FLOAT:
+					skip_elements(in, length, 4);
+					break;
+				case tag::LONG:
+				case tag::DOUBLE:
+					skip_elements(in, length, 8);
+					break;
+				default:
+					in.enter();
+					for (int32_t i = 0; i < length; i++)
+						add(in, element, std::string_view());
+					in.leave();
+					break;
+				}
+				break;
+			}
+			case tag::COMPOUND:
+			{
+				in.enter();
+				tag child = in.read_type();
+				while (child != tag::NONE)
+				{
+					std::string_view child_key = read_key(in);
+					add(in, child, child_key);
+					count++;
+					child = in.read_type();
+				}
+				in.leave();
+				break;
+			}
+			default:
+				throw std::runtime_error("Invalid tag type.");
+			}
+
+			entries[index].element = element;
+			entries[index].count = count;
+			entries[index].end = static_cast<uint32_t>(entries.size());
+		}
+	};
+
+	inline view_value::view_value(const view* owner, uint32_t index) : _owner(owner), _entry(index)
+	{
+		const view::entry& e = owner->entries[index];
+		_data = owner->base + e.offset;
+		_type = e.type;
+		if (e.key_length != 0)
+			_key = std::string_view(reinterpret_cast<const char*>(owner->base + e.key), e.key_length);
+	}
+
+	inline size_t view_value::size() const
+	{
+		switch (_type)
+		{
+		case tag::LIST:
+		case tag::COMPOUND:
+			return _owner->entries[_entry].count;
+		case tag::STRING:
+			return read_be<uint16_t>(_data);
+		case tag::BYTEARRAY:
+		case tag::INTARRAY:
+		case tag::LONGARRAY:
+			return static_cast<size_t>(read_be<int32_t>(_data));
+		default:
+			return 0;
+		}
+	}
+
+	inline tag view_value::element_type() const
+	{
+		if (_type != tag::LIST)
+			return tag::NONE;
+		return _owner->entries[_entry].element;
+	}
+
+	inline view_value view_value::operator[](std::string_view key) const
+	{
+		if (_type != tag::COMPOUND)
+			return view_value();
+		const std::vector<view::entry>& entries = _owner->entries;
+		const view::entry& parent = entries[_entry];
+		uint32_t child = _entry + 1;
+		for (uint32_t i = 0; i < parent.count; i++)
+		{
+			const view::entry& e = entries[child];
+			if (e.key_length == key.size() && std::memcmp(_owner->base + e.key, key.data(), key.size()) == 0)
+				return view_value(_owner, child);
+			child = e.end;
+		}
+		return view_value();
+	}
+
+	inline view_value view_value::operator[](size_t index) const
+	{
+		if (_type != tag::LIST && _type != tag::COMPOUND)
+			return view_value();
+		const std::vector<view::entry>& entries = _owner->entries;
+		const view::entry& parent = entries[_entry];
+		if (index >= parent.count)
+			return view_value();
+
+		if (_type == tag::LIST)
+		{
+			// Skip the element type and length.
+			const std::byte* elements = _data + 5;
+			switch (parent.element)
+			{
+			case tag::BYTE:
+				return view_value(_owner, elements + index, tag::BYTE);
+			case tag::SHORT:
+				return view_value(_owner, elements + index * 2, tag::SHORT);
+			case tag::INT:
+				return view_value(_owner, elements + index * 4, tag::INT);
+			case tag::FLOAT:
+				return view_value(_owner, elements + index * 4, tag::FLOAT);
+			case tag::LONG:
+				return view_value(_owner, elements + index * 8, tag::LONG);
+			case tag::DOUBLE:
+				return view_value(_owner, elements + index * 8, tag::DOUBLE);
+			default:
+				break;
+			}
+		}
+
+		// Children with subtrees have to be walked past, everything else is one entry each.
+		uint32_t child = _entry + 1;
+		for (size_t i = 0; i < index; i++)
+			child = entries[child].end;
+		return view_value(_owner, child);
+	}
+
+}
+
+#endif // NBT_VIEW_HEADER_FILE
@@ -4,5 +4,350 @@
 #pragma region [Includes]
 
 #include "world.h"
+#include "worldio.h"
+#include "asyncio.h"
+#include "../bounded_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #pragma endregion [Includes]
+
+namespace
+{
+	using clock = std::chrono::steady_clock;
+
+	struct CompressedChunk
+	{
+		int x = 0;
+		int z = 0;
+		worldio::compression type = worldio::compression::ZLIB;
+		zlib::vector payload;
+	};
+
+	struct InflatedChunk
+	{
+		int x = 0;
+		int z = 0;
+		zlib::vector data;
+	};
+
+	// What every stage shares. The last thread out of a stage closes the queue after it.
+	struct Pipeline
+	{
+		std::vector<std::string> regions;
+		std::atomic<size_t> nextRegion = 0;
+
+		BoundedQueue<CompressedChunk> compressed;
+		BoundedQueue<InflatedChunk> inflated;
+		BoundedQueue<world::Chunk> parsed;
+
+		std::atomic<size_t> readers = 0;
+		std::atomic<size_t> inflaters = 0;
+		std::atomic<size_t> parsers = 0;
+
+		std::mutex mutex;
+		world::LoadStats stats;
+
+		Pipeline(size_t depth) : compressed(depth), inflated(depth), parsed(depth) {}
+
+		void Merge(const world::LoadStats& local)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stats += local;
+		}
+	};
+
+	void ReadRegions(Pipeline& pipeline)
+	{
+		world::LoadStats local;
+		for (size_t next = pipeline.nextRegion++; next < pipeline.regions.size(); next = pipeline.nextRegion++)
+		{
+			clock::time_point start = clock::now();
+			worldio::RegionFile region;
+			try
+			{
+				region = worldio::RegionFile(pipeline.regions[next]);
+			}
+			catch (const std::exception&)
+			{
+				local.failed++;
+				continue;
+			}
+			local.regions++;
+
+			for (size_t index = 0; index < worldio::CHUNKS_PER_REGION; index++)
+			{
+				uint8_t type = region.Compression(index);
+				if (type == 0)
+					continue;
+
+				CompressedChunk chunk;
+				chunk.x = region.X() * static_cast<int>(worldio::REGION_WIDTH) + static_cast<int>(index % worldio::REGION_WIDTH);
+				chunk.z = region.Z() * static_cast<int>(worldio::REGION_WIDTH) + static_cast<int>(index / worldio::REGION_WIDTH);
+				chunk.type = static_cast<worldio::compression>(type & ~static_cast<uint8_t>(worldio::compression::EXTERNAL));
+				// Copying the payload out is what faults the mapped pages in, so the I/O happens here.
+				try
+				{
+					if (region.IsExternal(index))
+					{
+						worldio::MappedFile external(region.ExternalPath(index));
+						chunk.payload.assign(external.View().begin(), external.View().end());
+					}
+					else
+					{
+						std::span<const std::byte> payload = region.Payload(index);
+						chunk.payload.assign(payload.begin(), payload.end());
+					}
+				}
+				catch (const std::exception&)
+				{
+				}
+				if (chunk.payload.empty())
+				{
+					local.failed++;
+					continue;
+				}
+				local.compressedBytes += chunk.payload.size();
+
+				local.read += clock::now() - start;
+				pipeline.compressed.Push(std::move(chunk));
+				start = clock::now();
+			}
+			local.read += clock::now() - start;
+		}
+
+		pipeline.Merge(local);
+		if (--pipeline.readers == 0)
+			pipeline.compressed.Close();
+	}
+
+	// The reader stage on its own thread, with the reads queued through AsyncIO and each chunk
+	// pushed to the inflaters from the completion of the read it arrived in.
+	void ScanRegions(Pipeline& pipeline, size_t depth)
+	{
+		world::LoadStats local;
+		clock::time_point start = clock::now();
+		try
+		{
+			worldio::AsyncIO io(depth);
+			worldio::ScanResult scanned = worldio::ScanRegions(io, pipeline.regions, [&](const worldio::ScannedChunk& scannedChunk)
+			{
+				CompressedChunk chunk;
+				chunk.x = scannedChunk.x;
+				chunk.z = scannedChunk.z;
+				chunk.type = scannedChunk.type;
+				chunk.payload.assign(scannedChunk.payload.begin(), scannedChunk.payload.end());
+				local.compressedBytes += chunk.payload.size();
+
+				local.read += clock::now() - start;
+				pipeline.compressed.Push(std::move(chunk));
+				start = clock::now();
+			});
+			local.regions += scanned.regions;
+			local.failed += scanned.failed;
+		}
+		catch (const std::exception&)
+		{
+			local.failed++;
+		}
+		local.read += clock::now() - start;
+
+		pipeline.Merge(local);
+		if (--pipeline.readers == 0)
+			pipeline.compressed.Close();
+	}
+
+	void InflateChunks(Pipeline& pipeline)
+	{
+		world::LoadStats local;
+		zlib::Inflater inflater;
+		CompressedChunk chunk;
+		while (pipeline.compressed.Pop(chunk))
+		{
+			clock::time_point start = clock::now();
+			InflatedChunk result;
+			result.x = chunk.x;
+			result.z = chunk.z;
+			try
+			{
+				const char* data = reinterpret_cast<const char*>(chunk.payload.data());
+				switch (chunk.type)
+				{
+				case worldio::compression::GZIP:
+					inflater.SetType(zlib::GZIP);
+					inflater.Decompress(data, chunk.payload.size(), result.data);
+					break;
+				case worldio::compression::ZLIB:
+					inflater.SetType(zlib::ZLIB);
+					inflater.Decompress(data, chunk.payload.size(), result.data);
+					break;
+				default:
+					worldio::DecompressChunk(chunk.payload, chunk.type, result.data);
+					break;
+				}
+			}
+			catch (const std::exception&)
+			{
+				local.failed++;
+				local.inflate += clock::now() - start;
+				continue;
+			}
+			local.inflatedBytes += result.data.size();
+			local.inflate += clock::now() - start;
+			pipeline.inflated.Push(std::move(result));
+		}
+
+		pipeline.Merge(local);
+		if (--pipeline.inflaters == 0)
+			pipeline.inflated.Close();
+	}
+
+	void ParseChunks(Pipeline& pipeline)
+	{
+		world::LoadStats local;
+		InflatedChunk chunk;
+		while (pipeline.inflated.Pop(chunk))
+		{
+			clock::time_point start = clock::now();
+			world::Chunk result;
+			result.x = chunk.x;
+			result.z = chunk.z;
+			try
+			{
+				// Chunks come from disk and can be anything, so they get the same limits as any untrusted read.
+				nbt::nbtin in(chunk.data.data(), chunk.data.size());
+				in.limit(nbt::read_limits{});
+				result.data = nbt::load_schema<chunk::ChunkData>(in);
+			}
+			catch (const std::exception&)
+			{
+				local.failed++;
+				local.parse += clock::now() - start;
+				continue;
+			}
+			local.parse += clock::now() - start;
+			pipeline.parsed.Push(std::move(result));
+		}
+
+		pipeline.Merge(local);
+		if (--pipeline.parsers == 0)
+			pipeline.parsed.Close();
+	}
+
+	// The threads running the stages of a pipeline, joined on every way out of LoadWorld.
+	struct StageThreads
+	{
+		Pipeline& pipeline;
+		std::vector<std::thread> threads;
+
+		~StageThreads()
+		{
+			// Leaving early, the stages may be waiting on a stage that never started or on a consumer
+			// that is gone. Closing every queue lets them run out, pushes give up and pops drain.
+			if (std::any_of(threads.begin(), threads.end(), [](const std::thread& thread) { return thread.joinable(); }))
+			{
+				pipeline.compressed.Close();
+				pipeline.inflated.Close();
+				pipeline.parsed.Close();
+			}
+			Join();
+		}
+
+		void Join()
+		{
+			for (std::thread& thread : threads)
+			{
+				if (thread.joinable())
+					thread.join();
+			}
+		}
+	};
+}
+
+//╔════════════════════════════════════════════════════════╗
+//║ World                                                  ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [World]
+
+const world::Chunk* world::World::Find(int x, int z) const
+{
+	auto found = chunks.find(Key(x, z));
+	return found == chunks.end() ? nullptr : &found->second;
+}
+
+void world::World::Insert(Chunk&& chunk)
+{
+	uint64_t key = Key(chunk.x, chunk.z);
+	chunks.insert_or_assign(key, std::move(chunk));
+}
+
+world::LoadStats& world::LoadStats::operator+=(const LoadStats& rhs)
+{
+	regions += rhs.regions;
+	chunks += rhs.chunks;
+	failed += rhs.failed;
+	compressedBytes += rhs.compressedBytes;
+	inflatedBytes += rhs.inflatedBytes;
+	read += rhs.read;
+	inflate += rhs.inflate;
+	parse += rhs.parse;
+	build += rhs.build;
+	wall += rhs.wall;
+	return *this;
+}
+
+world::LoadStats world::LoadWorld(const std::string& directory, World& world, const LoadOptions& options)
+{
+	clock::time_point begin = clock::now();
+	Pipeline pipeline(std::max<size_t>(options.queueDepth, 2));
+	for (const auto& entry : std::filesystem::directory_iterator(directory))
+	{
+		int regionX, regionZ;
+		if (entry.is_regular_file() && worldio::RegionFile::ParseName(entry.path().filename().string(), regionX, regionZ))
+			pipeline.regions.push_back(entry.path().string());
+	}
+
+	// Inflating and parsing a chunk take about as long as each other, so they split the cores.
+	size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+	size_t readers = options.asyncIO ? 1 : std::max<size_t>(options.readers, 1);
+	size_t inflaters = options.inflaters != 0 ? options.inflaters : std::max<size_t>(hardware / 2, 1);
+	size_t parsers = options.parsers != 0 ? options.parsers : std::max<size_t>(hardware - hardware / 2, 1);
+	pipeline.readers = readers;
+	pipeline.inflaters = inflaters;
+	pipeline.parsers = parsers;
+
+	StageThreads stages{ pipeline };
+	if (options.asyncIO)
+		stages.threads.emplace_back(ScanRegions, std::ref(pipeline), options.ioDepth);
+	else
+	{
+		for (size_t i = 0; i < readers; i++)
+			stages.threads.emplace_back(ReadRegions, std::ref(pipeline));
+	}
+	for (size_t i = 0; i < inflaters; i++)
+		stages.threads.emplace_back(InflateChunks, std::ref(pipeline));
+	for (size_t i = 0; i < parsers; i++)
+		stages.threads.emplace_back(ParseChunks, std::ref(pipeline));
+
+	LoadStats local;
+	Chunk chunk;
+	while (pipeline.parsed.Pop(chunk))
+	{
+		clock::time_point start = clock::now();
+		world.Insert(std::move(chunk));
+		local.chunks++;
+		local.build += clock::now() - start;
+	}
+	stages.Join();
+
+	pipeline.stats += local;
+	pipeline.stats.wall = clock::now() - begin;
+	return pipeline.stats;
+}
+
+#pragma endregion [World]
@@ -6,7 +6,98 @@
 //╚════════════════════════════════════════════════════════╝
 #pragma region [Includes]
 
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "chunk.h"
 
 #pragma endregion [Includes]
 
-#endif // WORLD_HEADER_FILE
\ No newline at end of file
+//╔════════════════════════════════════════════════════════╗
+//║ World                                                  ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [World]
+
+namespace world
+{
+	struct Chunk
+	{
+		// Chunk coordinates, taken from where the chunk is stored.
+		int x = 0;
+		int z = 0;
+		chunk::ChunkData data;
+	};
+
+	// The loaded chunks of a dimension.
+	class World
+	{
+	public:
+		// nullptr if the chunk isn't loaded.
+		[[nodiscard]] const Chunk* Find(int x, int z) const;
+
+		// Replaces any chunk already at the same coordinates.
+		void Insert(Chunk&& chunk);
+
+		[[nodiscard]] inline size_t Size() const
+		{
+			return chunks.size();
+		}
+
+		[[nodiscard]] inline const std::unordered_map<uint64_t, Chunk>& Chunks() const
+		{
+			return chunks;
+		}
+
+	private:
+		std::unordered_map<uint64_t, Chunk> chunks;
+
+		[[nodiscard]] static inline uint64_t Key(int x, int z)
+		{
+			return static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32 | static_cast<uint32_t>(z);
+		}
+	};
+
+	// 0 threads picks a count from the hardware.
+	// queueDepth is the capacity of each queue between stages, and with the thread counts
+	// it caps how many chunks are in memory at once however large the world is.
+	struct LoadOptions
+	{
+		size_t readers = 2;
+		size_t inflaters = 0;
+		size_t parsers = 0;
+		size_t queueDepth = 256;
+		// Replaces the reader threads with one thread keeping ioDepth reads in flight through worldio::AsyncIO,
+		// which suits cold scans where the regions aren't in the page cache yet.
+		bool asyncIO = false;
+		size_t ioDepth = 64;
+	};
+
+	// The times are the time spent working summed over a stage's threads, not counting waits on its queues.
+	struct LoadStats
+	{
+		size_t regions = 0;
+		size_t chunks = 0;
+		// Regions and chunks that couldn't be read, inflated or parsed, and were skipped.
+		size_t failed = 0;
+		uint64_t compressedBytes = 0;
+		uint64_t inflatedBytes = 0;
+		std::chrono::nanoseconds read{};
+		std::chrono::nanoseconds inflate{};
+		std::chrono::nanoseconds parse{};
+		std::chrono::nanoseconds build{};
+		std::chrono::nanoseconds wall{};
+
+		LoadStats& operator+=(const LoadStats& rhs);
+	};
+
+	// Loads every chunk of every r.X.Z.mca file in directory into world.
+	// Region files are read by the reader threads, chunks handed through bounded queues to the
+	// inflater threads, then the parser threads, and finally inserted into world on the calling thread.
+	LoadStats LoadWorld(const std::string& directory, World& world, const LoadOptions& options = {});
+}
+
+#pragma endregion [World]
+
+#endif // WORLD_HEADER_FILE
@@ -4,5 +4,1163 @@
 #pragma region [Includes]
 
 #include "worldio.h"
+#include "../lz4_helper.h"
+#include "../thread_pool.h"
+
+#include <stdexcept>
+#include <algorithm>
+#include <charconv>
+#include <filesystem>
+#include <array>
+#include <future>
+#include <optional>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 #pragma endregion [Includes]
+
+namespace
+{
+	// c.X.Z.mcc, named after the chunk's world coordinates.
+	std::string ExternalFileName(int regionX, int regionZ, size_t index)
+	{
+		using namespace worldio;
+		int chunkX = regionX * static_cast<int>(REGION_WIDTH) + static_cast<int>(index % REGION_WIDTH);
+		int chunkZ = regionZ * static_cast<int>(REGION_WIDTH) + static_cast<int>(index / REGION_WIDTH);
+		return "c." + std::to_string(chunkX) + "." + std::to_string(chunkZ) + ".mcc";
+	}
+
+	inline void WriteBigEndian(std::byte* p, uint32_t value)
+	{
+		p[0] = static_cast<std::byte>(value >> 24);
+		p[1] = static_cast<std::byte>(value >> 16);
+		p[2] = static_cast<std::byte>(value >> 8);
+		p[3] = static_cast<std::byte>(value);
+	}
+
+	inline uint32_t ReadBigEndian(const std::byte* p)
+	{
+		return
+			static_cast<uint32_t>(p[0]) << 24 |
+			static_cast<uint32_t>(p[1]) << 16 |
+			static_cast<uint32_t>(p[2]) << 8 |
+			static_cast<uint32_t>(p[3]);
+	}
+
+	// Writes data to filename and flushes it to disk before returning.
+	void WriteSynced(const std::string& filename, std::span<const std::byte> data)
+	{
+#ifdef _WIN32
+		HANDLE handle = CreateFileA(filename.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+			throw std::runtime_error("Could not open file.");
+		const std::byte* p = data.data();
+		size_t size = data.size();
+		bool written = true;
+		while (written && size != 0)
+		{
+			DWORD count = 0;
+			written = WriteFile(handle, p, static_cast<DWORD>(std::min<size_t>(size, 1u << 30)), &count, nullptr) && count != 0;
+			p += count;
+			size -= count;
+		}
+		written = written && FlushFileBuffers(handle);
+		if (!CloseHandle(handle) || !written)
+			throw std::runtime_error("Could not write file.");
+#else
+		int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			throw std::runtime_error("Could not open file.");
+		const std::byte* p = data.data();
+		size_t size = data.size();
+		bool written = true;
+		while (written && size != 0)
+		{
+			ssize_t count = ::write(fd, p, size);
+			if (count < 0 && errno == EINTR)
+				continue;
+			written = count > 0;
+			if (written)
+			{
+				p += count;
+				size -= static_cast<size_t>(count);
+			}
+		}
+		written = written && ::fsync(fd) == 0;
+		if (::close(fd) != 0 || !written)
+			throw std::runtime_error("Could not write file.");
+#endif
+	}
+
+	// Renames from over to and makes the rename itself durable, which on POSIX means flushing the directory too.
+	void RenameSynced(const std::string& from, const std::string& to)
+	{
+#ifdef _WIN32
+		if (!MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+			throw std::runtime_error("Could not rename file.");
+#else
+		if (::rename(from.c_str(), to.c_str()) != 0)
+			throw std::runtime_error("Could not rename file.");
+		std::string directory = std::filesystem::path(to).parent_path().string();
+		int fd = ::open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			throw std::runtime_error("Could not open directory.");
+		// Some file systems can't flush directories and say so with EINVAL; there is nothing more to do on those.
+		bool synced = ::fsync(fd) == 0 || errno == EINVAL;
+		::close(fd);
+		if (!synced)
+			throw std::runtime_error("Could not flush directory.");
+#endif
+	}
+
+	// Writes next to filename first and then renames over it, so readers never see half a file,
+	// and a crash leaves either the old file or the whole new one.
+	void ReplaceFile(const std::string& filename, std::span<const std::byte> data)
+	{
+		std::string temporary = filename + ".tmp";
+		try
+		{
+			WriteSynced(temporary, data);
+		}
+		catch (...)
+		{
+			std::error_code error;
+			std::filesystem::remove(temporary, error);
+			throw;
+		}
+		RenameSynced(temporary, filename);
+	}
+
+	// The .mcc files of a region being rebuilt in memory. New ones are written under temporary names
+	// and only renamed into place by Commit, once the new region is, so the old region never points
+	// at a .mcc file it didn't write. Whatever wasn't committed is removed again.
+	class ExternalFiles
+	{
+	public:
+		ExternalFiles(const std::filesystem::path& directory, int regionX, int regionZ) : directory(directory), regionX(regionX), regionZ(regionZ)
+		{
+		}
+
+		~ExternalFiles()
+		{
+			for (const std::string& filename : pending)
+			{
+				std::error_code error;
+				std::filesystem::remove(filename + ".tmp", error);
+			}
+		}
+
+		std::string Path(size_t index) const
+		{
+			return (directory / ExternalFileName(regionX, regionZ, index)).string();
+		}
+
+		void Write(size_t index, std::span<const std::byte> payload)
+		{
+			std::string filename = Path(index);
+			pending.push_back(filename);
+			WriteSynced(filename + ".tmp", payload);
+		}
+
+		// Removed by Commit, after the new files are in place.
+		void Remove(std::string filename)
+		{
+			stale.push_back(std::move(filename));
+		}
+
+		void Commit()
+		{
+			while (!pending.empty())
+			{
+				RenameSynced(pending.back() + ".tmp", pending.back());
+				pending.pop_back();
+			}
+			for (const std::string& filename : stale)
+			{
+				std::error_code error;
+				std::filesystem::remove(filename, error);
+			}
+			stale.clear();
+		}
+
+	private:
+		std::filesystem::path directory;
+		int regionX;
+		int regionZ;
+		std::vector<std::string> pending;
+		std::vector<std::string> stale;
+	};
+
+	// Appends a chunk to a region being built in memory and points its header entries at it.
+	// Chunks that don't fit in 255 sectors go to their .mcc file, leaving only the chunk header.
+	// Returns whether the chunk went to its .mcc file.
+	bool AppendChunk(zlib::vector& region, ExternalFiles& externals, size_t index, std::span<const std::byte> payload, uint8_t type, uint32_t timestamp)
+	{
+		using namespace worldio;
+		// The length includes the compression type byte.
+		size_t length = payload.size() + 1;
+		size_t sectors = (CHUNK_HEADER_SIZE + payload.size() + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		bool external = sectors > 255;
+		if (external)
+		{
+			externals.Write(index, payload);
+			type |= static_cast<uint8_t>(compression::EXTERNAL);
+			length = 1;
+			sectors = 1;
+		}
+
+		size_t offset = region.size() / SECTOR_SIZE;
+		region.resize(region.size() + sectors * SECTOR_SIZE);
+		std::byte* p = region.data() + offset * SECTOR_SIZE;
+		WriteBigEndian(p, static_cast<uint32_t>(length));
+		p[4] = static_cast<std::byte>(type);
+		if (!external)
+			std::copy(payload.begin(), payload.end(), p + CHUNK_HEADER_SIZE);
+
+		WriteBigEndian(region.data() + index * 4, static_cast<uint32_t>(offset << 8 | sectors));
+		WriteBigEndian(region.data() + SECTOR_SIZE + index * 4, timestamp);
+		return external;
+	}
+
+	// Chunk indices in the order compaction lays them out.
+	const std::array<uint16_t, worldio::CHUNKS_PER_REGION>& ChunkOrder(worldio::chunk_order order)
+	{
+		using namespace worldio;
+		static const auto tables = []()
+		{
+			std::array<std::array<uint16_t, CHUNKS_PER_REGION>, 2> result;
+			for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+			{
+				result[0][index] = static_cast<uint16_t>(index);
+				// Interleaving the bits of x and z gives the Z-order curve.
+				size_t x = index % REGION_WIDTH;
+				size_t z = index / REGION_WIDTH;
+				size_t morton = 0;
+				for (size_t bit = 0; bit < 5; bit++)
+					morton |= (x >> bit & 1) << (2 * bit) | (z >> bit & 1) << (2 * bit + 1);
+				result[1][morton] = static_cast<uint16_t>(index);
+			}
+			return result;
+		}();
+		return tables[order == chunk_order::MORTON ? 1 : 0];
+	}
+
+	// Counts the jumps, and the sectors jumped over, when reading the present chunks in order.
+	void MeasureLocality(const uint32_t* locations, worldio::chunk_order order, uint64_t& jumps, uint64_t& distance)
+	{
+		using namespace worldio;
+		size_t next = HEADER_SIZE / SECTOR_SIZE;
+		for (uint16_t index : ChunkOrder(order))
+		{
+			size_t offset = locations[index] >> 8;
+			if (offset == 0)
+				continue;
+			if (offset != next)
+			{
+				jumps++;
+				distance += offset > next ? offset - next : next - offset;
+			}
+			next = offset + (locations[index] & 0xFF);
+		}
+	}
+}
+
+//╔════════════════════════════════════════════════════════╗
+//║ MappedFile                                             ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [MappedFile]
+
+worldio::MappedFile::MappedFile(const std::string& filename)
+{
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Could not open the file.");
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(handle, &length))
+	{
+		CloseHandle(handle);
+		throw std::runtime_error("Could not get the file size.");
+	}
+
+	file = handle;
+	size = static_cast<size_t>(length.QuadPart);
+	opened = true;
+
+	// Mapping an empty file is an error, so leave data as nullptr.
+	if (size == 0)
+		return;
+
+	HANDLE map = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (map == nullptr)
+	{
+		Close();
+		throw std::runtime_error("Could not map the file.");
+	}
+	mapping = map;
+
+	data = static_cast<const std::byte*>(MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr)
+	{
+		Close();
+		throw std::runtime_error("Could not map the file.");
+	}
+#else
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		throw std::runtime_error("Could not open the file.");
+
+	struct stat info;
+	if (::fstat(fd, &info) != 0)
+	{
+		::close(fd);
+		throw std::runtime_error("Could not get the file size.");
+	}
+
+	size = static_cast<size_t>(info.st_size);
+	opened = true;
+
+	// Mapping an empty file is an error, so leave data as nullptr.
+	if (size != 0)
+	{
+		void* address = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (address == MAP_FAILED)
+		{
+			::close(fd);
+			opened = false;
+			throw std::runtime_error("Could not map the file.");
+		}
+		// Chunks are pulled out in whatever order the caller wants, so don't read ahead.
+		::madvise(address, size, MADV_RANDOM);
+		data = static_cast<const std::byte*>(address);
+	}
+
+	// The mapping keeps its own reference to the file.
+	::close(fd);
+#endif
+}
+
+worldio::MappedFile::~MappedFile()
+{
+	Close();
+}
+
+worldio::MappedFile::MappedFile(MappedFile&& rhs) noexcept
+{
+	*this = std::move(rhs);
+}
+
+worldio::MappedFile& worldio::MappedFile::operator=(MappedFile&& rhs) noexcept
+{
+	if (this != &rhs)
+	{
+		Close();
+		data = rhs.data;
+		size = rhs.size;
+		opened = rhs.opened;
+#ifdef _WIN32
+		file = rhs.file;
+		mapping = rhs.mapping;
+		rhs.file = nullptr;
+		rhs.mapping = nullptr;
+#endif
+		rhs.data = nullptr;
+		rhs.size = 0;
+		rhs.opened = false;
+	}
+	return *this;
+}
+
+void worldio::MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data != nullptr)
+		UnmapViewOfFile(data);
+	if (mapping != nullptr)
+		CloseHandle(mapping);
+	if (file != nullptr)
+		CloseHandle(file);
+	file = nullptr;
+	mapping = nullptr;
+#else
+	if (data != nullptr)
+		::munmap(const_cast<std::byte*>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+	opened = false;
+}
+
+#pragma endregion [MappedFile]
+
+//╔════════════════════════════════════════════════════════╗
+//║ RegionFile                                             ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [RegionFile]
+
+worldio::RegionFile::RegionFile(const std::string& filename) : file(filename), path(filename)
+{
+	std::string name = std::filesystem::path(filename).filename().string();
+	if (!ParseName(name, regionX, regionZ))
+		throw std::runtime_error("Region file name must be of the form r.X.Z.mca.");
+}
+
+bool worldio::RegionFile::ParseName(std::string_view filename, int& regionX, int& regionZ)
+{
+	// r.X.Z.mca
+	if (filename.size() < 9 || filename.substr(0, 2) != "r.")
+		return false;
+	const char* first = filename.data() + 2;
+	const char* last = filename.data() + filename.size();
+
+	auto [xend, xerr] = std::from_chars(first, last, regionX);
+	if (xerr != std::errc() || xend == last || *xend != '.')
+		return false;
+	auto [zend, zerr] = std::from_chars(xend + 1, last, regionZ);
+	if (zerr != std::errc())
+		return false;
+	return std::string_view(zend, last - zend) == ".mca";
+}
+
+inline uint32_t worldio::RegionFile::ReadHeader(size_t offset) const
+{
+	// Region files that are shorter than the header are treated as empty.
+	if (file.Size() < HEADER_SIZE)
+		return 0;
+	const std::byte* p = file.Data() + offset;
+	return
+		static_cast<uint32_t>(p[0]) << 24 |
+		static_cast<uint32_t>(p[1]) << 16 |
+		static_cast<uint32_t>(p[2]) << 8 |
+		static_cast<uint32_t>(p[3]);
+}
+
+uint32_t worldio::RegionFile::SectorOffset(size_t index) const
+{
+	if (index >= CHUNKS_PER_REGION)
+		throw std::runtime_error("Chunk index out of range.");
+	return ReadHeader(index * 4) >> 8;
+}
+
+uint8_t worldio::RegionFile::SectorCount(size_t index) const
+{
+	if (index >= CHUNKS_PER_REGION)
+		throw std::runtime_error("Chunk index out of range.");
+	return static_cast<uint8_t>(ReadHeader(index * 4) & 0xFF);
+}
+
+uint32_t worldio::RegionFile::Timestamp(size_t index) const
+{
+	if (index >= CHUNKS_PER_REGION)
+		throw std::runtime_error("Chunk index out of range.");
+	return ReadHeader(SECTOR_SIZE + index * 4);
+}
+
+bool worldio::RegionFile::HasChunk(size_t index) const
+{
+	return !Sectors(index).empty();
+}
+
+std::span<const std::byte> worldio::RegionFile::Sectors(size_t index) const
+{
+	if (index >= CHUNKS_PER_REGION)
+		throw std::runtime_error("Chunk index out of range.");
+	uint32_t location = ReadHeader(index * 4);
+	size_t offset = static_cast<size_t>(location >> 8) * SECTOR_SIZE;
+	size_t length = static_cast<size_t>(location & 0xFF) * SECTOR_SIZE;
+	if (offset < HEADER_SIZE || length == 0)
+		return {};
+	if (offset >= file.Size())
+		return {};
+	// The last sector of a region is allowed to be truncated.
+	length = std::min(length, file.Size() - offset);
+	if (length < CHUNK_HEADER_SIZE)
+		return {};
+	return std::span<const std::byte>(file.Data() + offset, length);
+}
+
+uint8_t worldio::RegionFile::Compression(size_t index) const
+{
+	std::span<const std::byte> sectors = Sectors(index);
+	if (sectors.empty())
+		return 0;
+	return static_cast<uint8_t>(sectors[4]);
+}
+
+bool worldio::RegionFile::IsExternal(size_t index) const
+{
+	return (Compression(index) & static_cast<uint8_t>(compression::EXTERNAL)) != 0;
+}
+
+std::span<const std::byte> worldio::RegionFile::Payload(size_t index) const
+{
+	std::span<const std::byte> sectors = Sectors(index);
+	if (sectors.empty())
+		return {};
+	size_t length =
+		static_cast<size_t>(sectors[0]) << 24 |
+		static_cast<size_t>(sectors[1]) << 16 |
+		static_cast<size_t>(sectors[2]) << 8 |
+		static_cast<size_t>(sectors[3]);
+	// The length includes the compression type byte.
+	if (length == 0 || length > sectors.size() - 4)
+		return {};
+	if ((static_cast<uint8_t>(sectors[4]) & static_cast<uint8_t>(compression::EXTERNAL)) != 0)
+		return {};
+	return sectors.subspan(CHUNK_HEADER_SIZE, length - 1);
+}
+
+std::string worldio::RegionFile::ExternalPath(size_t index) const
+{
+	std::filesystem::path external = std::filesystem::path(path).parent_path();
+	external /= ExternalFileName(regionX, regionZ, index);
+	return external.string();
+}
+
+std::span<const std::byte> worldio::RegionFile::ResolvePayload(size_t index, MappedFile& external, uint8_t& type) const
+{
+	type = Compression(index);
+	if (type == 0)
+		return {};
+
+	if ((type & static_cast<uint8_t>(compression::EXTERNAL)) != 0)
+	{
+		type &= ~static_cast<uint8_t>(compression::EXTERNAL);
+		external = MappedFile(ExternalPath(index));
+		return external.View();
+	}
+
+	std::span<const std::byte> payload = Payload(index);
+	if (payload.empty())
+		type = 0;
+	return payload;
+}
+
+zlib::vector worldio::RegionFile::ReadChunk(size_t index) const
+{
+	zlib::vector result;
+	ReadChunk(index, result);
+	return result;
+}
+
+size_t worldio::RegionFile::ReadChunk(size_t index, zlib::vector& output) const
+{
+	output.clear();
+	MappedFile external;
+	uint8_t type;
+	std::span<const std::byte> payload = ResolvePayload(index, external, type);
+	if (type == 0)
+		return 0;
+
+	return DecompressChunk(payload, static_cast<compression>(type), output);
+}
+
+size_t worldio::RegionFile::ReadChunk(size_t index, zlib::Inflater& inflater, zlib::vector& output) const
+{
+	output.clear();
+	MappedFile external;
+	uint8_t type;
+	std::span<const std::byte> payload = ResolvePayload(index, external, type);
+	if (type == 0)
+		return 0;
+
+	const char* data = reinterpret_cast<const char*>(payload.data());
+	switch (static_cast<compression>(type))
+	{
+	case compression::GZIP:
+		inflater.SetType(zlib::GZIP);
+		return inflater.Decompress(data, payload.size(), output);
+	case compression::ZLIB:
+		inflater.SetType(zlib::ZLIB);
+		return inflater.Decompress(data, payload.size(), output);
+	default:
+		return DecompressChunk(payload, static_cast<compression>(type), output);
+	}
+}
+
+nbt::NBTree worldio::RegionFile::LoadChunk(size_t index) const
+{
+	zlib::vector data = ReadChunk(index);
+	if (data.empty())
+		return nbt::NBTree();
+	nbt::nbtin in(data);
+	return nbt::load(in);
+}
+
+#pragma endregion [RegionFile]
+
+//╔════════════════════════════════════════════════════════╗
+//║ RegionWriter                                           ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [RegionWriter]
+
+worldio::RegionWriter::RegionWriter(const std::string& filename) : path(filename)
+{
+	std::string name = std::filesystem::path(filename).filename().string();
+	if (!RegionFile::ParseName(name, regionX, regionZ))
+		throw std::runtime_error("Region file name must be of the form r.X.Z.mca.");
+
+	uint64_t size;
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(filename.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_FLAG_RANDOM_ACCESS, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		throw std::runtime_error("Could not open the file.");
+	file = handle;
+
+	LARGE_INTEGER length;
+	if (!GetFileSizeEx(handle, &length))
+	{
+		CloseHandle(handle);
+		throw std::runtime_error("Could not get the file size.");
+	}
+	size = static_cast<uint64_t>(length.QuadPart);
+#else
+	fd = ::open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0)
+		throw std::runtime_error("Could not open the file.");
+
+	struct stat info;
+	if (::fstat(fd, &info) != 0)
+	{
+		::close(fd);
+		throw std::runtime_error("Could not get the file size.");
+	}
+	size = static_cast<uint64_t>(info.st_size);
+#endif
+
+	// Like RegionFile, files shorter than the header are treated as empty.
+	if (size >= HEADER_SIZE)
+	{
+		std::byte header[HEADER_SIZE];
+		ReadAt(header, HEADER_SIZE, 0);
+		for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+		{
+			locations[index] = ReadBigEndian(header + index * 4);
+			timestamps[index] = ReadBigEndian(header + SECTOR_SIZE + index * 4);
+		}
+	}
+	else
+	{
+		// New chunks go after the header, so it has to exist before any of them.
+		std::byte header[HEADER_SIZE] = {};
+		WriteAt(header, HEADER_SIZE, 0);
+		size = HEADER_SIZE;
+	}
+
+	// The last sector is allowed to be truncated.
+	sectorCount = static_cast<size_t>((size + SECTOR_SIZE - 1) / SECTOR_SIZE);
+	Mark(0, HEADER_SIZE / SECTOR_SIZE, true);
+	for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+	{
+		size_t offset = SectorOffset(index);
+		size_t count = SectorCount(index);
+		// Entries pointing into the header or past the end of the file can't be read back, so drop them.
+		if (offset < HEADER_SIZE / SECTOR_SIZE || count == 0 || offset >= sectorCount)
+		{
+			locations[index] = 0;
+			continue;
+		}
+		Mark(offset, count, true);
+		sectorCount = std::max(sectorCount, offset + count);
+	}
+}
+
+worldio::RegionWriter::~RegionWriter()
+{
+	try
+	{
+		Flush();
+	}
+	catch (...)
+	{
+	}
+#ifdef _WIN32
+	if (file != nullptr)
+		CloseHandle(file);
+#else
+	if (fd >= 0)
+		::close(fd);
+#endif
+}
+
+size_t worldio::RegionWriter::FreeSectors() const
+{
+	size_t count = 0;
+	for (size_t sector = 0; sector < sectorCount; sector++)
+		count += IsUsed(sector) ? 0 : 1;
+	return count;
+}
+
+bool worldio::RegionWriter::IsUsed(size_t sector) const
+{
+	size_t word = sector / 64;
+	return word < used.size() && (used[word] >> (sector % 64) & 1) != 0;
+}
+
+void worldio::RegionWriter::Mark(size_t offset, size_t count, bool value)
+{
+	size_t last = offset + count;
+	if ((last + 63) / 64 > used.size())
+		used.resize((last + 63) / 64);
+	for (size_t sector = offset; sector < last; sector++)
+	{
+		uint64_t bit = uint64_t(1) << (sector % 64);
+		if (value)
+			used[sector / 64] |= bit;
+		else
+			used[sector / 64] &= ~bit;
+	}
+}
+
+size_t worldio::RegionWriter::Allocate(size_t count) const
+{
+	size_t start = HEADER_SIZE / SECTOR_SIZE;
+	size_t run = 0;
+	for (size_t sector = start; sector < sectorCount; sector++)
+	{
+		// Skip whole words with no free sectors.
+		if (sector % 64 == 0 && sector / 64 < used.size() && used[sector / 64] == ~uint64_t(0))
+		{
+			sector += 63;
+			run = 0;
+			start = sector + 1;
+		}
+		else if (IsUsed(sector))
+		{
+			run = 0;
+			start = sector + 1;
+		}
+		else if (++run == count)
+		{
+			return start;
+		}
+	}
+	// Whatever is free at the end of the file gets extended.
+	return start;
+}
+
+void worldio::RegionWriter::WriteChunk(size_t index, std::span<const std::byte> payload, compression type, uint32_t timestamp)
+{
+	if (index >= CHUNKS_PER_REGION)
+		throw std::runtime_error("Chunk index out of range.");
+
+	uint8_t typeByte = static_cast<uint8_t>(type);
+	// The length includes the compression type byte.
+	size_t length = payload.size() + 1;
+	size_t sectors = (CHUNK_HEADER_SIZE + payload.size() + SECTOR_SIZE - 1) / SECTOR_SIZE;
+	bool external = sectors > 255;
+	if (external)
+	{
+		// Only the chunk header stays in the region.
+		ReplaceFile((std::filesystem::path(path).parent_path() / ExternalFileName(regionX, regionZ, index)).string(), payload);
+		std::erase(stale, index);
+		typeByte |= static_cast<uint8_t>(compression::EXTERNAL);
+		length = 1;
+		sectors = 1;
+	}
+	else
+	{
+		stale.push_back(index);
+	}
+
+	// Whole sectors are written so the file always ends on a sector boundary.
+	buffer.assign(sectors * SECTOR_SIZE, std::byte(0));
+	WriteBigEndian(buffer.data(), static_cast<uint32_t>(length));
+	buffer[4] = static_cast<std::byte>(typeByte);
+	if (!external)
+		std::copy(payload.begin(), payload.end(), buffer.begin() + CHUNK_HEADER_SIZE);
+
+	size_t offset = SectorOffset(index);
+	size_t count = SectorCount(index);
+	if (offset != 0 && sectors <= count)
+	{
+		// Still fits, so rewrite it in place and give back what's left over.
+		if (sectors < count)
+			released.push_back(static_cast<uint32_t>((offset + sectors) << 8 | (count - sectors)));
+	}
+	else
+	{
+		if (offset != 0)
+			released.push_back(locations[index]);
+		offset = Allocate(sectors);
+		Mark(offset, sectors, true);
+		sectorCount = std::max(sectorCount, offset + sectors);
+	}
+	WriteAt(buffer.data(), buffer.size(), static_cast<uint64_t>(offset) * SECTOR_SIZE);
+
+	locations[index] = static_cast<uint32_t>(offset << 8 | sectors);
+	timestamps[index] = timestamp;
+	written += sectors;
+	dirty = true;
+}
+
+void worldio::RegionWriter::SaveChunk(size_t index, const nbt::NBTree& chunk, compression type, uint32_t timestamp)
+{
+	nbt::nbtout out;
+	nbt::dump(chunk, out);
+	CompressChunk(reinterpret_cast<const char*>(out.buffer.data()), out.buffer.size(), type, serialized);
+	WriteChunk(index, serialized, type, timestamp);
+}
+
+void worldio::RegionWriter::RemoveChunk(size_t index)
+{
+	if (index >= CHUNKS_PER_REGION)
+		throw std::runtime_error("Chunk index out of range.");
+	if (locations[index] == 0)
+		return;
+	released.push_back(locations[index]);
+	stale.push_back(index);
+	locations[index] = 0;
+	timestamps[index] = 0;
+	dirty = true;
+}
+
+void worldio::RegionWriter::Flush()
+{
+	if (!dirty)
+		return;
+
+	// The header must not point at chunk data that isn't on disk yet.
+	Sync();
+	std::byte header[HEADER_SIZE];
+	for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+	{
+		WriteBigEndian(header + index * 4, locations[index]);
+		WriteBigEndian(header + SECTOR_SIZE + index * 4, timestamps[index]);
+	}
+	WriteAt(header, HEADER_SIZE, 0);
+	Sync();
+	dirty = false;
+
+	// Nothing points at these any more, so they can be reused.
+	for (uint32_t range : released)
+		Mark(range >> 8, range & 0xFF, false);
+	released.clear();
+	// Unless a corrupt entry shares them with a live chunk.
+	for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+	{
+		if (locations[index] != 0)
+			Mark(SectorOffset(index), SectorCount(index), true);
+	}
+
+	// Chunks that were written to the region or removed no longer need their .mcc file.
+	for (size_t index : stale)
+	{
+		std::error_code error;
+		std::filesystem::remove(std::filesystem::path(path).parent_path() / ExternalFileName(regionX, regionZ, index), error);
+	}
+	stale.clear();
+
+	// Trim free sectors off the end of the file.
+	size_t last = sectorCount;
+	while (last > HEADER_SIZE / SECTOR_SIZE && !IsUsed(last - 1))
+		last--;
+	if (last < sectorCount)
+	{
+		Truncate(static_cast<uint64_t>(last) * SECTOR_SIZE);
+		sectorCount = last;
+	}
+}
+
+void worldio::RegionWriter::ReadAt(void* data, size_t size, uint64_t offset)
+{
+	char* p = static_cast<char*>(data);
+	while (size != 0)
+	{
+#ifdef _WIN32
+		OVERLAPPED position = {};
+		position.Offset = static_cast<DWORD>(offset);
+		position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD count = 0;
+		if (!ReadFile(file, p, static_cast<DWORD>(std::min<size_t>(size, 1u << 30)), &count, &position) || count == 0)
+			throw std::runtime_error("Could not read the file.");
+#else
+		ssize_t count = ::pread(fd, p, size, static_cast<off_t>(offset));
+		if (count <= 0)
+			throw std::runtime_error("Could not read the file.");
+#endif
+		p += count;
+		size -= static_cast<size_t>(count);
+		offset += static_cast<uint64_t>(count);
+	}
+}
+
+void worldio::RegionWriter::WriteAt(const void* data, size_t size, uint64_t offset)
+{
+	const char* p = static_cast<const char*>(data);
+	while (size != 0)
+	{
+#ifdef _WIN32
+		OVERLAPPED position = {};
+		position.Offset = static_cast<DWORD>(offset);
+		position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+		DWORD count = 0;
+		if (!WriteFile(file, p, static_cast<DWORD>(std::min<size_t>(size, 1u << 30)), &count, &position) || count == 0)
+			throw std::runtime_error("Could not write the file.");
+#else
+		ssize_t count = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+		if (count <= 0)
+			throw std::runtime_error("Could not write the file.");
+#endif
+		p += count;
+		size -= static_cast<size_t>(count);
+		offset += static_cast<uint64_t>(count);
+	}
+}
+
+void worldio::RegionWriter::Sync()
+{
+#ifdef _WIN32
+	if (!FlushFileBuffers(file))
+		throw std::runtime_error("Could not flush the file.");
+#else
+	if (::fsync(fd) != 0)
+		throw std::runtime_error("Could not flush the file.");
+#endif
+}
+
+void worldio::RegionWriter::Truncate(uint64_t size)
+{
+#ifdef _WIN32
+	LARGE_INTEGER length;
+	length.QuadPart = static_cast<LONGLONG>(size);
+	if (!SetFilePointerEx(file, length, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+		throw std::runtime_error("Could not resize the file.");
+#else
+	if (::ftruncate(fd, static_cast<off_t>(size)) != 0)
+		throw std::runtime_error("Could not resize the file.");
+#endif
+}
+
+#pragma endregion [RegionWriter]
+
+//╔════════════════════════════════════════════════════════╗
+//║ Chunk Payloads                                         ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Chunk Payloads]
+
+size_t worldio::DecompressChunk(std::span<const std::byte> payload, compression type, zlib::vector& output)
+{
+	const char* data = reinterpret_cast<const char*>(payload.data());
+	switch (type)
+	{
+	case compression::GZIP:
+		return zlib::GetCodec().Decompress(data, payload.size(), zlib::GZIP, output);
+	case compression::ZLIB:
+		return zlib::GetCodec().Decompress(data, payload.size(), zlib::ZLIB, output);
+	case compression::NONE:
+		output.assign(payload.begin(), payload.end());
+		return output.size();
+	case compression::LZ4:
+		return lz4::Decompress(data, payload.size(), output);
+	default:
+		throw std::runtime_error("Unsupported chunk compression type.");
+	}
+}
+
+void worldio::CompressChunk(const char* data, size_t size, compression type, zlib::vector& output)
+{
+	switch (type)
+	{
+	case compression::GZIP:
+		zlib::GetCodec().Compress(data, size, zlib::GZIP, output);
+		break;
+	case compression::ZLIB:
+		zlib::GetCodec().Compress(data, size, zlib::ZLIB, output);
+		break;
+	case compression::NONE:
+		output.assign(reinterpret_cast<const std::byte*>(data), reinterpret_cast<const std::byte*>(data) + size);
+		break;
+	case compression::LZ4:
+		output = lz4::Compress(data, size);
+		break;
+	default:
+		throw std::runtime_error("Unsupported chunk compression type.");
+	}
+}
+
+void worldio::WriteRegion(const std::string& filename, const RegionFile& source, compression type)
+{
+	ExternalFiles externals(std::filesystem::path(filename).parent_path(), source.X(), source.Z());
+	zlib::vector region(HEADER_SIZE);
+	zlib::vector chunk;
+	zlib::vector payload;
+
+	for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+	{
+		if (source.ReadChunk(index, chunk) == 0)
+			continue;
+		CompressChunk(reinterpret_cast<const char*>(chunk.data()), chunk.size(), type, payload);
+		// Chunks that were external before and aren't now would leave their .mcc file behind.
+		if (!AppendChunk(region, externals, index, payload, static_cast<uint8_t>(type), source.Timestamp(index)))
+			externals.Remove(externals.Path(index));
+	}
+
+	// Never leave a half written region behind.
+	ReplaceFile(filename, region);
+	externals.Commit();
+}
+
+#pragma endregion [Chunk Payloads]
+
+//╔════════════════════════════════════════════════════════╗
+//║ Compaction                                             ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Compaction]
+
+worldio::CompactResult& worldio::CompactResult::operator+=(const CompactResult& rhs)
+{
+	regions += rhs.regions;
+	rewritten += rhs.rewritten;
+	chunks += rhs.chunks;
+	dropped += rhs.dropped;
+	bytesBefore += rhs.bytesBefore;
+	bytesAfter += rhs.bytesAfter;
+	jumpsBefore += rhs.jumpsBefore;
+	jumpsAfter += rhs.jumpsAfter;
+	distanceBefore += rhs.distanceBefore;
+	distanceAfter += rhs.distanceAfter;
+	return *this;
+}
+
+worldio::CompactResult worldio::CompactRegion(const std::string& filename, const CompactOptions& options)
+{
+	CompactResult result;
+	result.regions = 1;
+	zlib::vector region(HEADER_SIZE);
+	std::optional<ExternalFiles> externals;
+	{
+		RegionFile source(filename);
+		externals.emplace(std::filesystem::path(filename).parent_path(), source.X(), source.Z());
+		result.bytesBefore = std::filesystem::file_size(filename);
+
+		uint32_t locations[CHUNKS_PER_REGION];
+		// The sectors chunks actually need, anything past that is dead.
+		size_t live = HEADER_SIZE / SECTOR_SIZE;
+		for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+		{
+			locations[index] = source.HasChunk(index) ? source.SectorOffset(index) << 8 | source.SectorCount(index) : 0;
+			if (source.IsExternal(index))
+				live += 1;
+			else if (!source.Payload(index).empty())
+				live += (CHUNK_HEADER_SIZE + source.Payload(index).size() + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		}
+		MeasureLocality(locations, options.order, result.jumpsBefore, result.distanceBefore);
+
+		// Already in order with no dead sectors, so there's nothing to gain.
+		size_t sectors = (result.bytesBefore + SECTOR_SIZE - 1) / SECTOR_SIZE;
+		if (!options.recompress && result.jumpsBefore == 0 && live == sectors)
+		{
+			for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+				result.chunks += locations[index] != 0 ? 1 : 0;
+			result.bytesAfter = result.bytesBefore;
+			result.jumpsAfter = result.jumpsBefore;
+			result.distanceAfter = result.distanceBefore;
+			return result;
+		}
+
+		zlib::vector chunk;
+		zlib::vector payload;
+		for (uint16_t index : ChunkOrder(options.order))
+		{
+			if (locations[index] == 0)
+				continue;
+			uint8_t type = source.Compression(index);
+			bool external = (type & static_cast<uint8_t>(compression::EXTERNAL)) != 0;
+			type &= ~static_cast<uint8_t>(compression::EXTERNAL);
+
+			if (options.recompress && type != static_cast<uint8_t>(options.type))
+			{
+				if (source.ReadChunk(index, chunk) == 0)
+				{
+					result.dropped++;
+					continue;
+				}
+				CompressChunk(reinterpret_cast<const char*>(chunk.data()), chunk.size(), options.type, payload);
+				// Chunks that moved out of their .mcc file leave it behind.
+				if (!AppendChunk(region, *externals, index, payload, static_cast<uint8_t>(options.type), source.Timestamp(index)) && external)
+					externals->Remove(source.ExternalPath(index));
+			}
+			else if (external)
+			{
+				// The .mcc file stays as it is, only its chunk header moves.
+				size_t offset = region.size() / SECTOR_SIZE;
+				region.resize(region.size() + SECTOR_SIZE);
+				WriteBigEndian(region.data() + offset * SECTOR_SIZE, 1);
+				region[offset * SECTOR_SIZE + 4] = static_cast<std::byte>(type | static_cast<uint8_t>(compression::EXTERNAL));
+				WriteBigEndian(region.data() + index * 4, static_cast<uint32_t>(offset << 8 | 1));
+				WriteBigEndian(region.data() + SECTOR_SIZE + index * 4, source.Timestamp(index));
+			}
+			else
+			{
+				std::span<const std::byte> raw = source.Payload(index);
+				// Chunks that can't be read back are left out.
+				if (raw.empty())
+				{
+					result.dropped++;
+					continue;
+				}
+				AppendChunk(region, *externals, index, raw, type, source.Timestamp(index));
+			}
+			result.chunks++;
+		}
+		// The mapping is closed here, before the file is replaced.
+	}
+
+	ReplaceFile(filename, region);
+	externals->Commit();
+
+	uint32_t locations[CHUNKS_PER_REGION];
+	for (size_t index = 0; index < CHUNKS_PER_REGION; index++)
+		locations[index] = ReadBigEndian(region.data() + index * 4);
+	MeasureLocality(locations, options.order, result.jumpsAfter, result.distanceAfter);
+	result.bytesAfter = region.size();
+	result.rewritten = 1;
+	return result;
+}
+
+worldio::CompactResult worldio::CompactRegions(const std::string& directory, const CompactOptions& options)
+{
+	std::vector<std::future<CompactResult>> pending;
+	for (const auto& entry : std::filesystem::directory_iterator(directory))
+	{
+		int regionX, regionZ;
+		if (!entry.is_regular_file() || !RegionFile::ParseName(entry.path().filename().string(), regionX, regionZ))
+			continue;
+		std::string filename = entry.path().string();
+		pending.push_back(ThreadPool::Shared().Submit([filename, options]() { return CompactRegion(filename, options); }));
+	}
+
+	// Wait for every region before reporting the first failure, so none is left half done.
+	CompactResult result;
+	std::exception_ptr failure;
+	for (std::future<CompactResult>& region : pending)
+	{
+		try
+		{
+			result += region.get();
+		}
+		catch (...)
+		{
+			if (!failure)
+				failure = std::current_exception();
+		}
+	}
+	if (failure)
+		std::rethrow_exception(failure);
+	return result;
+}
+
+#pragma endregion [Compaction]
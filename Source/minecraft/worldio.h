@@ -1,12 +1,366 @@
 ﻿#ifndef WORLDIO_HEADER_FILE
 #define WORLDIO_HEADER_FILE
 
+// https://minecraft.fandom.com/wiki/Region_file_format
+
 //╔════════════════════════════════════════════════════════╗
 //║ Includes                                               ║
 //╚════════════════════════════════════════════════════════╝
 #pragma region [Includes]
 
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "../zlib_helper.h"
+#include "nbt.hpp"
 
 #pragma endregion [Includes]
 
-#endif // WORLDIO_HEADER_FILE
\ No newline at end of file
+//╔════════════════════════════════════════════════════════╗
+//║ Region I/O                                             ║
+//╚════════════════════════════════════════════════════════╝
+#pragma region [Region I/O]
+
+namespace worldio
+{
+	constexpr size_t SECTOR_SIZE = 4096;
+	constexpr size_t REGION_WIDTH = 32;
+	constexpr size_t CHUNKS_PER_REGION = REGION_WIDTH * REGION_WIDTH;
+	// The location table and the timestamp table are one sector each.
+	constexpr size_t HEADER_SIZE = 2 * SECTOR_SIZE;
+	// Every chunk payload starts with a 4 byte length and a 1 byte compression type.
+	constexpr size_t CHUNK_HEADER_SIZE = 5;
+
+	// The compression type byte at the start of every chunk payload.
+	// If the EXTERNAL bit is set, the payload lives in a c.X.Z.mcc file next to the region.
+	enum class compression : uint8_t
+	{
+		GZIP = 1,
+		ZLIB = 2,
+		NONE = 3,
+		LZ4 = 4,
+		EXTERNAL = 128,
+	};
+
+	// Index of a chunk within its region's header tables.
+	[[nodiscard]] constexpr size_t ChunkIndex(int chunkX, int chunkZ)
+	{
+		return static_cast<size_t>(chunkX & 31) + static_cast<size_t>(chunkZ & 31) * REGION_WIDTH;
+	}
+
+	// Read-only view of a whole file mapped into memory.
+	// Pages are only faulted in when they are touched.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		MappedFile(MappedFile&& rhs) noexcept;
+		MappedFile& operator=(MappedFile&& rhs) noexcept;
+
+		void Close();
+
+		[[nodiscard]] inline bool IsOpen() const
+		{
+			return opened;
+		}
+
+		[[nodiscard]] inline const std::byte* Data() const
+		{
+			return data;
+		}
+
+		[[nodiscard]] inline size_t Size() const
+		{
+			return size;
+		}
+
+		[[nodiscard]] inline std::span<const std::byte> View() const
+		{
+			return std::span<const std::byte>(data, size);
+		}
+
+	private:
+		const std::byte* data = nullptr;
+		size_t size = 0;
+		bool opened = false;
+#ifdef _WIN32
+		void* file = nullptr;
+		void* mapping = nullptr;
+#endif
+	};
+
+	// A memory mapped r.X.Z.mca file.
+	// The location and timestamp tables are decoded straight out of the mapping
+	// and chunk payloads are handed out as spans into it, so nothing is copied
+	// until a chunk is actually decompressed.
+	// Chunk indices are z * 32 + x, anything from CHUNKS_PER_REGION up throws.
+	class RegionFile
+	{
+	public:
+		RegionFile() = default;
+		RegionFile(const std::string& filename);
+
+		RegionFile(const RegionFile&) = delete;
+		RegionFile& operator=(const RegionFile&) = delete;
+		RegionFile(RegionFile&&) noexcept = default;
+		RegionFile& operator=(RegionFile&&) noexcept = default;
+
+		// Parses the region coordinates out of a "r.X.Z.mca" file name.
+		static bool ParseName(std::string_view filename, int& regionX, int& regionZ);
+
+		[[nodiscard]] inline bool IsOpen() const
+		{
+			return file.IsOpen();
+		}
+
+		[[nodiscard]] inline const std::string& Path() const
+		{
+			return path;
+		}
+
+		[[nodiscard]] inline int X() const
+		{
+			return regionX;
+		}
+
+		[[nodiscard]] inline int Z() const
+		{
+			return regionZ;
+		}
+
+		// Offset of the chunk in sectors from the start of the file. 0 if the chunk is absent.
+		[[nodiscard]] uint32_t SectorOffset(size_t index) const;
+
+		// Number of 4 KiB sectors allocated to the chunk.
+		[[nodiscard]] uint8_t SectorCount(size_t index) const;
+
+		// Last modification time of the chunk in epoch seconds.
+		[[nodiscard]] uint32_t Timestamp(size_t index) const;
+
+		[[nodiscard]] bool HasChunk(size_t index) const;
+
+		// The raw sectors allocated to the chunk, including the 5 byte chunk header.
+		// Empty if the chunk is absent or its sectors run past the end of the file.
+		[[nodiscard]] std::span<const std::byte> Sectors(size_t index) const;
+
+		// The compression type byte of the chunk, including the EXTERNAL bit.
+		[[nodiscard]] uint8_t Compression(size_t index) const;
+
+		[[nodiscard]] bool IsExternal(size_t index) const;
+
+		// The compressed chunk payload, ready for zlib::Decompress.
+		// Empty for absent chunks and for chunks stored in an external .mcc file.
+		[[nodiscard]] std::span<const std::byte> Payload(size_t index) const;
+
+		// Path of the c.X.Z.mcc file that holds an oversized chunk.
+		[[nodiscard]] std::string ExternalPath(size_t index) const;
+
+		// Decompresses the chunk with the selected zlib::Codec. Returns an empty vector if the chunk is absent.
+		[[nodiscard]] zlib::vector ReadChunk(size_t index) const;
+
+		// Decompresses the chunk into output, reusing output's capacity.
+		// Returns the decompressed size, 0 if the chunk is absent.
+		size_t ReadChunk(size_t index, zlib::vector& output) const;
+
+		// Same as above but always inflates through the given streaming inflater.
+		size_t ReadChunk(size_t index, zlib::Inflater& inflater, zlib::vector& output) const;
+
+		// Decompresses and parses the chunk.
+		[[nodiscard]] nbt::NBTree LoadChunk(size_t index) const;
+
+	private:
+		MappedFile file;
+		std::string path;
+		int regionX = 0;
+		int regionZ = 0;
+
+		[[nodiscard]] inline uint32_t ReadHeader(size_t offset) const;
+
+		// Finds the payload of a chunk, mapping its .mcc file into external if needed.
+		// type receives the compression type without the EXTERNAL bit, 0 if the chunk is absent.
+		[[nodiscard]] std::span<const std::byte> ResolvePayload(size_t index, MappedFile& external, uint8_t& type) const;
+	};
+
+	// Writes chunks into a new or existing r.X.Z.mca file without rewriting the rest of it.
+	// Free sectors are tracked in a bitmap built from the location table. A chunk that still fits
+	// in its sectors is rewritten in place, otherwise it moves to the first run of free sectors that
+	// fits, growing the file if there is none. Chunks that don't fit in 255 sectors go to c.X.Z.mcc files.
+	//
+	// Chunk data is written straight away but the header only by Flush, once the data is on disk.
+	// Sectors a chunk moved out of are not reused until then, so a crash before Flush leaves the
+	// old header pointing at the old, intact copies. Only chunks rewritten in place can be torn.
+	class RegionWriter
+	{
+	public:
+		// Creates the file if it doesn't exist.
+		RegionWriter(const std::string& filename);
+		// Flushes, ignoring errors. Call Flush first to see them.
+		~RegionWriter();
+
+		RegionWriter(const RegionWriter&) = delete;
+		RegionWriter& operator=(const RegionWriter&) = delete;
+
+		[[nodiscard]] inline const std::string& Path() const
+		{
+			return path;
+		}
+
+		[[nodiscard]] inline uint32_t SectorOffset(size_t index) const
+		{
+			if (index >= CHUNKS_PER_REGION)
+				throw std::runtime_error("Chunk index out of range.");
+			return locations[index] >> 8;
+		}
+
+		[[nodiscard]] inline uint8_t SectorCount(size_t index) const
+		{
+			if (index >= CHUNKS_PER_REGION)
+				throw std::runtime_error("Chunk index out of range.");
+			return static_cast<uint8_t>(locations[index] & 0xFF);
+		}
+
+		[[nodiscard]] inline uint32_t Timestamp(size_t index) const
+		{
+			if (index >= CHUNKS_PER_REGION)
+				throw std::runtime_error("Chunk index out of range.");
+			return timestamps[index];
+		}
+
+		// Length of the file in sectors, including the header.
+		[[nodiscard]] inline size_t FileSectors() const
+		{
+			return sectorCount;
+		}
+
+		// Sectors written for chunk data since the file was opened.
+		[[nodiscard]] inline size_t SectorsWritten() const
+		{
+			return written;
+		}
+
+		[[nodiscard]] size_t FreeSectors() const;
+
+		// Stores an already compressed chunk payload, as produced by CompressChunk.
+		void WriteChunk(size_t index, std::span<const std::byte> payload, compression type, uint32_t timestamp);
+
+		// Serializes and compresses the chunk, then stores it.
+		void SaveChunk(size_t index, const nbt::NBTree& chunk, compression type, uint32_t timestamp);
+
+		void RemoveChunk(size_t index);
+
+		// Syncs the chunk data, writes the header in one go and syncs again.
+		// Then frees the sectors chunks moved out of and trims free sectors off the end of the file.
+		void Flush();
+
+	private:
+		std::string path;
+		int regionX = 0;
+		int regionZ = 0;
+#ifdef _WIN32
+		void* file = nullptr;
+#else
+		int fd = -1;
+#endif
+		uint32_t locations[CHUNKS_PER_REGION] = {};
+		uint32_t timestamps[CHUNKS_PER_REGION] = {};
+		// One bit per sector, set if it is in use.
+		std::vector<uint64_t> used;
+		size_t sectorCount = 0;
+		// Sector ranges given up since the last Flush, as offset << 8 | count.
+		std::vector<uint32_t> released;
+		// Chunks written since the last Flush whose .mcc file may now be stale.
+		std::vector<size_t> stale;
+		zlib::vector buffer;
+		zlib::vector serialized;
+		size_t written = 0;
+		bool dirty = false;
+
+		[[nodiscard]] bool IsUsed(size_t sector) const;
+		void Mark(size_t offset, size_t count, bool value);
+		// First fit. Sectors past the end of the file count as free.
+		[[nodiscard]] size_t Allocate(size_t count) const;
+
+		void ReadAt(void* data, size_t size, uint64_t offset);
+		void WriteAt(const void* data, size_t size, uint64_t offset);
+		void Sync();
+		void Truncate(uint64_t size);
+	};
+
+	// Decompresses a chunk payload of the given compression type into output, replacing its contents.
+	// Returns the decompressed size.
+	size_t DecompressChunk(std::span<const std::byte> payload, compression type, zlib::vector& output);
+
+	// Compresses serialized chunk NBT into a payload of the given compression type, replacing output's contents.
+	void CompressChunk(const char* data, size_t size, compression type, zlib::vector& output);
+
+	// Writes every chunk of source to a new region file, recompressed as type.
+	// Timestamps are kept. Chunks that don't fit in 255 sectors go to c.X.Z.mcc files next to filename.
+	// The file is written next to filename and flushed to disk first and then renamed over it. New .mcc files are renamed
+	// into place after it, and .mcc files of chunks that are no longer external are removed.
+	void WriteRegion(const std::string& filename, const RegionFile& source, compression type);
+
+	// The order compaction lays chunks out in.
+	// Morton (Z-order) keeps chunks that are close together in both directions close together on disk.
+	enum class chunk_order
+	{
+		ROW,
+		MORTON,
+	};
+
+	struct CompactOptions
+	{
+		chunk_order order = chunk_order::MORTON;
+		// Recompresses chunks that aren't stored as type already. Otherwise their payloads are copied as they are.
+		bool recompress = false;
+		compression type = compression::ZLIB;
+	};
+
+	// What compaction did. Locality is measured by reading the chunks in the chosen order:
+	// jumps counts the times the next chunk doesn't start where the last one ended,
+	// distance the sectors jumped over in total.
+	struct CompactResult
+	{
+		size_t regions = 0;
+		// Regions that weren't compact already and were written again.
+		size_t rewritten = 0;
+		size_t chunks = 0;
+		// Chunks that couldn't be read and were left out.
+		size_t dropped = 0;
+		uint64_t bytesBefore = 0;
+		uint64_t bytesAfter = 0;
+		uint64_t jumpsBefore = 0;
+		uint64_t jumpsAfter = 0;
+		uint64_t distanceBefore = 0;
+		uint64_t distanceAfter = 0;
+
+		[[nodiscard]] inline uint64_t BytesReclaimed() const
+		{
+			return bytesBefore > bytesAfter ? bytesBefore - bytesAfter : 0;
+		}
+
+		CompactResult& operator+=(const CompactResult& rhs);
+	};
+
+	// Rewrites the region with its chunks back to back in the chosen order, dropping dead sectors
+	// and trimming over-allocated ones. Regions that are already compact are left alone.
+	// The new region is written next to the old one, flushed to disk and renamed over it, so a crash leaves one or the other whole.
+	// Recompressed chunks that go to .mcc files are written under temporary names and renamed into place after the region.
+	CompactResult CompactRegion(const std::string& filename, const CompactOptions& options = {});
+
+	// Compacts every r.X.Z.mca file in the directory in parallel on ThreadPool::Shared().
+	CompactResult CompactRegions(const std::string& directory, const CompactOptions& options = {});
+}
+
+#pragma endregion [Region I/O]
+
+#endif // WORLDIO_HEADER_FILE
@@ -0,0 +1,54 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threads)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	workers.reserve(threads);
+	for (size_t i = 0; i < threads; i++)
+		workers.emplace_back(&ThreadPool::Run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	ready.notify_all();
+	for (std::thread& worker : workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::Push(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	ready.notify_one();
+}
+
+void ThreadPool::Run()
+{
+	for (;;)
+	{
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			ready.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+// A fixed set of worker threads pulling tasks off a shared queue.
+// Tasks must not block waiting on other tasks of the same pool, or a full pool can deadlock.
+class ThreadPool
+{
+public:
+	// 0 starts one thread per hardware thread.
+	explicit ThreadPool(size_t threads = 0);
+	// Runs every task that was already queued, then joins the workers.
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	template <typename F>
+	auto Submit(F&& task) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+	{
+		using R = std::invoke_result_t<std::decay_t<F>>;
+		auto packaged = std::make_shared<std::packaged_task<R()>>(std::forward<F>(task));
+		std::future<R> result = packaged->get_future();
+		Push([packaged]() { (*packaged)(); });
+		return result;
+	}
+
+	[[nodiscard]] inline size_t Size() const
+	{
+		return workers.size();
+	}
+
+	// A process wide pool with one thread per hardware thread, started on first use.
+	static ThreadPool& Shared();
+
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable ready;
+	bool stopping = false;
+
+	void Push(std::function<void()> task);
+	void Run();
+};
+
+#endif // THREAD_POOL_H
@@ -1,9 +1,24 @@
 #include "zlib_helper.h"
+#include "zlib_inflate.h"
+#include "thread_pool.h"
 #include <stdexcept>
+#include <cstring>
+#include <memory>
+#include <limits>
+#include <algorithm>
 #include <vector>
 #include <fstream>
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <zlib.h>
 
+#ifdef ANVIL_WITH_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
 zlib::vector zlib::Convert(const std::string& value)
 {
 	const zlib::byte* pointer = reinterpret_cast<const zlib::byte*>(value.data());
@@ -54,6 +69,13 @@ std::string zlib::Compress(const std::string& data, int type)
 //This is the preferred method of Compressing data.
 //It does not assume to much, and gives plents of options.
 zlib::vector zlib::Compress(const char* data, size_t size, int type)
+{
+	zlib::vector result;
+	zlib::GetCodec().Compress(data, size, type, result);
+	return result;
+}
+
+static zlib::vector DeflateStream(const char* data, size_t size, int type)
 {
 	z_stream strm{};
 	memset(&strm, 0, sizeof(strm));
@@ -120,55 +142,526 @@ std::string zlib::Decompress(const std::string& data, int type)
 
 zlib::vector zlib::Decompress(const char* data, size_t size, int type)
 {
-	z_stream strm{};
-	memset(&strm, 0, sizeof(strm));
-	strm.zalloc = Z_NULL;
-	strm.zfree = Z_NULL;
-	strm.opaque = Z_NULL;
+	zlib::vector result;
+	zlib::GetCodec().Decompress(data, size, type, result);
+	return result;
+}
+
+namespace
+{
+	// Deflate can reach back 32 KiB, so that much of the previous block is enough to prime the next one.
+	constexpr size_t WINDOW_SIZE = 32 * 1024;
+
+	// Shared between CompressParallel and its helper tasks, which may only get to run after it has returned.
+	struct ParallelDeflate
+	{
+		const char* data = nullptr;
+		size_t size = 0;
+		size_t blockSize = 0;
+		size_t blocks = 0;
+		bool gzip = false;
+
+		std::vector<zlib::vector> output;
+		std::vector<uLong> checks;
+
+		std::atomic<size_t> next = 0;
+		std::mutex mutex;
+		std::condition_variable done;
+		size_t finished = 0;
+		std::exception_ptr error;
+
+		void DeflateBlock(size_t index)
+		{
+			size_t offset = index * blockSize;
+			size_t length = std::min(blockSize, size - offset);
+			const Bytef* input = reinterpret_cast<const Bytef*>(data + offset);
+			bool last = index + 1 == blocks;
+
+			checks[index] = gzip ? crc32_z(0, input, length) : adler32_z(1, input, length);
+
+			z_stream strm{};
+			// Raw deflate, the header and trailer are written once for the whole stream.
+			if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+				throw std::runtime_error("deflateInit2 failed.");
+
+			if (offset > 0)
+			{
+				size_t dictionary = std::min(offset, WINDOW_SIZE);
+				deflateSetDictionary(&strm, input - dictionary, static_cast<uInt>(dictionary));
+			}
+
+			zlib::vector& result = output[index];
+			result.resize(deflateBound(&strm, static_cast<uLong>(length)) + 16);
+			strm.next_in = const_cast<Bytef*>(input);
+			strm.avail_in = static_cast<uInt>(length);
+			strm.next_out = reinterpret_cast<Bytef*>(result.data());
+			strm.avail_out = static_cast<uInt>(result.size());
+
+			// Every block but the last ends in a sync flush, which leaves it byte aligned and
+			// without the final block bit, so the blocks can simply be concatenated.
+			int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+			for (;;)
+			{
+				int ret = deflate(&strm, flush);
+				if (last ? ret == Z_STREAM_END : (ret == Z_OK && strm.avail_out != 0))
+					break;
+				if (ret != Z_OK && ret != Z_BUF_ERROR)
+				{
+					deflateEnd(&strm);
+					throw std::runtime_error("deflate failed.");
+				}
+				size_t used = result.size() - strm.avail_out;
+				result.resize(result.size() * 2);
+				strm.next_out = reinterpret_cast<Bytef*>(result.data() + used);
+				strm.avail_out = static_cast<uInt>(result.size() - used);
+			}
+			result.resize(result.size() - strm.avail_out);
+			deflateEnd(&strm);
+		}
+
+		// Claims and compresses blocks until there are none left.
+		void Work()
+		{
+			for (size_t index; (index = next.fetch_add(1)) < blocks; )
+			{
+				try
+				{
+					DeflateBlock(index);
+				}
+				catch (...)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					if (!error)
+						error = std::current_exception();
+				}
+
+				bool all;
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					all = ++finished == blocks;
+				}
+				if (all)
+					done.notify_all();
+			}
+		}
+	};
+}
+
+zlib::vector zlib::CompressParallel(const zlib::vector& data, int type)
+{
+	return zlib::CompressParallel(reinterpret_cast<const char*>(data.data()), data.size(), type);
+}
+
+zlib::vector zlib::CompressParallel(const char* data, size_t size, int type, size_t blockSize)
+{
+	// Smaller blocks would lose too much to the missing history.
+	blockSize = std::clamp(blockSize, WINDOW_SIZE, size_t(1) << 30);
+	if (size <= blockSize)
+		return zlib::Compress(data, size, type);
+
+	std::shared_ptr<ParallelDeflate> job = std::make_shared<ParallelDeflate>();
+	job->data = data;
+	job->size = size;
+	job->blockSize = blockSize;
+	job->blocks = (size + blockSize - 1) / blockSize;
+	job->gzip = type == zlib::GZIP;
+	job->output.resize(job->blocks);
+	job->checks.resize(job->blocks);
+
+	ThreadPool& pool = ThreadPool::Shared();
+	size_t helpers = std::min(pool.Size(), job->blocks - 1);
+	for (size_t i = 0; i < helpers; i++)
+		pool.Submit([job]() { job->Work(); });
+
+	job->Work();
+	{
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->done.wait(lock, [&job]() { return job->finished == job->blocks; });
+	}
+	if (job->error)
+		std::rethrow_exception(job->error);
+
+	uLong check = job->checks[0];
+	size_t total = 0;
+	for (size_t i = 0; i < job->blocks; i++)
+	{
+		if (i > 0)
+		{
+			z_off_t length = static_cast<z_off_t>(std::min(blockSize, size - i * blockSize));
+			check = job->gzip ? crc32_combine(check, job->checks[i], length) : adler32_combine(check, job->checks[i], length);
+		}
+		total += job->output[i].size();
+	}
+
+	zlib::vector result;
+	result.reserve(total + 18);
+	auto put = [&result](uint8_t value) { result.push_back(static_cast<std::byte>(value)); };
+
+	if (job->gzip)
+	{
+		// No name, no mtime, unknown OS.
+		for (uint8_t value : { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff })
+			put(value);
+	}
+	else
+	{
+		// 32 KiB window, default level.
+		put(0x78);
+		put(0x9c);
+	}
 
+	for (const zlib::vector& block : job->output)
+		result.insert(result.end(), block.begin(), block.end());
+
+	if (job->gzip)
+	{
+		for (int shift = 0; shift < 32; shift += 8)
+			put(static_cast<uint8_t>(check >> shift));
+		for (int shift = 0; shift < 32; shift += 8)
+			put(static_cast<uint8_t>(size >> shift));
+	}
+	else
+	{
+		for (int shift = 24; shift >= 0; shift -= 8)
+			put(static_cast<uint8_t>(check >> shift));
+	}
+	return result;
+}
+
+static size_t GuessInflatedSize(const char* data, size_t size)
+{
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+	// Gzip streams end with the uncompressed size modulo 2^32.
+	if (size >= 18 && bytes[0] == 0x1f && bytes[1] == 0x8b)
+	{
+		size_t isize =
+			static_cast<size_t>(bytes[size - 4]) |
+			static_cast<size_t>(bytes[size - 3]) << 8 |
+			static_cast<size_t>(bytes[size - 2]) << 16 |
+			static_cast<size_t>(bytes[size - 1]) << 24;
+		// DEFLATE can't do better than about 1032:1, so anything larger is a corrupt trailer.
+		if (isize != 0 && isize <= size * 1032)
+			return isize;
+	}
+	// NBT usually compresses somewhere around 4:1.
+	return std::max(size * 4, zlib::CHUNK_SIZE);
+}
+
+zlib::Inflater::Inflater(int type) : stream(std::make_unique<z_stream>())
+{
+	SetType(type);
+	stream->zalloc = Z_NULL;
+	stream->zfree = Z_NULL;
+	stream->opaque = Z_NULL;
+	stream->next_in = Z_NULL;
+	stream->avail_in = 0;
+	if (inflateInit2(stream.get(), window) != Z_OK)
+	{
+		throw std::runtime_error("inflateInit2 failed.");
+	}
+}
+
+zlib::Inflater::~Inflater()
+{
+	if (stream)
+		inflateEnd(stream.get());
+}
+
+// The z_stream is heap allocated because zlib's internal state points back at it,
+// so moving only hands over the pointer.
+zlib::Inflater::Inflater(Inflater&& rhs) noexcept = default;
+
+zlib::Inflater& zlib::Inflater::operator=(Inflater&& rhs) noexcept
+{
+	if (this != &rhs)
+	{
+		if (stream)
+			inflateEnd(stream.get());
+		stream = std::move(rhs.stream);
+		window = rhs.window;
+	}
+	return *this;
+}
+
+void zlib::Inflater::SetType(int type)
+{
 	switch (type)
 	{
 	case zlib::ZLIB:
 	case zlib::GZIP:
+		window = type;
 		break;
 	default:
-		type = zlib::ZLIB;
+		window = zlib::ZLIB;
 	}
+}
 
-	if (inflateInit2(&strm, type) != Z_OK)
+void zlib::Inflater::Begin(const char* data, size_t size)
+{
+	if (!stream)
+		throw std::runtime_error("Inflater has been moved from.");
+	if (inflateReset2(stream.get(), window) != Z_OK)
+		throw std::runtime_error("inflateReset2 failed.");
+	if (size > std::numeric_limits<uInt>::max())
+		throw std::runtime_error("Input is too large.");
+	stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+	stream->avail_in = static_cast<uInt>(size);
+}
+
+size_t zlib::Inflater::Decompress(const char* data, size_t size, zlib::vector& output, size_t sizeHint)
+{
+	Begin(data, size);
+
+	if (sizeHint == 0)
+		sizeHint = GuessInflatedSize(data, size);
+	// One extra byte so that a correct hint finishes without a second call to inflate.
+	// A reused buffer only reallocates when the guess outgrows its capacity.
+	if (output.size() < sizeHint + 1)
+		output.resize(sizeHint + 1);
+
+	size_t written = 0;
+	for (;;)
 	{
-		throw std::runtime_error("inflateInit2 failed.");
+		// Use up the capacity already there before doubling it.
+		if (written == output.size())
+			output.resize(std::max(output.capacity(), output.size() * 2));
+
+		size_t room = std::min<size_t>(output.size() - written, std::numeric_limits<uInt>::max());
+		stream->next_out = reinterpret_cast<Bytef*>(output.data() + written);
+		stream->avail_out = static_cast<uInt>(room);
+
+		// Z_FINISH lets inflate skip maintaining its sliding window when the output fits.
+		int ret = inflate(stream.get(), Z_FINISH);
+		written += room - stream->avail_out;
+
+		if (ret == Z_STREAM_END)
+			break;
+		if ((ret == Z_OK || ret == Z_BUF_ERROR) && stream->avail_out == 0)
+			continue;
+
+		output.clear();
+		throw std::runtime_error(ret == Z_BUF_ERROR ? "Compressed data is truncated." : "Failed at the end or something.");
 	}
 
-	strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
-	strm.avail_in = size;
+	output.resize(written);
+	return written;
+}
 
-	int ret;
-	std::unique_ptr<std::byte[]> outbuffer = std::make_unique<std::byte[]>(zlib::CHUNK_SIZE);
-	std::string outstring;
-	std::vector<std::byte> result;
-	do
+size_t zlib::Inflater::Decompress(const char* data, size_t size, zlib::byte* output, size_t capacity)
+{
+	Begin(data, size);
+
+	size_t written = 0;
+	for (;;)
 	{
-		strm.next_out = reinterpret_cast<Bytef*>(&outbuffer[0]);
-		strm.avail_out = zlib::CHUNK_SIZE;
+		size_t room = std::min<size_t>(capacity - written, std::numeric_limits<uInt>::max());
+		stream->next_out = reinterpret_cast<Bytef*>(output + written);
+		stream->avail_out = static_cast<uInt>(room);
 
-		ret = inflate(&strm, 0);
+		int ret = inflate(stream.get(), Z_FINISH);
+		written += room - stream->avail_out;
 
-		if (result.size() < strm.total_out)
+		if (ret == Z_STREAM_END)
+			return written;
+		if ((ret == Z_OK || ret == Z_BUF_ERROR) && stream->avail_out == 0 && written < capacity)
+			continue;
+
+		if (written == capacity)
+			throw std::runtime_error("Output buffer is too small.");
+		throw std::runtime_error(ret == Z_BUF_ERROR ? "Compressed data is truncated." : "Failed at the end or something.");
+	}
+}
+
+zlib::vector zlib::Inflater::Decompress(const char* data, size_t size, size_t sizeHint)
+{
+	zlib::vector result;
+	Decompress(data, size, result, sizeHint);
+	return result;
+}
+
+namespace
+{
+	class StreamCodec : public zlib::Codec
+	{
+	public:
+		const char* Name() const override
 		{
-			int write_size = strm.total_out - result.size();
-			result.insert(result.end(), &outbuffer[0], &outbuffer[write_size]);
+			return "zlib";
+		}
+
+		void Compress(const char* data, size_t size, int type, zlib::vector& output) const override
+		{
+			output = DeflateStream(data, size, type);
+		}
+
+		size_t Decompress(const char* data, size_t size, int type, zlib::vector& output, size_t sizeHint) const override
+		{
+			// Reuse one inflate state per thread instead of setting one up for every call.
+			thread_local zlib::Inflater inflater;
+			inflater.SetType(type);
+			return inflater.Decompress(data, size, output, sizeHint);
+		}
+	};
+
+	class BuiltinCodec : public zlib::Codec
+	{
+	public:
+		const char* Name() const override
+		{
+			return "builtin";
+		}
+
+		void Compress(const char* data, size_t size, int type, zlib::vector& output) const override
+		{
+			output = DeflateStream(data, size, type);
 		}
-	} while (ret == Z_OK);
 
-	inflateEnd(&strm);
+		size_t Decompress(const char* data, size_t size, int type, zlib::vector& output, size_t sizeHint) const override
+		{
+			return zlib::InflateBuffer(data, size, type, output, sizeHint);
+		}
+	};
+
+#ifdef ANVIL_WITH_LIBDEFLATE
+	class LibdeflateCodec : public zlib::Codec
+	{
+	public:
+		const char* Name() const override
+		{
+			return "libdeflate";
+		}
+
+		void Compress(const char* data, size_t size, int type, zlib::vector& output) const override
+		{
+			thread_local std::unique_ptr<libdeflate_compressor, decltype(&libdeflate_free_compressor)> compressor(
+				libdeflate_alloc_compressor(6), &libdeflate_free_compressor);
+			if (!compressor)
+				throw std::runtime_error("libdeflate_alloc_compressor failed.");
+
+			bool gzip = type == zlib::GZIP;
+			size_t bound = gzip
+				? libdeflate_gzip_compress_bound(compressor.get(), size)
+				: libdeflate_zlib_compress_bound(compressor.get(), size);
+			output.resize(bound);
+			size_t written = gzip
+				? libdeflate_gzip_compress(compressor.get(), data, size, output.data(), output.size())
+				: libdeflate_zlib_compress(compressor.get(), data, size, output.data(), output.size());
+			if (written == 0)
+				throw std::runtime_error("libdeflate compression failed.");
+			output.resize(written);
+		}
+
+		size_t Decompress(const char* data, size_t size, int type, zlib::vector& output, size_t sizeHint) const override
+		{
+			thread_local std::unique_ptr<libdeflate_decompressor, decltype(&libdeflate_free_decompressor)> decompressor(
+				libdeflate_alloc_decompressor(), &libdeflate_free_decompressor);
+			if (!decompressor)
+				throw std::runtime_error("libdeflate_alloc_decompressor failed.");
+
+			const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+			bool gzip = type == zlib::GZIP || (size >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b);
+			size_t capacity = sizeHint;
+			if (capacity == 0)
+				capacity = std::max({ size * 4, zlib::CHUNK_SIZE, output.capacity() });
+
+			for (;;)
+			{
+				output.resize(capacity);
+				size_t actual = 0;
+				libdeflate_result result = gzip
+					? libdeflate_gzip_decompress(decompressor.get(), data, size, output.data(), output.size(), &actual)
+					: libdeflate_zlib_decompress(decompressor.get(), data, size, output.data(), output.size(), &actual);
+				if (result == LIBDEFLATE_SUCCESS)
+				{
+					output.resize(actual);
+					return actual;
+				}
+				if (result != LIBDEFLATE_INSUFFICIENT_SPACE)
+				{
+					output.clear();
+					throw std::runtime_error("libdeflate decompression failed.");
+				}
+				capacity *= 2;
+			}
+		}
+	};
+#endif
 
-	if (ret != Z_STREAM_END)
+	zlib::backend InitialBackend()
 	{
-		throw std::runtime_error("Failed at the end or something.");
+		zlib::backend value = zlib::backend::BUILTIN;
+		const char* name = std::getenv("ANVIL_ZLIB_BACKEND");
+		if (name != nullptr)
+		{
+			std::string_view view(name);
+			if (view == "zlib")
+				value = zlib::backend::ZLIB;
+#ifdef ANVIL_WITH_LIBDEFLATE
+			else if (view == "libdeflate")
+				value = zlib::backend::LIBDEFLATE;
+#endif
+		}
+		return value;
 	}
 
+	std::atomic<zlib::backend>& SelectedBackend()
+	{
+		static std::atomic<zlib::backend> selected(InitialBackend());
+		return selected;
+	}
+}
 
-	return result;
+bool zlib::SetBackend(zlib::backend value)
+{
+	if (zlib::GetCodec(value) == nullptr)
+		return false;
+	SelectedBackend().store(value, std::memory_order_relaxed);
+	return true;
 }
 
+bool zlib::SetBackend(std::string_view name)
+{
+	if (name == "zlib")
+		return zlib::SetBackend(zlib::backend::ZLIB);
+	if (name == "builtin")
+		return zlib::SetBackend(zlib::backend::BUILTIN);
+	if (name == "libdeflate")
+		return zlib::SetBackend(zlib::backend::LIBDEFLATE);
+	return false;
+}
+
+zlib::backend zlib::GetBackend()
+{
+	return SelectedBackend().load(std::memory_order_relaxed);
+}
+
+const zlib::Codec& zlib::GetCodec()
+{
+	return *zlib::GetCodec(zlib::GetBackend());
+}
+
+const zlib::Codec* zlib::GetCodec(zlib::backend value)
+{
+	switch (value)
+	{
+	case zlib::backend::ZLIB:
+	{
+		static const StreamCodec codec;
+		return &codec;
+	}
+	case zlib::backend::BUILTIN:
+	{
+		static const BuiltinCodec codec;
+		return &codec;
+	}
+#ifdef ANVIL_WITH_LIBDEFLATE
+	case zlib::backend::LIBDEFLATE:
+	{
+		static const LibdeflateCodec codec;
+		return &codec;
+	}
+#endif
+	default:
+		return nullptr;
+	}
+}
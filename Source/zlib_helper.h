@@ -4,6 +4,10 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <memory>
+#include <string_view>
+
+struct z_stream_s;
 
 // 256k
 #define BUFFER_CHUNK_SIZE 262144
@@ -35,6 +39,92 @@ namespace zlib
 
 	std::string Compress(const std::string& data, int type = zlib::ZLIB);
 	std::string Decompress(const std::string& data, int type = zlib::ZLIB);
+
+	// pigz's default block size.
+	constexpr size_t PARALLEL_BLOCK_SIZE = 128 * 1024;
+
+	// Splits the input into blocks, deflates them on ThreadPool::Shared() and stitches them into one
+	// zlib or gzip stream that any decoder can read. Each block is primed with the 32 KiB of input
+	// before it, so the ratio stays close to Compress. Meant for large trees like level.dat or schematics.
+	// The calling thread compresses blocks too, so it is fine to call this from a pool task.
+	zlib::vector CompressParallel(const char* data, size_t size, int type = zlib::ZLIB, size_t blockSize = zlib::PARALLEL_BLOCK_SIZE);
+	zlib::vector CompressParallel(const zlib::vector& data, int type = zlib::ZLIB);
+
+	// Keeps a single inflate state alive across calls so that decompressing
+	// many small buffers (such as region chunks) doesn't pay for inflateInit2/inflateEnd
+	// and a fresh output buffer every time.
+	// An Inflater is not thread safe, use one per thread.
+	class Inflater
+	{
+	public:
+		Inflater(int type = zlib::ZLIB);
+		~Inflater();
+
+		Inflater(const Inflater&) = delete;
+		Inflater& operator=(const Inflater&) = delete;
+		Inflater(Inflater&& rhs) noexcept;
+		Inflater& operator=(Inflater&& rhs) noexcept;
+
+		// Changes the stream format used by the next call to Decompress.
+		void SetType(int type);
+
+		// Decompresses into output, replacing its contents but reusing its capacity.
+		// sizeHint is the expected decompressed size. When it is right the whole
+		// buffer is inflated in a single pass. 0 guesses from the input alone,
+		// a gzip trailer's size or a multiple of the compressed size.
+		// Returns the decompressed size.
+		size_t Decompress(const char* data, size_t size, zlib::vector& output, size_t sizeHint = 0);
+
+		// Decompresses into a caller owned buffer (an arena for example).
+		// Throws if the output does not fit in capacity.
+		// Returns the decompressed size.
+		size_t Decompress(const char* data, size_t size, zlib::byte* output, size_t capacity);
+
+		zlib::vector Decompress(const char* data, size_t size, size_t sizeHint = 0);
+
+	private:
+		std::unique_ptr<z_stream_s> stream;
+		int window = zlib::ZLIB;
+
+		void Begin(const char* data, size_t size);
+	};
+
+	// A compression backend behind zlib::Compress and zlib::Decompress.
+	// Codecs work on whole buffers and must be safe to call from several threads at once.
+	class Codec
+	{
+	public:
+		virtual ~Codec() = default;
+
+		[[nodiscard]] virtual const char* Name() const = 0;
+
+		// Compresses into output, replacing its contents.
+		virtual void Compress(const char* data, size_t size, int type, zlib::vector& output) const = 0;
+
+		// Decompresses into output, replacing its contents. sizeHint works like it does for Inflater.
+		// Returns the decompressed size.
+		virtual size_t Decompress(const char* data, size_t size, int type, zlib::vector& output, size_t sizeHint = 0) const = 0;
+	};
+
+	enum class backend
+	{
+		ZLIB,		// Streaming zlib, for both directions.
+		BUILTIN,	// The whole-buffer decoder in zlib_inflate.cpp, zlib for compression.
+		LIBDEFLATE,	// libdeflate, only available when built with ANVIL_WITH_LIBDEFLATE.
+	};
+
+	// Selects the codec used by Compress and Decompress for every thread.
+	// Returns false, leaving the selection alone, if the backend isn't available in this build.
+	// The starting backend can be picked with the ANVIL_ZLIB_BACKEND environment variable
+	// ("zlib", "builtin" or "libdeflate") so runs can be compared without rebuilding.
+	bool SetBackend(zlib::backend value);
+	bool SetBackend(std::string_view name);
+	zlib::backend GetBackend();
+
+	// The codec for the selected backend.
+	const zlib::Codec& GetCodec();
+	// The codec for a specific backend, nullptr if it isn't available in this build.
+	const zlib::Codec* GetCodec(zlib::backend value);
 }
 
 #endif // ZLIB_HELPER_H
@@ -0,0 +1,655 @@
+#include "zlib_inflate.h"
+#include <stdexcept>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <bit>
+#include <zlib.h>
+
+// https://www.rfc-editor.org/rfc/rfc1951 (DEFLATE)
+// https://www.rfc-editor.org/rfc/rfc1950 (zlib)
+// https://www.rfc-editor.org/rfc/rfc1952 (gzip)
+
+namespace
+{
+	// A decode table entry, laid out like zlib's inftrees "code".
+	struct entry
+	{
+		uint8_t op;
+		uint8_t bits;
+		uint16_t val;
+	};
+
+	enum : uint8_t
+	{
+		OP_LITERAL = 0,
+		// Length or distance base, the low 4 bits hold the number of extra bits.
+		OP_BASE = 16,
+		OP_END = 32,
+		// val is the offset of a sub table, bits is the number of bits that index it.
+		OP_SUBTABLE = 64,
+		OP_INVALID = 128,
+	};
+
+	constexpr int MAX_CODE_BITS = 15;
+	constexpr int LITLEN_BITS = 11;
+	constexpr int DIST_BITS = 8;
+	constexpr int PRECODE_BITS = 7;
+
+	constexpr int LITLEN_SYMBOLS = 288;
+	constexpr int DIST_SYMBOLS = 32;
+	constexpr int PRECODE_SYMBOLS = 19;
+
+	// Every code longer than the primary table gets a sub table of at most 2^(15 - primary) entries.
+	constexpr size_t LITLEN_TABLE_SIZE = (1 << LITLEN_BITS) + LITLEN_SYMBOLS * (1 << (MAX_CODE_BITS - LITLEN_BITS));
+	constexpr size_t DIST_TABLE_SIZE = (1 << DIST_BITS) + DIST_SYMBOLS * (1 << (MAX_CODE_BITS - DIST_BITS));
+	constexpr size_t PRECODE_TABLE_SIZE = 1 << PRECODE_BITS;
+
+	// Matches are copied 8 bytes at a time and may write up to 15 bytes past their end.
+	constexpr size_t OUTPUT_SLACK = 16;
+
+	constexpr uint16_t LENGTH_BASE[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	constexpr uint8_t LENGTH_EXTRA[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	constexpr uint16_t DIST_BASE[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	constexpr uint8_t DIST_EXTRA[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+	constexpr uint8_t PRECODE_ORDER[PRECODE_SYMBOLS] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+	enum class table_kind { LITLEN, DIST, PRECODE };
+
+	entry MakeEntry(table_kind kind, int symbol, int bits)
+	{
+		entry e{ OP_INVALID, static_cast<uint8_t>(bits), 0 };
+		switch (kind)
+		{
+		case table_kind::LITLEN:
+			if (symbol < 256)
+				e = entry{ OP_LITERAL, e.bits, static_cast<uint16_t>(symbol) };
+			else if (symbol == 256)
+				e = entry{ OP_END, e.bits, 0 };
+			else if (symbol < 286)
+				e = entry{ static_cast<uint8_t>(OP_BASE | LENGTH_EXTRA[symbol - 257]), e.bits, LENGTH_BASE[symbol - 257] };
+			break;
+		case table_kind::DIST:
+			if (symbol < 30)
+				e = entry{ static_cast<uint8_t>(OP_BASE | DIST_EXTRA[symbol]), e.bits, DIST_BASE[symbol] };
+			break;
+		case table_kind::PRECODE:
+			e = entry{ OP_LITERAL, e.bits, static_cast<uint16_t>(symbol) };
+			break;
+		}
+		return e;
+	}
+
+	// Builds a two level lookup table for a canonical Huffman code.
+	// Codes of up to primary bits resolve in one lookup, longer codes go through a sub table.
+	// Incomplete codes are allowed, their unused entries decode as OP_INVALID.
+	void BuildTable(const uint8_t* lengths, int symbols, int primary, table_kind kind, entry* table)
+	{
+		uint16_t count[MAX_CODE_BITS + 1] = {};
+		for (int s = 0; s < symbols; s++)
+			count[lengths[s]]++;
+		count[0] = 0;
+
+		int left = 1;
+		for (int len = 1; len <= MAX_CODE_BITS; len++)
+		{
+			left = (left << 1) - count[len];
+			if (left < 0)
+				throw std::runtime_error("Invalid Huffman code (over-subscribed).");
+		}
+
+		uint16_t next[MAX_CODE_BITS + 1] = {};
+		uint16_t code = 0;
+		for (int len = 1; len <= MAX_CODE_BITS; len++)
+		{
+			code = static_cast<uint16_t>((code + count[len - 1]) << 1);
+			next[len] = code;
+		}
+
+		// DEFLATE sends codes most significant bit first, so the table is indexed by the reversed code.
+		uint16_t reversed[LITLEN_SYMBOLS];
+		for (int s = 0; s < symbols; s++)
+		{
+			int len = lengths[s];
+			if (len == 0)
+				continue;
+			uint16_t c = next[len]++;
+			uint16_t r = 0;
+			for (int i = 0; i < len; i++)
+			{
+				r = static_cast<uint16_t>((r << 1) | (c & 1));
+				c >>= 1;
+			}
+			reversed[s] = r;
+		}
+
+		const size_t primarySize = size_t(1) << primary;
+		const uint16_t primaryMask = static_cast<uint16_t>(primarySize - 1);
+		for (size_t i = 0; i < primarySize; i++)
+			table[i] = entry{ OP_INVALID, 0, 0 };
+
+		// Size every sub table by the longest code that shares its prefix.
+		uint8_t longest[1 << LITLEN_BITS] = {};
+		for (int s = 0; s < symbols; s++)
+		{
+			if (lengths[s] > primary)
+			{
+				uint8_t& l = longest[reversed[s] & primaryMask];
+				l = std::max(l, lengths[s]);
+			}
+		}
+		size_t offset = primarySize;
+		for (size_t p = 0; p < primarySize; p++)
+		{
+			if (longest[p] == 0)
+				continue;
+			int subBits = longest[p] - primary;
+			table[p] = entry{ OP_SUBTABLE, static_cast<uint8_t>(subBits), static_cast<uint16_t>(offset) };
+			for (size_t i = 0; i < (size_t(1) << subBits); i++)
+				table[offset + i] = entry{ OP_INVALID, 0, 0 };
+			offset += size_t(1) << subBits;
+		}
+
+		for (int s = 0; s < symbols; s++)
+		{
+			int len = lengths[s];
+			if (len == 0)
+				continue;
+			if (len <= primary)
+			{
+				entry e = MakeEntry(kind, s, len);
+				for (size_t i = reversed[s]; i < primarySize; i += size_t(1) << len)
+					table[i] = e;
+			}
+			else
+			{
+				const entry& sub = table[reversed[s] & primaryMask];
+				entry e = MakeEntry(kind, s, len - primary);
+				for (size_t i = reversed[s] >> primary; i < (size_t(1) << sub.bits); i += size_t(1) << (len - primary))
+					table[sub.val + i] = e;
+			}
+		}
+	}
+
+	struct fixed_tables
+	{
+		entry litlen[LITLEN_TABLE_SIZE];
+		entry dist[DIST_TABLE_SIZE];
+
+		fixed_tables()
+		{
+			uint8_t lengths[LITLEN_SYMBOLS];
+			std::fill(lengths, lengths + 144, uint8_t(8));
+			std::fill(lengths + 144, lengths + 256, uint8_t(9));
+			std::fill(lengths + 256, lengths + 280, uint8_t(7));
+			std::fill(lengths + 280, lengths + 288, uint8_t(8));
+			BuildTable(lengths, LITLEN_SYMBOLS, LITLEN_BITS, table_kind::LITLEN, litlen);
+			std::fill(lengths, lengths + DIST_SYMBOLS, uint8_t(5));
+			BuildTable(lengths, DIST_SYMBOLS, DIST_BITS, table_kind::DIST, dist);
+		}
+	};
+
+	inline uint64_t Load64LE(const uint8_t* p)
+	{
+		uint64_t value;
+		std::memcpy(&value, p, 8);
+		if constexpr (std::endian::native == std::endian::big)
+			value = ((value & 0x00000000000000FFull) << 56) | ((value & 0x000000000000FF00ull) << 40) |
+					((value & 0x0000000000FF0000ull) << 24) | ((value & 0x00000000FF000000ull) << 8) |
+					((value & 0x000000FF00000000ull) >> 8) | ((value & 0x0000FF0000000000ull) >> 24) |
+					((value & 0x00FF000000000000ull) >> 40) | ((value & 0xFF00000000000000ull) >> 56);
+		return value;
+	}
+
+	// Skips the gzip header and returns a pointer to the DEFLATE data.
+	const uint8_t* SkipGzipHeader(const uint8_t* in, const uint8_t* end)
+	{
+		if (end - in < 18 || in[2] != 8)
+			throw std::runtime_error("Invalid gzip header.");
+		uint8_t flags = in[3];
+		in += 10;
+		if (flags & 0x04)
+		{
+			// FEXTRA
+			if (end - in < 2)
+				throw std::runtime_error("Invalid gzip header.");
+			size_t extra = size_t(in[0]) | size_t(in[1]) << 8;
+			in += 2;
+			if (size_t(end - in) < extra)
+				throw std::runtime_error("Invalid gzip header.");
+			in += extra;
+		}
+		for (uint8_t text : { uint8_t(0x08), uint8_t(0x10) })
+		{
+			// FNAME and FCOMMENT are zero terminated.
+			if (flags & text)
+			{
+				const uint8_t* zero = static_cast<const uint8_t*>(std::memchr(in, 0, end - in));
+				if (zero == nullptr)
+					throw std::runtime_error("Invalid gzip header.");
+				in = zero + 1;
+			}
+		}
+		if (flags & 0x02)
+		{
+			// FHCRC
+			if (end - in < 2)
+				throw std::runtime_error("Invalid gzip header.");
+			in += 2;
+		}
+		if (end - in < 8)
+			throw std::runtime_error("Invalid gzip header.");
+		return in;
+	}
+}
+
+size_t zlib::InflateBuffer(const char* data, size_t size, int type, zlib::vector& output, size_t sizeHint)
+{
+	const uint8_t* const begin = reinterpret_cast<const uint8_t*>(data);
+	const uint8_t* const end = begin + size;
+	const uint8_t* in = begin;
+
+	bool gzip = size >= 2 && begin[0] == 0x1f && begin[1] == 0x8b;
+	if (gzip)
+	{
+		in = SkipGzipHeader(in, end);
+		// The trailer holds the uncompressed size, but it can't be trusted past DEFLATE's best ratio.
+		size_t isize = size_t(end[-4]) | size_t(end[-3]) << 8 | size_t(end[-2]) << 16 | size_t(end[-1]) << 24;
+		if (sizeHint == 0 && isize <= size * 1032)
+			sizeHint = isize;
+	}
+	else
+	{
+		if (type == zlib::GZIP)
+			throw std::runtime_error("Not a gzip stream.");
+		if (size < 6 || (begin[0] & 0x0F) != 8 || (begin[0] >> 4) > 7 || ((begin[0] << 8) | begin[1]) % 31 != 0)
+			throw std::runtime_error("Invalid zlib header.");
+		if (begin[1] & 0x20)
+			throw std::runtime_error("Preset dictionaries are not supported.");
+		in += 2;
+	}
+	if (sizeHint == 0)
+		sizeHint = std::max(size * 4, zlib::CHUNK_SIZE);
+
+	// A reused buffer only reallocates when the guess outgrows its capacity.
+	output.resize(sizeHint + OUTPUT_SLACK);
+	uint8_t* obegin = reinterpret_cast<uint8_t*>(output.data());
+	uint8_t* out = obegin;
+	uint8_t* oend = obegin + sizeHint;
+
+	auto grow = [&](size_t needed)
+	{
+		size_t written = out - obegin;
+		// Use up the capacity already there before doubling it.
+		size_t capacity = output.capacity() - OUTPUT_SLACK;
+		if (capacity < written + needed || capacity <= size_t(oend - obegin))
+			capacity = std::max((oend - obegin) * size_t(2), written + needed);
+		output.resize(capacity + OUTPUT_SLACK);
+		obegin = reinterpret_cast<uint8_t*>(output.data());
+		out = obegin + written;
+		oend = obegin + capacity;
+	};
+
+	uint64_t bitbuf = 0;
+	unsigned bitcount = 0;
+	// Zero bytes fed to the bit buffer past the end of the input.
+	// Consuming any of them means the stream was truncated.
+	size_t padding = 0;
+
+	auto refill = [&]()
+	{
+		if (end - in >= 8)
+		{
+			// Bits above bitcount are left holding the next input bytes,
+			// which is harmless because the next refill ORs in the same bits.
+			bitbuf |= Load64LE(in) << bitcount;
+			in += (63 - bitcount) >> 3;
+			bitcount |= 56;
+		}
+		else
+		{
+			while (bitcount <= 56)
+			{
+				uint64_t next = 0;
+				if (in < end)
+					next = *in++;
+				else
+					padding++;
+				bitbuf |= next << bitcount;
+				bitcount += 8;
+			}
+			if (padding > 16)
+				throw std::runtime_error("Compressed data is truncated.");
+		}
+	};
+
+	auto bits = [&](unsigned count) -> uint32_t
+	{
+		return static_cast<uint32_t>(bitbuf & ((uint64_t(1) << count) - 1));
+	};
+
+	auto consume = [&](unsigned count)
+	{
+		bitbuf >>= count;
+		bitcount -= count;
+	};
+
+	// Drops to the next byte boundary and hands back the unconsumed bytes in the bit buffer.
+	auto align = [&]()
+	{
+		consume(bitcount & 7);
+		size_t buffered = bitcount >> 3;
+		if (buffered < padding)
+			throw std::runtime_error("Compressed data is truncated.");
+		in -= buffered - padding;
+		bitbuf = 0;
+		bitcount = 0;
+		padding = 0;
+	};
+
+	static const fixed_tables fixed;
+	entry litlenTable[LITLEN_TABLE_SIZE];
+	entry distTable[DIST_TABLE_SIZE];
+
+	bool last = false;
+	while (!last)
+	{
+		refill();
+		last = bits(1) != 0;
+		uint32_t blockType = (bitbuf >> 1) & 3;
+		consume(3);
+
+		const entry* litlen = litlenTable;
+		const entry* dist = distTable;
+
+		if (blockType == 0)
+		{
+			// Stored block.
+			align();
+			if (end - in < 4)
+				throw std::runtime_error("Compressed data is truncated.");
+			size_t length = size_t(in[0]) | size_t(in[1]) << 8;
+			size_t nlength = size_t(in[2]) | size_t(in[3]) << 8;
+			in += 4;
+			if (length != (~nlength & 0xFFFF))
+				throw std::runtime_error("Invalid stored block length.");
+			if (size_t(end - in) < length)
+				throw std::runtime_error("Compressed data is truncated.");
+			if (size_t(oend - out) < length)
+				grow(length);
+			std::memcpy(out, in, length);
+			out += length;
+			in += length;
+			continue;
+		}
+		else if (blockType == 1)
+		{
+			litlen = fixed.litlen;
+			dist = fixed.dist;
+		}
+		else if (blockType == 2)
+		{
+			uint32_t hlit = bits(5) + 257;
+			uint32_t hdist = (bits(10) >> 5) + 1;
+			uint32_t hclen = (bits(14) >> 10) + 4;
+			consume(14);
+			if (hlit > 286 || hdist > 30)
+				throw std::runtime_error("Invalid dynamic block header.");
+
+			uint8_t precodeLengths[PRECODE_SYMBOLS] = {};
+			for (uint32_t i = 0; i < hclen; i++)
+			{
+				if (bitcount < 3)
+					refill();
+				precodeLengths[PRECODE_ORDER[i]] = static_cast<uint8_t>(bits(3));
+				consume(3);
+			}
+			entry precode[PRECODE_TABLE_SIZE];
+			BuildTable(precodeLengths, PRECODE_SYMBOLS, PRECODE_BITS, table_kind::PRECODE, precode);
+
+			uint8_t lengths[LITLEN_SYMBOLS + DIST_SYMBOLS] = {};
+			uint32_t count = 0;
+			while (count < hlit + hdist)
+			{
+				refill();
+				entry e = precode[bits(PRECODE_BITS)];
+				if (e.op == OP_INVALID)
+					throw std::runtime_error("Invalid code lengths.");
+				consume(e.bits);
+				uint32_t repeat = 0;
+				uint8_t value = 0;
+				if (e.val < 16)
+				{
+					lengths[count++] = static_cast<uint8_t>(e.val);
+					continue;
+				}
+				else if (e.val == 16)
+				{
+					if (count == 0)
+						throw std::runtime_error("Invalid code lengths.");
+					value = lengths[count - 1];
+					repeat = 3 + bits(2);
+					consume(2);
+				}
+				else if (e.val == 17)
+				{
+					repeat = 3 + bits(3);
+					consume(3);
+				}
+				else
+				{
+					repeat = 11 + bits(7);
+					consume(7);
+				}
+				if (count + repeat > hlit + hdist)
+					throw std::runtime_error("Invalid code lengths.");
+				std::memset(lengths + count, value, repeat);
+				count += repeat;
+			}
+			if (lengths[256] == 0)
+				throw std::runtime_error("Missing end of block code.");
+
+			BuildTable(lengths, hlit, LITLEN_BITS, table_kind::LITLEN, litlenTable);
+			BuildTable(lengths + hlit, hdist, DIST_BITS, table_kind::DIST, distTable);
+		}
+		else
+		{
+			throw std::runtime_error("Invalid block type.");
+		}
+
+		// Every iteration needs at most 15 + 5 + 15 + 13 = 48 bits, which one refill always provides.
+		for (;;)
+		{
+			// Fast path: with 16 bytes of input and room for the longest match left,
+			// refills are a single unaligned load and nothing else needs a bounds check.
+			if (end - in >= 16 && oend - out >= 258)
+			{
+				bitbuf |= Load64LE(in) << bitcount;
+				in += (63 - bitcount) >> 3;
+				bitcount |= 56;
+
+				entry e = litlen[bitbuf & ((1 << LITLEN_BITS) - 1)];
+				if (e.op == OP_LITERAL)
+				{
+					// At least 41 bits are left, enough for a second literal without refilling.
+					bitbuf >>= e.bits;
+					bitcount -= e.bits;
+					*out++ = static_cast<uint8_t>(e.val);
+					e = litlen[bitbuf & ((1 << LITLEN_BITS) - 1)];
+					if (e.op == OP_LITERAL)
+					{
+						bitbuf >>= e.bits;
+						bitcount -= e.bits;
+						*out++ = static_cast<uint8_t>(e.val);
+					}
+					continue;
+				}
+				if (e.op & OP_SUBTABLE)
+				{
+					consume(LITLEN_BITS);
+					e = litlen[e.val + bits(e.bits)];
+					if (e.op == OP_LITERAL)
+					{
+						consume(e.bits);
+						*out++ = static_cast<uint8_t>(e.val);
+						continue;
+					}
+				}
+				if ((e.op & 0xF0) != OP_BASE)
+				{
+					if (e.op == OP_END)
+					{
+						consume(e.bits);
+						break;
+					}
+					throw std::runtime_error("Invalid literal/length code.");
+				}
+				consume(e.bits);
+				size_t length = e.val + bits(e.op & 15);
+				consume(e.op & 15);
+
+				entry d = dist[bitbuf & ((1 << DIST_BITS) - 1)];
+				if (d.op & OP_SUBTABLE)
+				{
+					consume(DIST_BITS);
+					d = dist[d.val + bits(d.bits)];
+				}
+				if ((d.op & 0xF0) != OP_BASE)
+					throw std::runtime_error("Invalid distance code.");
+				consume(d.bits);
+				size_t distance = d.val + bits(d.op & 15);
+				consume(d.op & 15);
+
+				if (distance > size_t(out - obegin))
+					throw std::runtime_error("Invalid distance too far back.");
+
+				const uint8_t* src = out - distance;
+				uint8_t* target = out + length;
+				if (distance >= 8)
+				{
+					// Copy the first 16 bytes unconditionally, most matches are short.
+					std::memcpy(out, src, 8);
+					std::memcpy(out + 8, src + 8, 8);
+					out += 16;
+					src += 16;
+					while (out < target)
+					{
+						std::memcpy(out, src, 8);
+						out += 8;
+						src += 8;
+					}
+				}
+				else if (distance == 1)
+				{
+					std::memset(out, *src, length);
+				}
+				else
+				{
+					while (out < target)
+						*out++ = *src++;
+				}
+				out = target;
+				continue;
+			}
+
+			if (bitcount < 48)
+				refill();
+
+			entry e = litlen[bits(LITLEN_BITS)];
+			if (e.op & OP_SUBTABLE)
+			{
+				consume(LITLEN_BITS);
+				e = litlen[e.val + bits(e.bits)];
+			}
+			consume(e.bits);
+
+			if (e.op == OP_LITERAL)
+			{
+				if (out == oend)
+					grow(1);
+				*out++ = static_cast<uint8_t>(e.val);
+				continue;
+			}
+			if ((e.op & 0xF0) != OP_BASE)
+			{
+				if (e.op == OP_END)
+					break;
+				throw std::runtime_error("Invalid literal/length code.");
+			}
+
+			size_t length = e.val + bits(e.op & 15);
+			consume(e.op & 15);
+
+			entry d = dist[bits(DIST_BITS)];
+			if (d.op & OP_SUBTABLE)
+			{
+				consume(DIST_BITS);
+				d = dist[d.val + bits(d.bits)];
+			}
+			if ((d.op & 0xF0) != OP_BASE)
+				throw std::runtime_error("Invalid distance code.");
+			consume(d.bits);
+			size_t distance = d.val + bits(d.op & 15);
+			consume(d.op & 15);
+
+			if (distance > size_t(out - obegin))
+				throw std::runtime_error("Invalid distance too far back.");
+			if (size_t(oend - out) < length)
+				grow(length);
+
+			const uint8_t* src = out - distance;
+			uint8_t* target = out + length;
+			if (distance >= 8)
+			{
+				do
+				{
+					std::memcpy(out, src, 8);
+					out += 8;
+					src += 8;
+				} while (out < target);
+			}
+			else if (distance == 1)
+			{
+				std::memset(out, *src, length);
+			}
+			else
+			{
+				while (out < target)
+					*out++ = *src++;
+			}
+			out = target;
+		}
+	}
+
+	align();
+	size_t written = out - obegin;
+	if (gzip)
+	{
+		if (end - in < 8)
+			throw std::runtime_error("Compressed data is truncated.");
+		uint32_t expected = uint32_t(in[0]) | uint32_t(in[1]) << 8 | uint32_t(in[2]) << 16 | uint32_t(in[3]) << 24;
+		uint32_t isize = uint32_t(in[4]) | uint32_t(in[5]) << 8 | uint32_t(in[6]) << 16 | uint32_t(in[7]) << 24;
+		if (isize != static_cast<uint32_t>(written) || expected != crc32_z(0L, obegin, written))
+			throw std::runtime_error("Incorrect data check.");
+	}
+	else
+	{
+		if (end - in < 4)
+			throw std::runtime_error("Compressed data is truncated.");
+		uint32_t expected = uint32_t(in[0]) << 24 | uint32_t(in[1]) << 16 | uint32_t(in[2]) << 8 | uint32_t(in[3]);
+		if (expected != adler32_z(1L, obegin, written))
+			throw std::runtime_error("Incorrect data check.");
+	}
+
+	output.resize(written);
+	return written;
+}
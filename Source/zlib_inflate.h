@@ -0,0 +1,17 @@
+#ifndef ZLIB_INFLATE_H
+#define ZLIB_INFLATE_H
+
+#include "zlib_helper.h"
+
+namespace zlib
+{
+	// Whole-buffer DEFLATE decoder.
+	// Unlike zlib's inflate it never has to stop and resume in the middle of a
+	// stream, so it keeps everything in registers, refills its bit buffer a word
+	// at a time and copies matches a word at a time.
+	// type is zlib::ZLIB (which also accepts gzip, like inflateInit2 does) or zlib::GZIP.
+	// Decompresses into output, replacing its contents. Returns the decompressed size.
+	size_t InflateBuffer(const char* data, size_t size, int type, zlib::vector& output, size_t sizeHint = 0);
+}
+
+#endif // ZLIB_INFLATE_H